@@ -0,0 +1,240 @@
+#include "analyzer.h"
+#include <cmath>
+#include <iomanip>
+
+static const int GRANULARITY_SHIFT[3] = {12, 21, 30};
+static const char* GRANULARITY_NAME[3] = {"4K", "2M", "1G"};
+static const char* SEGMENT_NAME[3] = {"code", "stack", "heap"};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static size_t distanceBucket(double distance) {
+    if (distance < 1) {
+        return 0;
+    }
+    size_t b = 1 + size_t(log2(distance));
+    return min(b, ReuseDistanceTracker::BUCKETS - 2);
+}
+
+ReuseDistanceTracker::ReuseDistanceTracker(size_t capacity)
+    : capacity(capacity), threshold(UINT64_MAX), clock(0), buckets(BUCKETS, 0.0) {}
+
+double ReuseDistanceTracker::samplingRate() const {
+    return threshold == UINT64_MAX ? 1.0 : double(threshold) / double(UINT64_MAX);
+}
+
+void ReuseDistanceTracker::access(uint64_t key) {
+    uint64_t hash = mix64(key);
+    if (hash > threshold) {
+        return;
+    }
+    double rate = samplingRate();
+    uint64_t now = clock++;
+
+    auto it = last.find(key);
+    if (it != last.end()) {
+        // distinct sampled keys touched since the last access to this one
+        uint64_t since = times.size() - times.order_of_key(it->second.first + 1);
+        buckets[distanceBucket(since / rate)] += 1 / rate;
+        times.erase(it->second.first);
+        it->second.first = now;
+        times.insert(now);
+        return;
+    }
+
+    buckets[BUCKETS - 1] += 1 / rate;
+    last[key] = make_pair(now, hash);
+    times.insert(now);
+    byHash.insert(make_pair(hash, key));
+    // over capacity: lower the threshold below the largest tracked hash and forget that key
+    while (last.size() > capacity) {
+        auto victim = prev(byHash.end());
+        threshold = victim->first - 1;
+        auto v = last.find(victim->second);
+        times.erase(v->second.first);
+        last.erase(v);
+        byHash.erase(victim);
+    }
+}
+
+void DistinctCounter::add(uint64_t key) {
+    uint64_t hash = mix64(key);
+    if (smallest.size() < k) {
+        smallest.insert(hash);
+    } else if (hash < *smallest.rbegin() && smallest.find(hash) == smallest.end()) {
+        smallest.erase(prev(smallest.end()));
+        smallest.insert(hash);
+    }
+}
+
+double DistinctCounter::estimate() const {
+    if (smallest.size() < k) {
+        return smallest.size();
+    }
+    return (k - 1) / (double(*smallest.rbegin()) / double(UINT64_MAX));
+}
+
+TraceAnalyzer::TraceAnalyzer(const TraceAnalyzerOptions& options)
+    : options(options), events(0), accesses(0), currentWindow(0) {}
+
+TraceAnalyzer::ProcessProfile& TraceAnalyzer::profile(uint32_t pid) {
+    auto it = processes.find(pid);
+    if (it == processes.end()) {
+        it = processes.emplace(pid, ProcessProfile()).first;
+        for (auto& segment : it->second.segments) {
+            segment.reuse.assign(GRANULARITIES, ReuseDistanceTracker(options.samples));
+        }
+    }
+    return it->second;
+}
+
+void TraceAnalyzer::closeWindow() {
+    for (auto& p : processes) {
+        ProcessProfile& proc = p.second;
+        if (proc.windowAccesses == 0) {
+            continue;
+        }
+        WorkingSetSample sample;
+        sample.window = currentWindow;
+        for (int g = 0; g < GRANULARITIES; g++) {
+            sample.pages[g] = proc.window[g].estimate();
+            proc.window[g].clear();
+        }
+        proc.workingSet.push_back(sample);
+        proc.windowAccesses = 0;
+    }
+    currentWindow++;
+}
+
+void TraceAnalyzer::observe(const TraceEvent& event) {
+    events++;
+    ProcessProfile& proc = profile(event.pid);
+    if (event.instruction == "alloc") {
+        proc.allocSizes[event.value == 0 ? 0 : 63 - __builtin_clzll(event.value)]++;
+        return;
+    }
+    if (event.instruction == "free") {
+        proc.frees++;
+        return;
+    }
+    if (!isAccessInstruction(event.instruction)) {
+        return;
+    }
+
+    int segment = event.instruction == "access_code" ? 0 : event.instruction == "access_stak" ? 1 : 2;
+    SegmentProfile& seg = proc.segments[segment];
+    seg.accesses++;
+    for (int g = 0; g < GRANULARITIES; g++) {
+        uint64_t page = event.value >> GRANULARITY_SHIFT[g];
+        seg.reuse[g].access(page);
+        proc.window[g].add(page);
+    }
+    proc.windowAccesses++;
+    if (++accesses % options.window == 0) {
+        closeWindow();
+    }
+}
+
+static string bucketLabel(size_t b) {
+    if (b == ReuseDistanceTracker::BUCKETS - 1) {
+        return "cold";
+    }
+    if (b == 0) {
+        return "0";
+    }
+    uint64_t lo = 1ULL << (b - 1);
+    if (b == ReuseDistanceTracker::BUCKETS - 2) {
+        return to_string(lo) + "+";
+    }
+    uint64_t hi = (1ULL << b) - 1;
+    return lo == hi ? to_string(lo) : to_string(lo) + "-" + to_string(hi);
+}
+
+void TraceAnalyzer::printReport(ostream& out) {
+    // flush the partial last window
+    bool partial = false;
+    for (const auto& p : processes) {
+        partial = partial || p.second.windowAccesses > 0;
+    }
+    if (partial) {
+        closeWindow();
+    }
+
+    out << "Trace analysis: " << events << " events, " << accesses << " accesses, "
+        << processes.size() << " processes" << endl;
+
+    for (const auto& p : processes) {
+        uint32_t pid = p.first;
+        const ProcessProfile& proc = p.second;
+
+        for (int s = 0; s < 3; s++) {
+            const SegmentProfile& seg = proc.segments[s];
+            if (seg.accesses == 0) {
+                continue;
+            }
+            out << endl << "pid " << pid << " " << SEGMENT_NAME[s] << ": " << seg.accesses << " accesses" << endl;
+            out << "  reuse distance";
+            for (int g = 0; g < GRANULARITIES; g++) {
+                out << setw(12) << GRANULARITY_NAME[g];
+            }
+            out << endl;
+            for (size_t b = 0; b < ReuseDistanceTracker::BUCKETS; b++) {
+                bool any = false;
+                for (int g = 0; g < GRANULARITIES; g++) {
+                    any = any || seg.reuse[g].histogram()[b] > 0;
+                }
+                if (!any) {
+                    continue;
+                }
+                out << "  " << left << setw(14) << bucketLabel(b) << right;
+                for (int g = 0; g < GRANULARITIES; g++) {
+                    out << setw(12) << llround(seg.reuse[g].histogram()[b]);
+                }
+                out << endl;
+            }
+            out << "  sampling rate ";
+            for (int g = 0; g < GRANULARITIES; g++) {
+                out << setw(12) << setprecision(4) << seg.reuse[g].samplingRate();
+            }
+            out << setprecision(6) << endl;
+        }
+
+        out << endl << "pid " << pid << " working set per " << options.window << " accesses (distinct pages)" << endl;
+        out << "  window" << setw(12) << "4K" << setw(12) << "2M" << setw(12) << "1G" << setw(14) << "4K bytes" << endl;
+        for (const auto& sample : proc.workingSet) {
+            out << "  " << left << setw(6) << sample.window << right;
+            for (int g = 0; g < GRANULARITIES; g++) {
+                out << setw(12) << llround(sample.pages[g]);
+            }
+            out << setw(14) << llround(sample.pages[0]) * 4096 << endl;
+        }
+
+        uint64_t allocs = 0;
+        for (const auto& a : proc.allocSizes) {
+            allocs += a.second;
+        }
+        out << endl << "pid " << pid << " allocations: " << allocs << ", frees: " << proc.frees << endl;
+        if (allocs == 0) {
+            continue;
+        }
+        // test_generator.py draws the rank of a power-of-two size (4KB is rank 1) from zipf(a);
+        // discrete power-law MLE on those ranks, approximate because the generator drops unaligned sizes
+        double logSum = 0;
+        for (const auto& a : proc.allocSizes) {
+            double rank = a.first >= 12 ? a.first - 11 : 1;
+            logSum += a.second * log(rank / 0.5);
+        }
+        for (const auto& a : proc.allocSizes) {
+            out << "  " << left << setw(12) << (1ULL << a.first) << right << setw(10) << a.second
+                << setw(12) << 1.0 * a.second / allocs << endl;
+        }
+        out << "  zipf exponent (approx.): " << 1 + allocs / logSum << endl;
+    }
+}
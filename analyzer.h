@@ -0,0 +1,107 @@
+// analyzer.h
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include "trace.h"
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+
+using namespace std;
+
+/**
+ * Single-pass trace characterisation, no simulation.
+ * Per pid and segment (code, stack, heap): reuse-distance histograms at 4KB, 2MB and 1GB granularity.
+ * Per pid: working-set size over windows of accesses, and the allocation-size distribution.
+ * Memory is bounded whatever the trace length: reuse distances use fixed-size SHARDS sampling
+ * (only keys whose hash is under a threshold are tracked, the threshold drops to keep at most
+ * `samples` keys and the counts are scaled back up), and working sets use k-minimum-values sketches.
+ */
+class ReuseDistanceTracker {
+public:
+    explicit ReuseDistanceTracker(size_t capacity = 8192);
+
+    void access(uint64_t key);
+
+    // bucket 0: distance 0, bucket b: distance in [2^(b-1), 2^b), last bucket: first reference
+    static const size_t BUCKETS = 42;
+    const vector<double>& histogram() const { return buckets; }
+    double samplingRate() const;
+
+private:
+    typedef __gnu_pbds::tree<uint64_t, __gnu_pbds::null_type, less<uint64_t>, __gnu_pbds::rb_tree_tag,
+                             __gnu_pbds::tree_order_statistics_node_update> OrderedTimes;
+
+    size_t capacity;
+    uint64_t threshold;   // keys with hash <= threshold are sampled
+    uint64_t clock;
+    unordered_map<uint64_t, pair<uint64_t, uint64_t> > last;   // key -> (last access time, hash)
+    OrderedTimes times;                                        // last access time of every tracked key
+    set<pair<uint64_t, uint64_t> > byHash;                     // (hash, key), to evict the largest hash
+    vector<double> buckets;
+};
+
+// distinct keys estimated from the k smallest hashes seen
+class DistinctCounter {
+public:
+    explicit DistinctCounter(size_t k = 1024) : k(k) {}
+    void add(uint64_t key);
+    double estimate() const;
+    void clear() { smallest.clear(); }
+
+private:
+    size_t k;
+    set<uint64_t> smallest;
+};
+
+struct TraceAnalyzerOptions {
+    size_t samples = 8192;   // keys tracked per reuse-distance histogram
+    size_t window = 10000;   // accesses per working-set window
+};
+
+class TraceAnalyzer {
+public:
+    explicit TraceAnalyzer(const TraceAnalyzerOptions& options = TraceAnalyzerOptions());
+
+    void observe(const TraceEvent& event);
+    void printReport(ostream& out = cout);
+
+private:
+    // 4KB, 2MB, 1GB
+    static const int GRANULARITIES = 3;
+
+    struct SegmentProfile {
+        uint64_t accesses = 0;
+        vector<ReuseDistanceTracker> reuse;
+    };
+
+    struct WorkingSetSample {
+        uint64_t window;
+        double pages[GRANULARITIES];
+    };
+
+    struct ProcessProfile {
+        SegmentProfile segments[3];   // code, stack, heap
+        DistinctCounter window[GRANULARITIES];
+        uint64_t windowAccesses = 0;
+        vector<WorkingSetSample> workingSet;
+        map<uint32_t, uint64_t> allocSizes;   // log2(size) -> allocations
+        uint64_t frees = 0;
+    };
+
+    TraceAnalyzerOptions options;
+    uint64_t events;
+    uint64_t accesses;
+    uint64_t currentWindow;
+    map<uint32_t, ProcessProfile> processes;
+
+    ProcessProfile& profile(uint32_t pid);
+    void closeWindow();
+};
+
+#endif // ANALYZER_H
@@ -0,0 +1,117 @@
+#include "cache.h"
+#include <sstream>
+#include <stdexcept>
+
+thread_local int Walk_served[CACHE_MAX_LEVELS + 1] = {};
+thread_local int Walk_ref_served[CACHE_MAX_LEVELS + 1] = {};
+thread_local int Data_served[CACHE_MAX_LEVELS + 1] = {};
+
+static uint32_t parseBytes(const string& text) {
+    size_t end = 0;
+    unsigned long value;
+    try {
+        value = stoul(text, &end);
+    } catch (const exception&) {
+        throw invalid_argument("bad size " + text);
+    }
+    string suffix = text.substr(end);
+    if (suffix == "K" || suffix == "k") {
+        value <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        value <<= 20;
+    } else if (!suffix.empty()) {
+        throw invalid_argument("bad size " + text);
+    }
+    return value;
+}
+
+static bool isPowerOfTwo(uint32_t value) {
+    return value != 0 && (value & (value - 1)) == 0;
+}
+
+CacheConfig parseCacheLevel(const string& spec) {
+    vector<string> fields;
+    stringstream ss(spec);
+    string field;
+    while (getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.empty() || fields.size() > 3) {
+        throw invalid_argument("expected size[:ways|full[:line]]");
+    }
+    CacheConfig config = {parseBytes(fields[0]), 8, 64};
+    if (fields.size() > 1) {
+        config.ways = fields[1] == "full" ? 0 : parseBytes(fields[1]);
+    }
+    if (fields.size() > 2) {
+        config.lineSize = parseBytes(fields[2]);
+    }
+    if (!isPowerOfTwo(config.lineSize) || config.size < config.lineSize || config.size % config.lineSize != 0) {
+        throw invalid_argument("the size must be a multiple of the line size, a power of two");
+    }
+    uint32_t lines = config.size / config.lineSize;
+    if (config.ways != 0 && lines % config.ways != 0) {
+        throw invalid_argument("size must be a multiple of ways * line size");
+    }
+    return config;
+}
+
+string cacheLevelSpec(const CacheConfig& config) {
+    return to_string(config.size) + ":" + (config.ways == 0 ? string("full") : to_string(config.ways)) + ":"
+           + to_string(config.lineSize);
+}
+
+CacheHierarchy::CacheHierarchy() : clock(0) {}
+
+void CacheHierarchy::configure(const vector<CacheConfig>& configs) {
+    if (configs.size() > size_t(CACHE_MAX_LEVELS)) {
+        throw invalid_argument("at most " + to_string(CACHE_MAX_LEVELS) + " cache levels");
+    }
+    levels.clear();
+    for (const CacheConfig& config : configs) {
+        Level level;
+        level.config = config;
+        uint32_t lines = config.size / config.lineSize;
+        level.ways = config.ways == 0 ? lines : config.ways;
+        level.sets = lines / level.ways;
+        level.lineBits = __builtin_ctz(config.lineSize);
+        level.tags.assign(lines, 0);
+        level.stamps.assign(lines, 0);
+        levels.push_back(level);
+    }
+}
+
+bool CacheHierarchy::enabled() const {
+    return !levels.empty();
+}
+
+size_t CacheHierarchy::levelCount() const {
+    return levels.size();
+}
+
+bool CacheHierarchy::lookUpOrFill(Level& level, uint64_t address) {
+    uint64_t line = address >> level.lineBits;
+    size_t first = size_t(line % level.sets) * level.ways;
+    size_t victim = first;
+    for (size_t w = first; w < first + level.ways; w++) {
+        if (level.tags[w] == line + 1) {
+            level.stamps[w] = ++clock;
+            return true;
+        }
+        if (level.stamps[w] < level.stamps[victim]) {
+            victim = w;
+        }
+    }
+    level.tags[victim] = line + 1;
+    level.stamps[victim] = ++clock;
+    return false;
+}
+
+size_t CacheHierarchy::access(uint64_t address) {
+    for (size_t k = 0; k < levels.size(); k++) {
+        if (lookUpOrFill(levels[k], address)) {
+            return k;
+        }
+    }
+    return CACHE_MEMORY;
+}
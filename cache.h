@@ -0,0 +1,65 @@
+// cache.h
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// data cache levels (l1d, l2, llc, ...); the counters keep one more slot for memory
+static const int CACHE_MAX_LEVELS = 4;
+static const size_t CACHE_MEMORY = CACHE_MAX_LEVELS;
+
+// thread_local counters, indexed by the level that served the reference (0 for the first cache,
+// CACHE_MEMORY for memory)
+extern thread_local int Walk_served[CACHE_MAX_LEVELS + 1];     // walks, by the slowest of their references
+extern thread_local int Walk_ref_served[CACHE_MAX_LEVELS + 1]; // single page-table references
+extern thread_local int Data_served[CACHE_MAX_LEVELS + 1];     // data accesses
+
+struct CacheConfig {
+    uint32_t size;       // bytes
+    uint32_t ways;       // 0: fully associative
+    uint32_t lineSize;   // bytes
+};
+
+// "size[:ways|full[:line]]", the size may end in K or M, e.g. "32K:8" or "8M:16:64"; defaults 8 ways, 64B lines.
+// throws invalid_argument on a malformed spec
+CacheConfig parseCacheLevel(const string& spec);
+string cacheLevelSpec(const CacheConfig& config);
+
+/**
+ * Physically-indexed set-associative lru data cache hierarchy.
+ * A reference looks the line up from the first level down and fills it into every level that missed,
+ * so page-table walks and data accesses compete for the same lines.
+ */
+class CacheHierarchy {
+public:
+    CacheHierarchy();
+
+    void configure(const vector<CacheConfig>& configs);
+    bool enabled() const;
+    size_t levelCount() const;
+
+    // reference the line holding a physical address, return the level that served it (CACHE_MEMORY for memory)
+    size_t access(uint64_t address);
+
+private:
+    struct Level {
+        CacheConfig config;
+        uint32_t sets;
+        uint32_t ways;
+        uint32_t lineBits;
+        vector<uint64_t> tags;      // line number + 1, 0 for an empty way
+        vector<uint64_t> stamps;
+    };
+
+    vector<Level> levels;
+    uint64_t clock;
+
+    // true on a hit (the line becomes most recently used), otherwise the lru way is replaced by the line
+    bool lookUpOrFill(Level& level, uint64_t address);
+};
+
+#endif // CACHE_H
@@ -0,0 +1,18 @@
+# a miss in l1 must reach the shared l2: with --l2-size the l2 serves hits, and --l2-partition
+# repartitions it by pid
+# usage: sh check-l2.sh [simulator] [trace]
+sim=${1:-./a.out}
+trace=${2:-test_cases/local_90_8_3.txt}
+for partition in "" "--l2-partition 1000"; do
+    report=$("$sim" "$trace" --l1-size 16 --l2-size 256 $partition)
+    rate=$(echo "$report" | grep "L2 hit rate:" | awk '{print $4}')
+    echo "l2 ${partition:-shared}: hit rate $rate"
+    if [ -z "$rate" ] || [ "$rate" = "0" ]; then
+        echo "no l2 hits"
+        exit 1
+    fi
+done
+if ! "$sim" "$trace" --l1-size 16 --l2-size 256 --l2-partition 1000 | grep -q "utility partitioned"; then
+    echo "--l2-partition left the l2 shared"
+    exit 1
+fi
@@ -0,0 +1,19 @@
+# the adaptive l1 policies must each make their own choices: on a small l1 lru, arc, drrip and ship
+# give four different miss counts on the same trace
+# usage: sh check-policies.sh [simulator] [trace]
+sim=${1:-./a.out}
+trace=${2:-test_cases/local_50_4_2.txt}
+counts=""
+for policy in lru arc drrip ship; do
+    misses=$("$sim" "$trace" --l1-size 16 --l1-policy $policy | grep "TLB misses" | awk '{print $3}')
+    if [ -z "$misses" ]; then
+        echo "$policy: no miss count"
+        exit 1
+    fi
+    echo "$policy: $misses misses"
+    counts="$counts$misses\n"
+done
+if [ $(printf "$counts" | sort -u | wc -l) -ne 4 ]; then
+    echo "two policies gave the same miss count"
+    exit 1
+fi
@@ -0,0 +1,163 @@
+#include "compaction.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+static const uint32_t FRAME_SIZE = 4096;
+
+const char* compactionModeName(CompactionMode mode) {
+    switch (mode) {
+        case COMPACT_ON_FAILURE: return "on-failure";
+        case COMPACT_INCREMENTAL: return "incremental";
+        default: return "off";
+    }
+}
+
+void parseCompactionMode(const string& spec, CompactionConfig& config) {
+    stringstream ss(spec);
+    string field;
+    vector<string> fields;
+    while (getline(ss, field, ':')) {
+        fields.push_back(field);
+    }
+    if (fields.empty()) {
+        throw invalid_argument("empty compaction mode");
+    }
+    if (fields[0] == "off" && fields.size() == 1) {
+        config.mode = COMPACT_OFF;
+    } else if (fields[0] == "on-failure" && fields.size() == 1) {
+        config.mode = COMPACT_ON_FAILURE;
+    } else if (fields[0] == "incremental" && fields.size() <= 3) {
+        config.mode = COMPACT_INCREMENTAL;
+        uint32_t* values[] = {&config.interval, &config.budget};
+        for (size_t i = 1; i < fields.size(); i++) {
+            size_t end = 0;
+            unsigned long value = 0;
+            try {
+                value = stoul(fields[i], &end);
+            } catch (const exception&) {
+                end = 0;
+            }
+            if (end == 0 || end != fields[i].size() || value == 0) {
+                throw invalid_argument("bad number " + fields[i]);
+            }
+            *values[i - 1] = value;
+        }
+    } else {
+        throw invalid_argument("unknown compaction mode " + spec);
+    }
+}
+
+Compactor::Compactor() : deferredSizes(0), ticks(0) {}
+
+void Compactor::configure(const CompactionConfig& config) {
+    settings = config;
+    deferredSizes = 0;
+    ticks = 0;
+}
+
+const CompactionConfig& Compactor::config() const {
+    return settings;
+}
+
+bool Compactor::enabled() const {
+    return settings.mode != COMPACT_OFF;
+}
+
+bool Compactor::deferred(uint32_t size) const {
+    return (deferredSizes >> __builtin_ctz(size)) & 1;
+}
+
+void Compactor::defer(uint32_t size) {
+    deferredSizes |= 1u << __builtin_ctz(size);
+}
+
+void Compactor::clearDeferred() {
+    deferredSizes = 0;
+}
+
+bool Compactor::tick() {
+    if (settings.mode != COMPACT_INCREMENTAL || ++ticks < settings.interval) {
+        return false;
+    }
+    ticks = 0;
+    return true;
+}
+
+double Compactor::hugeSuccessRate() const {
+    return hugeRequests == 0 ? 0.0 : 100.0 * hugeSuccesses / hugeRequests;
+}
+
+bool Compactor::hasFreeBlock(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end) {
+    size_t block;
+    return findFreeBlock(memoryMap, pages, first, end, block);
+}
+
+bool Compactor::findFreeBlock(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end, size_t& block) {
+    size_t start = (first + pages - 1) / pages * pages;
+    while (start + pages <= end) {
+        size_t freePages = 0;
+        while (freePages < pages && !memoryMap[start + freePages]) {
+            freePages++;
+        }
+        if (freePages == pages) {
+            block = start;
+            return true;
+        }
+        start = ((start + freePages) / pages + 1) * pages;
+    }
+    return false;
+}
+
+bool Compactor::chooseBlock(const vector<bool>& memoryMap, const Reclaimer& reclaimer, size_t pages, size_t first,
+                            size_t end, size_t budget, size_t& block) {
+    // a block can hold at most pages used frames, so pages + 1 means none found
+    size_t bestUsed = min(budget, pages) + 1;
+    for (size_t start = (first + pages - 1) / pages * pages; start + pages <= end; start += pages) {
+        size_t used = 0;
+        bool movable = true;
+        for (size_t pfn = start; pfn < start + pages && movable && used < bestUsed;) {
+            ReclaimVictim page;
+            if (!memoryMap[pfn]) {
+                pfn++;
+            } else if (reclaimer.lookUp(pfn, page) && page.page_size / FRAME_SIZE <= pages) {
+                used += page.page_size / FRAME_SIZE;
+                pfn += page.page_size / FRAME_SIZE;
+            } else {
+                movable = false;
+            }
+        }
+        if (movable && used < bestUsed) {
+            bestUsed = used;
+            block = start;
+            if (used == 0) {
+                return true;
+            }
+        }
+    }
+    if (bestUsed > min(budget, pages)) {
+        return false;
+    }
+    // the free frames outside the block have to take everything in it
+    size_t freeFrames = count(memoryMap.begin() + first, memoryMap.begin() + end, false);
+    return freeFrames - (pages - bestUsed) >= bestUsed;
+}
+
+bool Compactor::findTarget(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end, size_t skip,
+                           size_t skipPages, size_t& pfn) {
+    for (size_t top = end / pages * pages; top >= first + pages; top -= pages) {
+        size_t start = top - pages;
+        if (start < skip + skipPages && skip < top) {
+            continue;
+        }
+        size_t freePages = 0;
+        while (freePages < pages && !memoryMap[start + freePages]) {
+            freePages++;
+        }
+        if (freePages == pages) {
+            pfn = start;
+            return true;
+        }
+    }
+    return false;
+}
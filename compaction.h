@@ -0,0 +1,85 @@
+// compaction.h
+#ifndef COMPACTION_H
+#define COMPACTION_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "reclaimer.h"
+
+using namespace std;
+
+// when the os migrates pages to rebuild aligned free blocks
+//   off:          never, a large allocation that finds no aligned block is split into smaller pages
+//   on-failure:   before splitting, compact a block of the requested size (direct compaction)
+//   incremental:  on-failure, and every interval events a kcompactd pass keeps a free block of blockSize
+//                 on every node, migrating at most budget 4KB pages per pass
+enum CompactionMode { COMPACT_OFF, COMPACT_ON_FAILURE, COMPACT_INCREMENTAL };
+
+struct CompactionConfig {
+    CompactionMode mode = COMPACT_OFF;
+    uint32_t interval = 1000;
+    uint32_t budget = 512;
+    uint32_t blockSize = 2 * 1024 * 1024;
+};
+
+const char* compactionModeName(CompactionMode mode);
+// "off", "on-failure" or "incremental[:interval[:budget]]"; throws invalid_argument otherwise
+void parseCompactionMode(const string& spec, CompactionConfig& config);
+
+/**
+ * Picks what to migrate for memory compaction, in the style of the kernel's migrate and free scanners.
+ * A block is an aligned run of frames the size of the page wanted. It can be compacted when every used
+ * frame in it belongs to a mapping the reclaimer tracks that lies wholly inside it: shared (forked)
+ * frames, mappings being built and pages larger than the block stay put. The os moves the mappings to
+ * free frames found from the top of memory down, so the two scanners meet instead of undoing each other.
+ * A size that failed to compact is deferred until frames are freed again.
+ */
+class Compactor {
+public:
+    // counters
+    long long runs = 0;              // compaction attempts, direct and incremental
+    long long blocksFreed = 0;       // ... that left a whole aligned block free
+    long long failures = 0;          // no movable block, or no room outside it
+    long long deferredRuns = 0;      // attempts skipped for a size that just failed
+    long long passes = 0;            // kcompactd passes
+    long long pagesMigrated = 0;     // 4KB frames moved
+    long long bytesMigrated = 0;
+    long long hugeRequests = 0;      // mappings above 4KB asked for
+    long long hugeSuccesses = 0;     // ... backed by one page of the size asked for
+
+    Compactor();
+
+    void configure(const CompactionConfig& config);
+    const CompactionConfig& config() const;
+    bool enabled() const;
+
+    bool deferred(uint32_t size) const;
+    void defer(uint32_t size);
+    // frames were freed, every size may compact again
+    void clearDeferred();
+    // one event went by: true when a kcompactd pass is due
+    bool tick();
+
+    double hugeSuccessRate() const;
+
+    // whether [first, end) holds a free aligned block of pages frames
+    static bool hasFreeBlock(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end);
+    // ... and the first one
+    static bool findFreeBlock(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end, size_t& block);
+    // the movable aligned block of pages frames in [first, end) with the fewest used frames (at most budget),
+    // provided the rest of the range has room for them
+    static bool chooseBlock(const vector<bool>& memoryMap, const Reclaimer& reclaimer, size_t pages, size_t first,
+                            size_t end, size_t budget, size_t& block);
+    // the highest free aligned run of pages frames in [first, end) outside [skip, skip + skipPages)
+    static bool findTarget(const vector<bool>& memoryMap, size_t pages, size_t first, size_t end, size_t skip,
+                           size_t skipPages, size_t& pfn);
+
+private:
+    CompactionConfig settings;
+    uint32_t deferredSizes;          // bit log2(size) set for a deferred size
+    uint32_t ticks;
+};
+
+#endif // COMPACTION_H
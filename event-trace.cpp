@@ -0,0 +1,281 @@
+#include "event-trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+bool Event_trace_on = false;
+
+// one per thread that recorded: only its thread writes it, the registry only hands it out
+struct EventRing {
+    vector<SimEvent> events;
+    uint64_t written = 0;
+    uint32_t thread = 0;
+};
+
+static mutex ringsLock;
+static vector<unique_ptr<EventRing> > rings;   // never shrinks, threads keep pointers into it
+static size_t ringCapacity = 1;
+static chrono::steady_clock::time_point traceStart;
+static thread_local EventRing* threadRing = nullptr;
+
+static EventRing* registerRing() {
+    lock_guard<mutex> lock(ringsLock);
+    rings.emplace_back(new EventRing());
+    EventRing* ring = rings.back().get();
+    ring->events.resize(ringCapacity);
+    ring->thread = rings.size() - 1;
+    return ring;
+}
+
+// the events of a ring, oldest first
+static vector<SimEvent> ringEvents(const EventRing& ring) {
+    vector<SimEvent> ret;
+    size_t capacity = ring.events.size();
+    uint64_t first = ring.written > capacity ? ring.written - capacity : 0;
+    for (uint64_t i = first; i < ring.written; i++) {
+        ret.push_back(ring.events[i % capacity]);
+    }
+    return ret;
+}
+
+// an event and, for a span, its end, in time order
+struct Point {
+    uint64_t ts;
+    const SimEvent* event;
+    bool end;
+};
+
+static vector<Point> timeline(const vector<SimEvent>& events) {
+    vector<Point> ret;
+    for (const auto& e : events) {
+        ret.push_back(Point{e.ts, &e, false});
+        if (e.kind == SIM_EVENT_WALK) {
+            ret.push_back(Point{e.ts + e.dur, &e, true});
+        }
+    }
+    stable_sort(ret.begin(), ret.end(), [](const Point& a, const Point& b) { return a.ts < b.ts; });
+    return ret;
+}
+
+static const char* argName(const SimEvent& e) {
+    return e.kind == SIM_EVENT_MIGRATE ? "frame" : "page_size";
+}
+
+// fills, evictions and context-switch flushes name their TLB level
+static string eventName(const SimEvent& e) {
+    string name = simEventName(SimEventKind(e.kind));
+    if (e.kind == SIM_EVENT_FILL || e.kind == SIM_EVENT_EVICT || (e.kind == SIM_EVENT_FLUSH && e.tag == 0)) {
+        name += e.level == 0 ? " itlb" : " l" + to_string(e.level);
+    }
+    return name;
+}
+
+static void writeChrome(ostream& out) {
+    char buffer[256];
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto& ring : rings) {
+        if (ring->written == 0) {
+            continue;
+        }
+        out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->thread
+            << ",\"args\":{\"name\":\"simulator thread " << ring->thread << "\"}}";
+        first = false;
+        vector<SimEvent> events = ringEvents(*ring);
+        for (const auto& e : events) {
+            bool tlbEvent = e.kind <= SIM_EVENT_INVALIDATE;
+            // ts and dur are in microseconds
+            snprintf(buffer, sizeof(buffer), "\"ts\":%llu.%03llu", (unsigned long long)(e.ts / 1000),
+                     (unsigned long long)(e.ts % 1000));
+            out << ",\n{\"name\":\"" << eventName(e) << "\",\"cat\":\"" << (tlbEvent ? "tlb" : "memory") << "\","
+                << buffer << ",\"pid\":1,\"tid\":" << ring->thread;
+            if (e.kind == SIM_EVENT_WALK) {
+                snprintf(buffer, sizeof(buffer), ",\"ph\":\"X\",\"dur\":%u.%03u", e.dur / 1000, e.dur % 1000);
+                out << buffer;
+            } else {
+                out << ",\"ph\":\"i\",\"s\":\"t\"";
+            }
+            snprintf(buffer, sizeof(buffer), ",\"args\":{\"tag\":%u,\"vpn\":\"0x%llx\",\"%s\":%u}}", e.tag,
+                     (unsigned long long)e.vpn, argName(e), e.arg);
+            out << buffer;
+        }
+    }
+    out << "\n]}\n";
+}
+
+// protobuf wire format, just what a Trace of TrackEvent packets needs
+static void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+static void putField(string& out, int field, uint64_t value) {
+    putVarint(out, uint64_t(field) << 3);
+    putVarint(out, value);
+}
+
+static void putBytes(string& out, int field, const string& bytes) {
+    putVarint(out, (uint64_t(field) << 3) | 2);
+    putVarint(out, bytes.size());
+    out += bytes;
+}
+
+// DebugAnnotation {name = 10, uint_value = 3}
+static string annotation(const char* name, uint64_t value) {
+    string ret;
+    putBytes(ret, 10, name);
+    putField(ret, 3, value);
+    return ret;
+}
+
+// TracePacket fields
+static const int PACKET_TIMESTAMP = 8;
+static const int PACKET_SEQUENCE_ID = 10;
+static const int PACKET_TRACK_EVENT = 11;
+static const int PACKET_SEQUENCE_FLAGS = 13;
+static const int PACKET_TRACK_DESCRIPTOR = 60;
+// TrackEvent fields and types
+static const int EVENT_ANNOTATIONS = 4;
+static const int EVENT_TYPE = 9;
+static const int EVENT_TRACK = 11;
+static const int EVENT_NAME = 23;
+static const int SLICE_BEGIN = 1;
+static const int SLICE_END = 2;
+static const int INSTANT = 3;
+
+static void writePerfetto(ostream& out) {
+    string trace;
+    bool first = true;
+    for (const auto& ring : rings) {
+        if (ring->written == 0) {
+            continue;
+        }
+        uint64_t track = ring->thread + 1;
+        string descriptor;
+        putField(descriptor, 1, track);
+        putBytes(descriptor, 2, "simulator thread " + to_string(ring->thread));
+        string packet;
+        putBytes(packet, PACKET_TRACK_DESCRIPTOR, descriptor);
+        putField(packet, PACKET_SEQUENCE_ID, 1);
+        if (first) {
+            putField(packet, PACKET_SEQUENCE_FLAGS, 1);    // SEQ_INCREMENTAL_STATE_CLEARED
+            first = false;
+        }
+        putBytes(trace, 1, packet);
+
+        vector<SimEvent> events = ringEvents(*ring);
+        for (const auto& point : timeline(events)) {
+            const SimEvent& e = *point.event;
+            string event;
+            putField(event, EVENT_TYPE, point.end ? SLICE_END : e.kind == SIM_EVENT_WALK ? SLICE_BEGIN : INSTANT);
+            putField(event, EVENT_TRACK, track);
+            if (!point.end) {
+                putBytes(event, EVENT_NAME, eventName(e));
+                putBytes(event, EVENT_ANNOTATIONS, annotation("tag", e.tag));
+                putBytes(event, EVENT_ANNOTATIONS, annotation("vpn", e.vpn));
+                putBytes(event, EVENT_ANNOTATIONS, annotation(argName(e), e.arg));
+            }
+            packet.clear();
+            putField(packet, PACKET_TIMESTAMP, point.ts);
+            putBytes(packet, PACKET_TRACK_EVENT, event);
+            putField(packet, PACKET_SEQUENCE_ID, 1);
+            putBytes(trace, 1, packet);
+        }
+    }
+    out.write(trace.data(), trace.size());
+}
+
+const char* simEventName(SimEventKind kind) {
+    switch (kind) {
+        case SIM_EVENT_FILL: return "fill";
+        case SIM_EVENT_EVICT: return "evict";
+        case SIM_EVENT_FLUSH: return "flush";
+        case SIM_EVENT_INVALIDATE: return "invalidate";
+        case SIM_EVENT_WALK: return "walk";
+        case SIM_EVENT_SWAP_OUT: return "swap-out";
+        case SIM_EVENT_SWAP_IN: return "swap-in";
+        case SIM_EVENT_SWITCH: return "switch";
+        case SIM_EVENT_MIGRATE: return "migrate";
+        case SIM_EVENT_PROMOTE: return "promote";
+        case SIM_EVENT_DEMOTE: return "demote";
+        case SIM_EVENT_BREAK: return "break";
+        default: return "unknown";
+    }
+}
+
+void startEventTrace(size_t capacity) {
+    lock_guard<mutex> lock(ringsLock);
+    ringCapacity = max<size_t>(capacity, 1);
+    for (auto& ring : rings) {
+        ring->events.assign(ringCapacity, SimEvent());
+        ring->written = 0;
+    }
+    traceStart = chrono::steady_clock::now();
+    Event_trace_on = true;
+}
+
+void stopEventTrace() {
+    Event_trace_on = false;
+}
+
+uint64_t eventTraceClock() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - traceStart).count();
+}
+
+void recordSimEvent(SimEventKind kind, int level, uint32_t tag, uint64_t vpn, uint32_t arg, uint64_t start, bool span) {
+    if (threadRing == nullptr) {
+        threadRing = registerRing();
+    }
+    SimEvent& e = threadRing->events[threadRing->written % threadRing->events.size()];
+    uint64_t now = eventTraceClock();
+    e.ts = span ? start : now;
+    e.dur = span ? now - start : 0;
+    e.vpn = vpn;
+    e.tag = tag;
+    e.arg = arg;
+    e.kind = kind;
+    e.level = level;
+    threadRing->written++;
+}
+
+size_t eventTraceSize() {
+    lock_guard<mutex> lock(ringsLock);
+    size_t ret = 0;
+    for (const auto& ring : rings) {
+        ret += min<uint64_t>(ring->written, ring->events.size());
+    }
+    return ret;
+}
+
+size_t eventTraceOverwritten() {
+    lock_guard<mutex> lock(ringsLock);
+    size_t ret = 0;
+    for (const auto& ring : rings) {
+        ret += ring->written - min<uint64_t>(ring->written, ring->events.size());
+    }
+    return ret;
+}
+
+void writeEventTrace(const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        throw runtime_error("unable to open " + path);
+    }
+    lock_guard<mutex> lock(ringsLock);
+    if (path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0) {
+        writeChrome(out);
+    } else {
+        writePerfetto(out);
+    }
+    if (!out) {
+        throw runtime_error("error writing " + path);
+    }
+}
@@ -0,0 +1,82 @@
+// event-trace.h
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+/**
+ * Opt-in record of what the simulator did: TLB fills, evictions, flushes and invalidations, page walks,
+ * swap-outs, swap-ins, context switches, compaction moves, and reservation promotions, demotions and breaks.
+ * Recording is compiled in only with -DVMSIM_TRACING (make tracing, or cmake -DVMSIM_TRACING=ON);
+ * otherwise the SIM_EVENT macros expand to nothing. Every thread writes its own ring buffer
+ * without locking, the oldest events being overwritten once it is full. The rings are written
+ * out as Chrome trace JSON (chrome://tracing, Perfetto) or as a Perfetto protobuf trace.
+ */
+enum SimEventKind {
+    SIM_EVENT_FILL,         // a TLB level took an entry
+    SIM_EVENT_EVICT,        // ... and dropped another for it
+    SIM_EVENT_FLUSH,        // l1 flushed on a context switch (tag 0), or a process's entries on exit
+    SIM_EVENT_INVALIDATE,   // a page's entries dropped after a swap-out, a migration or a copy-on-write
+    SIM_EVENT_WALK,         // a page walk, timed from the miss to the fill
+    SIM_EVENT_SWAP_OUT,
+    SIM_EVENT_SWAP_IN,
+    SIM_EVENT_SWITCH,
+    SIM_EVENT_MIGRATE,      // compaction moved a mapping, arg is the new frame
+    SIM_EVENT_PROMOTE,      // a filled reservation became one large page
+    SIM_EVENT_DEMOTE,       // a large page split into 4KB pages
+    SIM_EVENT_BREAK,        // a reservation gave back its unmapped frames
+    SIM_EVENT_KINDS
+};
+
+// one event, 32 bytes. level is the TLB level (0 iTLB, 1 l1 or dTLB, 2 and below the lower levels);
+// arg is the page size, except for migrations
+struct SimEvent {
+    uint64_t ts;        // ns since the trace started
+    uint64_t vpn;
+    uint32_t dur;       // ns, walks only
+    uint32_t tag;       // pid or TLB tag
+    uint32_t arg;
+    uint8_t kind;
+    uint8_t level;
+};
+
+const char* simEventName(SimEventKind kind);
+
+// set while recording: the only cost of a traced build that is not tracing is this test
+extern bool Event_trace_on;
+
+// start recording, every thread keeping its last capacity events (the rings of an earlier run are cleared)
+void startEventTrace(size_t capacity);
+void stopEventTrace();
+// ns since the trace started
+uint64_t eventTraceClock();
+void recordSimEvent(SimEventKind kind, int level, uint32_t tag, uint64_t vpn, uint32_t arg,
+                    uint64_t start = 0, bool span = false);
+
+// events kept and events overwritten, over every thread
+size_t eventTraceSize();
+size_t eventTraceOverwritten();
+// Chrome trace JSON if path ends in .json, else a Perfetto protobuf trace; throws runtime_error.
+// Call it once the simulation threads are done
+void writeEventTrace(const string& path);
+
+#ifdef VMSIM_TRACING
+static const bool EVENT_TRACE_BUILT = true;
+#define SIM_EVENT(kind, level, tag, vpn, arg) \
+    do { if (Event_trace_on) recordSimEvent(kind, level, tag, vpn, arg); } while (0)
+// declare start, the beginning of a span
+#define SIM_EVENT_CLOCK(start) uint64_t start = Event_trace_on ? eventTraceClock() : 0
+#define SIM_EVENT_SPAN(kind, start, level, tag, vpn, arg) \
+    do { if (Event_trace_on) recordSimEvent(kind, level, tag, vpn, arg, start, true); } while (0)
+#else
+static const bool EVENT_TRACE_BUILT = false;
+#define SIM_EVENT(kind, level, tag, vpn, arg) do {} while (0)
+#define SIM_EVENT_CLOCK(start) do {} while (0)
+#define SIM_EVENT_SPAN(kind, start, level, tag, vpn, arg) do {} while (0)
+#endif
+
+#endif // EVENT_TRACE_H
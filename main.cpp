@@ -1,55 +1,633 @@
 #include "os.h"
 #include "tlb.h"
-#include "TwoLevelPageTable.h"
+#include "page-table.h"
+#include "stats.h"
+#include "trace.h"
+#include "parallel-sim.h"
+#include "profiler.h"
+#include "tuner.h"
+#include "analyzer.h"
+#include "scheduler.h"
+#include "event-trace.h"
 #include <stdint.h>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
+// usage: ./a.out <trace> [options]
+//   --slices K             split the trace into K slices simulated on K threads
+//   --warmup N             events replayed before each slice to warm the TLB (default 10000)
+//   --compare              also run the sequential simulation and report the error of the sliced run
+//   --memory MB            physical memory size (default 4096)
+//   --disk MB              swap size (default 10240)
+//   --high-watermark MB    kswapd reclaims until this much memory is free (default 200)
+//   --low-watermark MB     kswapd wakes up below this much free memory (default 100)
+//   --reclaim-batch N      pages reclaimed per kswapd batch (default 32)
+//   --background-reclaim   run kswapd on its own thread
+//   --l2-partition N       utility-partition the shared l2 between pids, repartitioning every N l2 lookups
+//   --l1-size N            l1 TLB entries (default 64)
+//   --l2-size N            fully-associative lru non-inclusive l2 TLB entries (default 0, l1 only)
+//   --tlb-level SPEC       add a TLB level below the previous ones: entries[:ways|full[:policy[:inclusive|exclusive|nine]]]
+//                          (repeatable, replaces --l2-size), e.g. --tlb-level 1536:12:lru:inclusive
+//   --tlb-config FILE      read the whole hierarchy (l1, victim buffer, lower levels) from a file, see README
+//   --cache SPEC           add a data cache level below the previous ones: size[:ways|full[:line]], e.g. --cache 32K:8
+//                          (repeatable, up to 4). Page walks then reference the directory and leaf entries
+//                          in the caches, which data accesses share, and the report counts who served them
+//   --numa-nodes N         split memory into N equal NUMA nodes; process pid runs on node pid % N
+//   --numa-sizes LIST      or give the node sizes in MB, comma separated (they must add up to --memory)
+//   --numa-policy P        first-touch, interleave or preferred[:node] (default first-touch)
+//   --numa-latency L,R     local and remote memory latency in ns (default 80,140)
+//   --timing W[:K[:M]]     time translations on an out-of-order core: a window of W accesses, K concurrent page
+//                          walkers (default 1) and M miss-status entries (default 8); misses to a page with a walk
+//                          in flight merge into it. Reports cycles, walk concurrency and stall cycles
+//   --timing-cycles LIST   hit,lower,cache,memory: cycles of an l1 hit, a hit below l1, and a walk reference served
+//                          by a data cache or by memory (default 1,8,20,200)
+//   --itlb-size N          split l1: code gets an N-entry iTLB, --l1-size sizes the dTLB (default 0, unified)
+//   --itlb-policy P        iTLB replacement policy (default random)
+//   --victim N             victim buffer of N entries catching l1 evictions (default 0, none)
+//   --l1-policy P          l1 replacement: random, fifo, lfu, lru, arc, drrip or ship (default random)
+//   --asid                 keep pid-tagged l1 entries across context switches instead of flushing l1
+//   --small-pages          back every allocation with 4KB pages
+//   --va-bits N            32, 48 or 57-bit virtual addresses: a 2-level table (default), or an x86-64 4 or 5-level
+//                          table with 4KB, 2MB and 1GB pages and the stack at the top of the lower half
+//   --compaction MODE      off, on-failure or incremental[:interval[:budget]]: migrate pages to rebuild aligned free
+//                          blocks when a large page finds none, and with incremental also every interval events
+//                          (default 1000), moving at most budget 4KB pages per pass (default 512)
+//   --compaction-block KB  free block size incremental compaction keeps on every node, a page size of the layout
+//                          above 4KB, up to 1048576 with --va-bits 48 (default 2048)
+//   --reservations KB      reserve an aligned physical block of KB for every aligned heap region of that size on its
+//                          first allocation, fill it as the heap grows and promote it to one page once full, e.g.
+//                          2048 or 1048576 with --va-bits 48 (off by default)
+//   --miss-classes         classify the misses of every TLB level as compulsory, capacity, conflict, flush or
+//                          invalidation, per level, segment and pid
+//   --tune                 search the TLB design space and print the Pareto frontier of hit rate vs entries
+//   --tune-trace FILE      another trace to tune on (repeatable)
+//   --tune-l1 LIST         l1 sizes to try, comma separated (default 16,32,64,128,256)
+//   --tune-l2 LIST         l2 sizes to try, 0 for none (default 0)
+//   --tune-l2-ways LIST    l2 associativities to try, 0 for fully associative (default 0)
+//   --tune-l2-policy LIST  l2 policies to try (default lru)
+//   --tune-victim LIST     victim buffer sizes to try (default 0)
+//   --tune-itlb LIST       iTLB sizes to try, 0 for a unified l1 (default 0)
+//   --tune-policy LIST     l1 policies to try (default random,fifo,lfu,lru)
+//   --tune-asid LIST       off,on (default off,on)
+//   --tune-pages LIST      mixed,4k (default mixed)
+//   --tune-budget N        skip configurations with more than N TLB entries
+//   --tune-eta N           keep 1/N of the configurations per successive-halving round (default 2)
+//   --tune-threads N       simulation threads (default one per hardware thread)
+//   --analyze              characterise the trace (reuse distance, working set, allocation sizes) without simulating it
+//   --analyze-window N     accesses per working-set window (default 10000)
+//   --analyze-samples N    keys tracked per reuse-distance histogram before sampling kicks in (default 8192)
+//   --profile PREFIX       write the hottest pages to PREFIX.hot.txt and a 2MB/1GB region heatmap to PREFIX.heatmap.csv
+//   --profile-top N        pages listed in PREFIX.hot.txt (default 20)
+//   --profile-sketch       count pages in a count-min sketch, for traces with too many pages to count exactly
+//   --schedule P           run the trace and every --schedule-trace as separate workloads on one os, switching
+//                          between them with a rr (round robin, the default) or cfs scheduler
+//   --schedule-trace F[:W] another workload (repeatable), W is its cfs weight (default 1024)
+//   --quantum N            accesses per scheduler slice (default 1000)
+//   --quantum-time C       or cycles per slice: timing model cycles with --timing, else every access at the hit
+//                          cycles and every page-table reference that reached memory at the memory cycles
+//   --event-trace FILE     record TLB fills, evictions, flushes, walks, swaps and switches to FILE, as Chrome trace
+//                          JSON if it ends in .json, else as a Perfetto trace (needs a -DVMSIM_TRACING build)
+//   --event-trace-size N   events kept per simulation thread, the oldest are overwritten (default 1048576)
+static vector<string> splitList(const string& list) {
+    vector<string> ret;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (!item.empty()) {
+            ret.push_back(item);
+        }
+    }
+    return ret;
+}
+
+static vector<uint32_t> parseSizes(const string& list) {
+    vector<uint32_t> ret;
+    for (const auto& item : splitList(list)) {
+        ret.push_back(strtoul(item.c_str(), nullptr, 10));
+    }
+    return ret;
+}
+
+static bool parseSwitches(const string& list, const char* offName, const char* onName, vector<bool>& ret) {
+    ret.clear();
+    for (const auto& item : splitList(list)) {
+        if (item == offName) {
+            ret.push_back(false);
+        } else if (item == onName) {
+            ret.push_back(true);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
 int main(int argc, char *argv[]) {
     size_t memorySize = 1ULL << 32; 
-    size_t diskSize = 1024 * 1024 * 1024 * 10; 
+    size_t diskSize = 1024ULL * 1024 * 1024 * 10; 
     uint32_t high_watermark = 200 * 1024 * 1024;
     uint32_t low_watermark = 100 * 1024 * 1024;
 
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <trace> [options]" << endl;
+        return 1;
+    }
+    size_t slices = 0;
+    size_t warmup = 10000;
+    bool compare = false;
+    uint32_t reclaimBatch = 32;
+    bool backgroundReclaim = false;
+    uint32_t l2PartitionInterval = 0;
+    string profilePrefix;
+    size_t profileTop = 20;
+    bool profileSketch = false;
+    uint32_t l1Size = 64;
+    uint32_t l2Size = 0;
+    vector<TlbLevelConfig> tlbLevels;
+    bool tlbHierarchy = false;         // --tlb-level or --tlb-config, which the tuner would replace
+    vector<CacheConfig> cacheLevels;
+    NumaConfig numaConfig;
+    TimingConfig timingConfig;
+    CompactionConfig compactionConfig;
+    bool compactionReport = false;     // any --compaction, off included, to compare against
+    uint32_t reservationSize = 0;
+    int vaBits = 32;
+    uint32_t numaNodes = 0;
+    string numaSizes;
+    TlbPolicy l1Policy = TLB_RANDOM;
+    uint32_t victimSize = 0;
+    uint32_t itlbSize = 0;
+    TlbPolicy itlbPolicy = TLB_RANDOM;
+    bool asidTagging = false;
+    bool smallPagesOnly = false;
+    bool missClasses = false;
+    bool tune = false;
+    vector<string> tuneTraces = {argv[1]};
+    TunerGrid grid;
+    TunerOptions tunerOptions;
+    bool analyze = false;
+    TraceAnalyzerOptions analyzerOptions;
+    bool schedule = false;
+    SchedulerConfig schedulerConfig;
+    vector<string> scheduleTraces = {argv[1]};
+    string eventTracePath;
+    size_t eventTraceCapacity = 1 << 20;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--slices") == 0 && i + 1 < argc) {
+            slices = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+            warmup = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            compare = true;
+        } else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            memorySize = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--disk") == 0 && i + 1 < argc) {
+            diskSize = strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--high-watermark") == 0 && i + 1 < argc) {
+            high_watermark = strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--low-watermark") == 0 && i + 1 < argc) {
+            low_watermark = strtoul(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--reclaim-batch") == 0 && i + 1 < argc) {
+            reclaimBatch = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--background-reclaim") == 0) {
+            backgroundReclaim = true;
+        } else if (strcmp(argv[i], "--l2-partition") == 0 && i + 1 < argc) {
+            l2PartitionInterval = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--l1-size") == 0 && i + 1 < argc) {
+            l1Size = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--l2-size") == 0 && i + 1 < argc) {
+            l2Size = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--tlb-level") == 0 && i + 1 < argc) {
+            try {
+                tlbLevels.push_back(parse_tlb_level(argv[++i]));
+                tlbHierarchy = true;
+            } catch (const exception& e) {
+                cerr << "Bad TLB level " << argv[i] << ": " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tlb-config") == 0 && i + 1 < argc) {
+            try {
+                TlbHierarchyConfig config = load_tlb_config(argv[++i]);
+                l1Size = config.l1_size;
+                l1Policy = config.l1_policy;
+                victimSize = config.victim_size;
+                itlbSize = config.itlb_size;
+                itlbPolicy = config.itlb_policy;
+                tlbLevels = config.levels;
+                tlbHierarchy = true;
+            } catch (const exception& e) {
+                cerr << "Error: " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            try {
+                cacheLevels.push_back(parseCacheLevel(argv[++i]));
+            } catch (const exception& e) {
+                cerr << "Bad cache level " << argv[i] << ": " << e.what() << endl;
+                return 1;
+            }
+            if (cacheLevels.size() > size_t(CACHE_MAX_LEVELS)) {
+                cerr << "At most " << CACHE_MAX_LEVELS << " cache levels" << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--numa-nodes") == 0 && i + 1 < argc) {
+            numaNodes = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--numa-sizes") == 0 && i + 1 < argc) {
+            numaSizes = argv[++i];
+        } else if (strcmp(argv[i], "--numa-policy") == 0 && i + 1 < argc) {
+            try {
+                parseNumaPolicy(argv[++i], numaConfig);
+            } catch (const exception& e) {
+                cerr << "Bad NUMA policy " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--numa-latency") == 0 && i + 1 < argc) {
+            auto latencies = parseSizes(argv[++i]);
+            if (latencies.size() != 2) {
+                cerr << "--numa-latency takes LOCAL,REMOTE" << endl;
+                return 1;
+            }
+            numaConfig.localLatency = latencies[0];
+            numaConfig.remoteLatency = latencies[1];
+        } else if (strcmp(argv[i], "--compaction") == 0 && i + 1 < argc) {
+            try {
+                parseCompactionMode(argv[++i], compactionConfig);
+                compactionReport = true;
+            } catch (const exception& e) {
+                cerr << "Bad --compaction " << argv[i] << ": " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--reservations") == 0 && i + 1 < argc) {
+            reservationSize = min(1UL << 20, strtoul(argv[++i], nullptr, 10)) * 1024;
+        } else if (strcmp(argv[i], "--compaction-block") == 0 && i + 1 < argc) {
+            // checked against the address layout once it is set
+            compactionConfig.blockSize = min(1UL << 20, strtoul(argv[++i], nullptr, 10)) * 1024;
+        } else if (strcmp(argv[i], "--timing") == 0 && i + 1 < argc) {
+            try {
+                parseTimingSpec(argv[++i], timingConfig);
+            } catch (const exception& e) {
+                cerr << "Bad --timing " << argv[i] << ": " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--timing-cycles") == 0 && i + 1 < argc) {
+            try {
+                parseTimingCycles(argv[++i], timingConfig);
+            } catch (const exception& e) {
+                cerr << "Bad --timing-cycles " << argv[i] << ": " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--itlb-size") == 0 && i + 1 < argc) {
+            itlbSize = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--itlb-policy") == 0 && i + 1 < argc) {
+            if (!parse_tlb_policy(argv[++i], itlbPolicy)) {
+                cerr << "Unknown iTLB policy " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--victim") == 0 && i + 1 < argc) {
+            victimSize = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--l1-policy") == 0 && i + 1 < argc) {
+            if (!parse_tlb_policy(argv[++i], l1Policy)) {
+                cerr << "Unknown l1 policy: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--asid") == 0) {
+            asidTagging = true;
+        } else if (strcmp(argv[i], "--small-pages") == 0) {
+            smallPagesOnly = true;
+        } else if (strcmp(argv[i], "--va-bits") == 0 && i + 1 < argc) {
+            vaBits = strtol(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--miss-classes") == 0) {
+            missClasses = true;
+        } else if (strcmp(argv[i], "--tune") == 0) {
+            tune = true;
+        } else if (strcmp(argv[i], "--tune-trace") == 0 && i + 1 < argc) {
+            tuneTraces.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-l1") == 0 && i + 1 < argc) {
+            grid.l1Sizes = parseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-l2") == 0 && i + 1 < argc) {
+            grid.l2Sizes = parseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-l2-ways") == 0 && i + 1 < argc) {
+            grid.l2Ways = parseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-l2-policy") == 0 && i + 1 < argc) {
+            grid.l2Policies.clear();
+            for (const auto& name : splitList(argv[++i])) {
+                TlbPolicy policy;
+                if (!parse_tlb_policy(name, policy)) {
+                    cerr << "Unknown l2 policy: " << name << endl;
+                    return 1;
+                }
+                grid.l2Policies.push_back(policy);
+            }
+        } else if (strcmp(argv[i], "--tune-itlb") == 0 && i + 1 < argc) {
+            grid.itlbSizes = parseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-victim") == 0 && i + 1 < argc) {
+            grid.victimSizes = parseSizes(argv[++i]);
+        } else if (strcmp(argv[i], "--tune-policy") == 0 && i + 1 < argc) {
+            grid.policies.clear();
+            for (const auto& name : splitList(argv[++i])) {
+                TlbPolicy policy;
+                if (!parse_tlb_policy(name, policy)) {
+                    cerr << "Unknown l1 policy: " << name << endl;
+                    return 1;
+                }
+                grid.policies.push_back(policy);
+            }
+        } else if (strcmp(argv[i], "--tune-asid") == 0 && i + 1 < argc) {
+            if (!parseSwitches(argv[++i], "off", "on", grid.asidTagging)) {
+                cerr << "Expected off,on: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tune-pages") == 0 && i + 1 < argc) {
+            if (!parseSwitches(argv[++i], "mixed", "4k", grid.smallPagesOnly)) {
+                cerr << "Expected mixed,4k: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tune-budget") == 0 && i + 1 < argc) {
+            tunerOptions.entryBudget = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--tune-eta") == 0 && i + 1 < argc) {
+            tunerOptions.eta = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--tune-threads") == 0 && i + 1 < argc) {
+            tunerOptions.threads = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            analyze = true;
+        } else if (strcmp(argv[i], "--analyze-window") == 0 && i + 1 < argc) {
+            analyzerOptions.window = max(1UL, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--analyze-samples") == 0 && i + 1 < argc) {
+            analyzerOptions.samples = max(1UL, strtoul(argv[++i], nullptr, 10));
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profilePrefix = argv[++i];
+        } else if (strcmp(argv[i], "--profile-top") == 0 && i + 1 < argc) {
+            profileTop = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--profile-sketch") == 0) {
+            profileSketch = true;
+        } else if (strcmp(argv[i], "--schedule") == 0 && i + 1 < argc) {
+            schedule = true;
+            try {
+                schedulerConfig.policy = parseSchedulerPolicy(argv[++i]);
+            } catch (const exception& e) {
+                cerr << "Bad --schedule: " << e.what() << endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--schedule-trace") == 0 && i + 1 < argc) {
+            schedule = true;
+            scheduleTraces.push_back(argv[++i]);
+        } else if (strcmp(argv[i], "--quantum") == 0 && i + 1 < argc) {
+            schedule = true;
+            schedulerConfig.quantum = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--quantum-time") == 0 && i + 1 < argc) {
+            schedule = true;
+            schedulerConfig.timeQuantum = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--event-trace") == 0 && i + 1 < argc) {
+            eventTracePath = argv[++i];
+        } else if (strcmp(argv[i], "--event-trace-size") == 0 && i + 1 < argc) {
+            eventTraceCapacity = max(1UL, strtoul(argv[++i], nullptr, 10));
+        } else {
+            cerr << "Unknown option: " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    if (!eventTracePath.empty() && !EVENT_TRACE_BUILT) {
+        cerr << "--event-trace needs a build with -DVMSIM_TRACING (make tracing)" << endl;
+        return 1;
+    }
+
+    if (schedule && (analyze || tune || slices > 0)) {
+        cerr << "--schedule cannot be combined with --analyze, --tune or --slices" << endl;
+        return 1;
+    }
+
+    if (tune && tlbHierarchy) {
+        cerr << "--tune builds its own hierarchy, use --tune-l2, --tune-l2-ways and --tune-l2-policy "
+             << "instead of --tlb-level or --tlb-config" << endl;
+        return 1;
+    }
+
+    if (analyze) {
+        // streams the file, so it works on traces that do not fit in memory
+        ifstream inputFile(argv[1]);
+        if (!inputFile) {
+            cerr << "Error: Unable to open file." << endl;
+            return 1;
+        }
+        TraceAnalyzer analyzer(analyzerOptions);
+        string line;
+        TraceEvent event;
+        while (getline(inputFile, line)) {
+            if (parseTraceLine(line, event)) {
+                analyzer.observe(event);
+            }
+        }
+        analyzer.printReport();
+        return 0;
+    }
+
     os osInstance(memorySize, diskSize, high_watermark, low_watermark);
+    try {
+        osInstance.setAddressBits(vaBits);
+    } catch (const exception& e) {
+        cerr << "Bad --va-bits: " << e.what() << endl;
+        return 1;
+    }
+    osInstance.setReclaimBatch(reclaimBatch);
+    osInstance.getTlb().reconfigure(l1Size, l2Size);
+    if (!tlbLevels.empty()) {
+        if (tlbLevels.size() + 1 > TLB_MAX_LEVELS) {
+            cerr << "At most " << TLB_MAX_LEVELS << " TLB levels" << endl;
+            return 1;
+        }
+        osInstance.getTlb().configure_levels(tlbLevels);
+    }
+    osInstance.getTlb().set_l1_policy(l1Policy);
+    osInstance.getTlb().set_victim_size(victimSize);
+    osInstance.getTlb().set_split_l1(itlbSize, itlbPolicy);
+    osInstance.getTlb().set_miss_classification(missClasses);
+    osInstance.setAsidTagging(asidTagging);
+    osInstance.setSmallPagesOnly(smallPagesOnly);
+    try {
+        osInstance.setCompaction(compactionConfig);
+    } catch (const exception& e) {
+        cerr << "Bad --compaction-block: " << e.what() << endl;
+        return 1;
+    }
+    try {
+        osInstance.setReservations(reservationSize);
+    } catch (const exception& e) {
+        cerr << "Bad --reservations: " << e.what() << endl;
+        return 1;
+    }
+    osInstance.setCaches(cacheLevels);
+    osInstance.setTiming(timingConfig);
+    if (numaNodes > 0 || !numaSizes.empty()) {
+        try {
+            numaConfig.nodeSizes = numaNodeSizes(memorySize, numaNodes, numaSizes);
+            osInstance.setNuma(numaConfig);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+    if (l2PartitionInterval > 0) {
+        if (osInstance.getTlb().shared_l2() == nullptr) {
+            cerr << "--l2-partition needs a fully-associative lru l2" << endl;
+            return 1;
+        }
+        osInstance.getTlb().set_l2_partitioning(true, l2PartitionInterval);
+    }
 
+    // the library builds Tlbs too, so the simulator announces them rather than the Tlb constructor
+    cout << "TLB initialized" << endl;
     cout << "OS initialized" << endl;
 
+    // every simulation thread records into its own ring, written out once they are done
+    auto finishEventTrace = [&eventTracePath]() {
+        if (eventTracePath.empty()) {
+            return true;
+        }
+        stopEventTrace();
+        try {
+            writeEventTrace(eventTracePath);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return false;
+        }
+        cout << "Event trace:      " << eventTraceSize() << " events (" << eventTraceOverwritten()
+             << " overwritten) written to " << eventTracePath << endl;
+        return true;
+    };
+    if (!eventTracePath.empty()) {
+        startEventTrace(eventTraceCapacity);
+    }
+
+    if (tune) {
+        vector<vector<TraceEvent> > traces;
+        for (const auto& path : tuneTraces) {
+            try {
+                traces.push_back(loadTrace(path));
+            } catch (const exception& e) {
+                cerr << "Error: Unable to open file " << path << endl;
+                return 1;
+            }
+        }
+        TunerResult result;
+        try {
+            result = autoTune(osInstance, traces, grid, tunerOptions);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        printTunerReport(result);
+        return finishEventTrace() ? 0 : 1;
+    }
+
+    if (slices > 0) {
+        vector<TraceEvent> events;
+        try {
+            events = loadTrace(argv[1]);
+        } catch (const exception& e) {
+            cerr << "Error: Unable to open file." << endl;
+            return 1;
+        }
+        ParallelSimResult result;
+        try {
+            result = simulateSliced(osInstance, events, slices, warmup, compare);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        printParallelReport(result, warmup);
+        return finishEventTrace() ? 0 : 1;
+    }
+
     ifstream inputFile(argv[1]);
     if (!inputFile) {
         cerr << "Error: Unable to open file." << endl;
         return 1;
     }
 
-    string line;
-    while (getline(inputFile, line)) {
-        //cout << "Executing command: " << line << endl;
-        istringstream iss(line);
-        uint32_t pid;
-        string instruction;
-        uint32_t value = 0;
+    schedulerConfig.timed = timingConfig.width > 0;
+    schedulerConfig.hitCycles = timingConfig.hitCycles;
+    schedulerConfig.memoryCycles = timingConfig.memoryCycles;
+    unique_ptr<TraceScheduler> scheduler;
+    if (schedule) {
+        try {
+            scheduler.reset(new TraceScheduler(schedulerConfig));
+            for (const auto& spec : scheduleTraces) {
+                scheduler->addTrace(spec);
+            }
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    PageProfiler profiler(profileSketch);
+    if (!profilePrefix.empty()) {
+        osInstance.setProfiler(&profiler);
+    }
+    if (backgroundReclaim) {
+        osInstance.startBackgroundReclaim();
+    }
 
-        iss >> pid >> instruction;
-        if (instruction == "switch") {
-            osInstance.switchToProcess(pid);
+    try {
+        if (scheduler) {
+            scheduler->run(osInstance);
         } else {
-            if (!(iss >> hex >> value)) {
-                cerr << "Error parsing value for instruction: " << instruction << endl;
-                continue;
-            }
-            osInstance.handleInstruction(instruction, value, pid);
+            // decode the next chunk while this one is simulated
+            streamTrace(inputFile, 4096, [&osInstance](const vector<PackedEvent>& chunk) {
+                osInstance.runBatch(chunk.data(), chunk.size());
+            });
         }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
     }
 
-    cout << "Total memory access attempts: " << memory_access_attempts << endl;
-    cout << "Code miss:    " << code_miss << endl;
-    cout << "Stack miss:   " << stack_miss << endl;
-    cout << "Heap miss:    " << heap_miss << endl;
-    cout << "TLB misses:   " << TLB_miss << endl;
-    cout << "TLB hit rate: " << 1.0 * (memory_access_attempts - TLB_miss) / memory_access_attempts << endl;
-    cout << "L1 hit rate:  " << 1.0 * L1_hit / memory_access_attempts << endl;
-    cout << "L2 hit rate:  " << 1.0 * L2_hit / (L2_hit + TLB_miss) << endl;
+    osInstance.stopBackgroundReclaim();
+
+    printStats(collectStats());
+    if (vaBits != 32) {
+        const AddressLayout& layout = osInstance.getAddressLayout();
+        cout << "Address space:    " << layout.vaBits << "-bit, " << layout.levels << "-level page table" << endl;
+    }
+    if (osInstance.getReclaimer().reclaimed > 0 || osInstance.getReclaimer().swapIns > 0) {
+        osInstance.printReclaimStats();
+    }
+    if (compactionReport) {
+        osInstance.printCompactionStats();
+    }
+    if (osInstance.getReservations().enabled()) {
+        osInstance.printReservationStats();
+    }
+    if (osInstance.forkCount() > 0) {
+        osInstance.printSharingStats();
+    }
+    if (osInstance.numaEnabled()) {
+        osInstance.printNumaStats();
+    }
+    SharedL2* l2 = osInstance.getTlb().shared_l2();
+    if (l2 != nullptr && l2->lookups() > 0) {
+        l2->print_occupancy(cout);
+    }
+    if (scheduler) {
+        scheduler->printReport();
+    }
+    if (!profilePrefix.empty()) {
+        try {
+            profiler.writeReports(profilePrefix, profileTop);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        cout << "Page profile written to " << profilePrefix << ".hot.txt and " << profilePrefix << ".heatmap.csv" << endl;
+    }
+
+    if (!finishEventTrace()) {
+        return 1;
+    }
 
     inputFile.close();
     return 0;
-}
\ No newline at end of file
+}
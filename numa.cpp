@@ -0,0 +1,55 @@
+#include "numa.h"
+#include <sstream>
+#include <stdexcept>
+
+thread_local int Numa_local = 0;
+thread_local int Numa_remote = 0;
+thread_local long long Walk_memory_ns = 0;
+thread_local long long Data_memory_ns = 0;
+
+const char* numaPolicyName(NumaPolicy policy) {
+    switch (policy) {
+    case NUMA_FIRST_TOUCH:
+        return "first-touch";
+    case NUMA_INTERLEAVE:
+        return "interleave";
+    case NUMA_PREFERRED:
+        return "preferred";
+    }
+    return "?";
+}
+
+void parseNumaPolicy(const string& spec, NumaConfig& config) {
+    if (spec == "first-touch") {
+        config.policy = NUMA_FIRST_TOUCH;
+    } else if (spec == "interleave") {
+        config.policy = NUMA_INTERLEAVE;
+    } else if (spec.compare(0, 9, "preferred") == 0 && (spec.size() == 9 || spec[9] == ':')) {
+        config.policy = NUMA_PREFERRED;
+        config.preferredNode = spec.size() > 10 ? stoul(spec.substr(10)) : 0;
+    } else {
+        throw invalid_argument("unknown NUMA policy " + spec);
+    }
+}
+
+vector<size_t> numaNodeSizes(size_t memorySize, uint32_t nodes, const string& sizesMB) {
+    vector<size_t> sizes;
+    if (nodes > 0) {
+        size_t pages = memorySize / 4096;
+        for (uint32_t k = 0; k < nodes; k++) {
+            sizes.push_back((pages * (k + 1) / nodes - pages * k / nodes) * 4096);
+        }
+        return sizes;
+    }
+    stringstream ss(sizesMB);
+    string item;
+    size_t total = 0;
+    while (getline(ss, item, ',')) {
+        sizes.push_back(stoull(item) * 1024 * 1024);
+        total += sizes.back();
+    }
+    if (sizes.empty() || total != memorySize) {
+        throw invalid_argument("NUMA node sizes must add up to the memory size");
+    }
+    return sizes;
+}
@@ -0,0 +1,40 @@
+// numa.h
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// thread_local counters, only counted when memory has more than one node
+extern thread_local int Numa_local;          // accesses to a frame on the process's home node
+extern thread_local int Numa_remote;         // ... on another node
+extern thread_local long long Walk_memory_ns;    // page walk references that reached memory
+extern thread_local long long Data_memory_ns;    // data accesses that reached memory
+
+// where allocateMemory and createProcess place frames
+//   first-touch: the home node of the process (pid % nodes), spilling to the next nodes when it is full
+//   interleave:  successive allocations round-robin over the nodes
+//   preferred:   one node for everything, spilling like first-touch
+enum NumaPolicy { NUMA_FIRST_TOUCH, NUMA_INTERLEAVE, NUMA_PREFERRED };
+
+struct NumaConfig {
+    vector<size_t> nodeSizes;       // bytes per node, adding up to the memory size
+    NumaPolicy policy = NUMA_FIRST_TOUCH;
+    uint32_t preferredNode = 0;
+    uint32_t localLatency = 80;     // ns per memory reference
+    uint32_t remoteLatency = 140;
+};
+
+const char* numaPolicyName(NumaPolicy policy);
+// "first-touch", "interleave" or "preferred[:node]"; throws invalid_argument otherwise
+void parseNumaPolicy(const string& spec, NumaConfig& config);
+
+// split memorySize into nodes equal nodes, or into the given comma-separated MB sizes when nodes is 0.
+// throws invalid_argument if the sizes are not whole 4KB pages or do not add up to memorySize
+vector<size_t> numaNodeSizes(size_t memorySize, uint32_t nodes, const string& sizesMB);
+
+#endif // NUMA_H
@@ -1,11 +1,13 @@
-#include "TwoLevelPageTable.h"
+#include "page-table.h"
 #include "process.h"
 #include "os.h"
 #include "tlb.h"
+#include "event-trace.h"
 #include <iostream>
 #include <utility>
 #include <vector>
 #include <algorithm>
+#include <numeric>
 #include <cmath>
 #include <iostream>
 #include <stdint.h> 
@@ -14,164 +16,829 @@
 #include <stdexcept>
 #include <cstdint>
 #include <map>
+#include <sstream>
 
-int memory_access_attempts = 0;
+thread_local int memory_access_attempts = 0;
 
 using namespace std;
 
 
 os::os(size_t memorySize, size_t diskSize, uint32_t high_watermarkGiven,
        uint32_t low_watermarkGiven)
-    : minPageSize(4096), memoryMap(memorySize / minPageSize, false),
-      //diskMap(diskSize / minPageSize, false),
+    : minPageSize(4096), runningProc(nullptr), memoryMap(memorySize / minPageSize, false), lowestFree(0),
+      diskMap(diskSize / minPageSize, false),
       high_watermark(high_watermarkGiven), low_watermark(low_watermarkGiven),
-      totalFreeSize(-1), tlb(Tlb(64, 1024, 4)) {
+      totalFreeSize(memorySize), diskCursor(0), tlb(Tlb(64, 0)),
+      reclaimBatch(32), kswapdAwake(false), backgroundReclaim(false), kswapdStopping(false),
+      asidTagging(false), smallPagesOnly(false), layout(addressLayout(32)), profiler(nullptr), tableFramesUsed(0),
+      nextCodeDomain(0), forks(0), cowFaults(0), cowCopies(0), cowCopiedBytes(0), sharedBytes(0),
+      peakSharedBytes(0), nodeStart{0, memorySize / minPageSize}, nodeFree{memorySize}, interleaveNext(0) {
+    numa.nodeSizes.push_back(memorySize);
 }
 
-os::~os() {
+os::os(const os& other)
+    : minPageSize(other.minPageSize), runningProc(nullptr), memoryMap(other.memoryMap), lowestFree(other.lowestFree),
+      processes(other.processes), diskMap(other.diskMap),
+      high_watermark(other.high_watermark), low_watermark(other.low_watermark),
+      totalFreeSize(other.totalFreeSize), pageToDiskMap(other.pageToDiskMap),
+      diskCursor(other.diskCursor), tlb(other.tlb), reclaimer(other.reclaimer),
+      reclaimBatch(other.reclaimBatch), kswapdAwake(other.kswapdAwake),
+      backgroundReclaim(false), kswapdStopping(false), compactor(other.compactor),
+      reservations(other.reservations), asidTagging(other.asidTagging),
+      smallPagesOnly(other.smallPagesOnly), layout(other.layout), profiler(nullptr), tableFramesUsed(other.tableFramesUsed),
+      freeTableFrames(other.freeTableFrames), caches(other.caches), sharedFrames(other.sharedFrames),
+      codeDomainMembers(other.codeDomainMembers), nextCodeDomain(other.nextCodeDomain), forks(other.forks),
+      cowFaults(other.cowFaults), cowCopies(other.cowCopies), cowCopiedBytes(other.cowCopiedBytes),
+      sharedBytes(other.sharedBytes), peakSharedBytes(other.peakSharedBytes), numa(other.numa),
+      nodeStart(other.nodeStart), nodeFree(other.nodeFree), interleaveNext(other.interleaveNext),
+      timer(other.timer) {
+    if (other.runningProc != nullptr) {
+        runningProc = processes.find(other.runningProc->pid);
+    }
 }
 
+os::~os() {
+    stopBackgroundReclaim();
+}
 
-uint32_t os::allocateMemory(uint32_t size) {
-    if (totalFreeSize - size < low_watermark) {
-        // Swap out pages to maintain free memory above the low watermark
-        uint32_t sizeTobeFree = high_watermark - (totalFreeSize - size);
-        swapOutToMeetWatermark(sizeTobeFree);
-    }
+static pair<uint32_t, uint64_t> diskKey(uint32_t pid, uint64_t vpn) {
+    return make_pair(pid, vpn);
+}
 
-    auto frames = findPhysicalFrames(size);
-    uint32_t vpn = (runningProc->heap) >> 12;   // 12 is 4k page's intra-page offset bits
+// map frames at vpn for a process and put them on the reclaim lists
+void os::mapFrames(process& proc, uint64_t vpn, const vector<pair<uint32_t, uint32_t> >& frames) {
     for (auto p : frames) {
         auto pfn = p.first;
         auto frame_size = p.second;
-        runningProc->pageTable.setMapping(frame_size, vpn, pfn);
+        for (uint64_t table : proc.pageTable.missingTables(frame_size, vpn)) {
+            proc.pageTable.setTableFrame(table, allocateTableFrame());
+        }
+        proc.pageTable.setMapping(frame_size, vpn, pfn);
+        reclaimer.track(pfn, proc.pid, vpn, frame_size);
         vpn += frame_size / minPageSize;
     }
+}
+
+void os::releaseFrames(uint32_t basePfn, uint32_t size) {
+    setFramesUsed(basePfn, size / minPageSize, false);
+    totalFreeSize += size;
+    compactor.clearDeferred();
+}
+
+// mark pfns used or free and keep the per-node free counts (a block found by a whole-memory search may
+// straddle two nodes)
+void os::setFramesUsed(size_t pfn, size_t count, bool used) {
+    uint32_t node = nodeOf(pfn);
+    if (!used) {
+        lowestFree = min(lowestFree, pfn);
+    }
+    for (size_t end = pfn + count; pfn < end; pfn++) {
+        memoryMap[pfn] = used;
+        while (pfn >= nodeStart[node + 1]) {
+            node++;
+        }
+        if (used) {
+            nodeFree[node] -= minPageSize;
+        } else {
+            nodeFree[node] += minPageSize;
+        }
+    }
+}
+
+uint32_t os::nodeOf(size_t pfn) const {
+    return upper_bound(nodeStart.begin(), nodeStart.end(), pfn) - nodeStart.begin() - 1;
+}
+
+// make room for an allocation of size bytes: reclaim synchronously if it cannot be satisfied,
+// and wake kswapd if it would leave free memory below the low watermark
+void os::ensureFreeMemory(size_t size) {
+    if (totalFreeSize < size) {
+        reclaimer.directReclaims++;
+        // reserved frames nobody mapped yet go before any page is swapped out
+        while (totalFreeSize < size) {
+            if (!breakOldestReservation() && !evictOnePage()) {
+                throw runtime_error("Not enough memory to allocate");
+            }
+        }
+    }
+    if (totalFreeSize - size < low_watermark && !kswapdAwake) {
+        kswapdAwake = true;
+        if (backgroundReclaim) {
+            kswapdWait.notify_one();
+        }
+    }
+}
+
+bool os::evictOnePage() {
+    ReclaimVictim victim;
+    if (!reclaimer.selectVictim(victim)) {
+        return false;
+    }
+    process* proc = processes.find(victim.pid);
+    if (proc == nullptr) {
+        releaseFrames(victim.pfn, victim.page_size);
+        return true;
+    }
+    swapOutPage(*proc, victim.vpn, victim.pfn, victim.page_size);
+    return true;
+}
+
+void os::reclaimOneBatch() {
+    if (!kswapdAwake) {
+        return;
+    }
+    reclaimer.batches++;
+    for (uint32_t i = 0; i < reclaimBatch && totalFreeSize < high_watermark; i++) {
+        if (!breakOldestReservation() && !evictOnePage()) {
+            break;
+        }
+    }
+    if (totalFreeSize >= high_watermark || reclaimer.activeSize() + reclaimer.inactiveSize() == 0) {
+        kswapdAwake = false;
+    }
+}
+
+void os::reclaimTick() {
+    if (!backgroundReclaim) {
+        reclaimOneBatch();
+    }
+}
+
+bool os::compact(uint32_t size, size_t first, size_t end, size_t budget) {
+    size_t pages = size / minPageSize;
+    size_t block;
+    compactor.runs++;
+    if (!Compactor::chooseBlock(memoryMap, reclaimer, pages, first, end, budget, block)) {
+        compactor.failures++;
+        return false;
+    }
+    // 4KB pages go to the highest free frames below the last one taken, larger ones search again
+    size_t cursor = end;
+    for (size_t pfn = block; pfn < block + pages;) {
+        ReclaimVictim page;
+        if (!memoryMap[pfn]) {
+            pfn++;
+            continue;
+        }
+        reclaimer.lookUp(pfn, page);
+        size_t span = page.page_size / minPageSize;
+        size_t target;
+        bool found = Compactor::findTarget(memoryMap, span, first, span == 1 ? cursor : end, block, pages, target);
+        if (!found || processes.find(page.pid) == nullptr) {
+            // what moved so far stays moved, it only cost the copies
+            compactor.failures++;
+            return false;
+        }
+        if (span == 1) {
+            cursor = target;
+        }
+        migrateMapping(page, target);
+        pfn += span;
+    }
+    compactor.blocksFreed++;
+    return true;
+}
+
+// copy a mapping to new frames: the owner's page table points at them and its stale translations are dropped
+void os::migrateMapping(const ReclaimVictim& page, uint32_t newPfn) {
+    Reservation* reservation = reservations.findFrame(page.pfn);
+    if (reservation != nullptr) {
+        releaseReservation(reservation->pfn, true);
+    }
+    process* proc = processes.find(page.pid);
+    size_t span = page.page_size / minPageSize;
+    bool cow = proc->pageTable.entry(page.vpn << 12).cow;
+    SIM_EVENT(SIM_EVENT_MIGRATE, 0, page.pid, page.vpn, newPfn);
+    setFramesUsed(newPfn, span, true);
+    proc->pageTable.setMapping(page.page_size, page.vpn, newPfn);
+    if (cow) {
+        proc->pageTable.setCopyOnWrite(page.vpn, true);
+    }
+    reclaimer.move(page.pfn, newPfn);
+    setFramesUsed(page.pfn, span, false);
+    invalidatePage(*proc, page.vpn);
+    compactor.pagesMigrated += span;
+    compactor.bytesMigrated += page.page_size;
+}
+
+void os::compactionTick() {
+    if (!compactor.tick()) {
+        return;
+    }
+    compactor.passes++;
+    uint32_t size = compactor.config().blockSize;
+    size_t pages = size / minPageSize;
+    for (size_t k = 0; k + 1 < nodeStart.size(); k++) {
+        if (nodeFree[k] < size || compactor.deferred(size) ||
+            Compactor::hasFreeBlock(memoryMap, pages, nodeStart[k], nodeStart[k + 1])) {
+            continue;
+        }
+        compact(size, nodeStart[k], nodeStart[k + 1], compactor.config().budget);
+    }
+}
+
+void os::kswapdLoop() {
+    unique_lock<mutex> lock(stateLock);
+    while (true) {
+        kswapdWait.wait(lock, [this]() { return kswapdStopping || kswapdAwake; });
+        if (kswapdStopping) {
+            // the counters are thread_local and die with this thread
+            kswapdStats = collectStats();
+            return;
+        }
+        reclaimOneBatch();
+        // let the simulation in between batches
+        lock.unlock();
+        this_thread::yield();
+        lock.lock();
+    }
+}
+
+void os::setReclaimBatch(uint32_t pages) {
+    reclaimBatch = pages == 0 ? 1 : pages;
+}
+
+void os::startBackgroundReclaim() {
+    if (backgroundReclaim) {
+        return;
+    }
+    backgroundReclaim = true;
+    kswapdStopping = false;
+    kswapd = thread([this]() { kswapdLoop(); });
+}
+
+void os::stopBackgroundReclaim() {
+    if (!backgroundReclaim) {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(stateLock);
+        kswapdStopping = true;
+    }
+    kswapdWait.notify_one();
+    kswapd.join();
+    backgroundReclaim = false;
+    addStats(kswapdStats);
+    kswapdStats = SimStats();
+}
+
+size_t os::freeMemorySize() const {
+    return totalFreeSize;
+}
+
+const Reclaimer& os::getReclaimer() const {
+    return reclaimer;
+}
+
+Tlb& os::getTlb() {
+    return tlb;
+}
+
+void os::setAsidTagging(bool enabled) {
+    asidTagging = enabled;
+}
+
+void os::setSmallPagesOnly(bool enabled) {
+    smallPagesOnly = enabled;
+}
+
+void os::setAddressBits(int vaBits) {
+    AddressLayout requested = addressLayout(vaBits);
+    if (processes.size() != 0) {
+        throw logic_error("the address width has to be set before any process is created");
+    }
+    layout = requested;
+}
+
+const AddressLayout& os::getAddressLayout() const {
+    return layout;
+}
+
+void os::checkLargePageSize(uint32_t size) const {
+    if (size <= uint32_t(minPageSize) || (size & (size - 1)) != 0 || layout.firstPageSize(0, size) != size) {
+        throw invalid_argument(to_string(size / 1024) + "KB is not a page size above 4KB in the " +
+                               to_string(layout.vaBits) + "-bit layout");
+    }
+}
+
+void os::setCompaction(const CompactionConfig& config) {
+    checkLargePageSize(config.blockSize);
+    compactor.configure(config);
+}
+
+const Compactor& os::getCompactor() const {
+    return compactor;
+}
+
+void os::setReservations(uint32_t size) {
+    if (size != 0) {
+        checkLargePageSize(size);
+    }
+    reservations.configure(size);
+}
+
+const ReservationTable& os::getReservations() const {
+    return reservations;
+}
+
+void os::setProfiler(PageProfiler* pageProfiler) {
+    profiler = pageProfiler;
+}
+
+void os::setCaches(const vector<CacheConfig>& configs) {
+    caches.configure(configs);
+}
+
+void os::setTiming(const TimingConfig& config) {
+    timer.configure(config);
+}
+
+void os::setNuma(const NumaConfig& config) {
+    if (totalFreeSize != memoryMap.size() * minPageSize) {
+        throw logic_error("NUMA nodes have to be set up before anything is allocated");
+    }
+    vector<size_t> starts = {0};
+    for (size_t bytes : config.nodeSizes) {
+        if (bytes == 0 || bytes % minPageSize != 0) {
+            throw invalid_argument("NUMA node sizes must be whole pages");
+        }
+        starts.push_back(starts.back() + bytes / minPageSize);
+    }
+    if (starts.size() < 2 || starts.back() != memoryMap.size()) {
+        throw invalid_argument("NUMA node sizes must add up to the memory size");
+    }
+    if (config.preferredNode >= config.nodeSizes.size()) {
+        throw invalid_argument("no NUMA node " + to_string(config.preferredNode));
+    }
+    numa = config;
+    nodeStart = starts;
+    nodeFree = config.nodeSizes;
+    interleaveNext = 0;
+}
+
+bool os::numaEnabled() const {
+    return nodeStart.size() > 2;
+}
+
+void os::printNumaStats(ostream& out) const {
+    out << "NUMA nodes:       " << nodeFree.size() << " (" << numaPolicyName(numa.policy) << ")" << endl;
+    for (size_t k = 0; k < nodeFree.size(); k++) {
+        out << "  node " << k << ": " << (numa.nodeSizes[k] - nodeFree[k]) << " of " << numa.nodeSizes[k]
+            << " bytes in use" << endl;
+    }
+}
+
+long long os::forkCount() const {
+    return forks;
+}
+
+void os::printSharingStats(ostream& out) const {
+    out << "Forks:            " << forks << endl;
+    out << "COW faults:       " << cowFaults << " (" << cowCopies << " copies, " << cowCopiedBytes << " bytes)" << endl;
+    out << "Shared memory:    " << sharedBytes << " bytes saved at exit, " << peakSharedBytes << " at peak" << endl;
+}
+
+void os::printReclaimStats(ostream& out) const {
+    out << "Reclaimed pages:  " << reclaimer.reclaimed << " (" << reclaimer.reclaimedBytes << " bytes)" << endl;
+    out << "Reclaim scanned:  " << reclaimer.scanned << endl;
+    out << "Activated:        " << reclaimer.activated << endl;
+    out << "Deactivated:      " << reclaimer.deactivated << endl;
+    out << "kswapd batches:   " << reclaimer.batches << endl;
+    out << "Direct reclaims:  " << reclaimer.directReclaims << endl;
+    out << "Swap-ins:         " << reclaimer.swapIns << endl;
+}
+
+void os::printCompactionStats(ostream& out) const {
+    out << "Compaction:       " << compactionModeName(compactor.config().mode) << ", " << compactor.runs << " runs ("
+        << compactor.blocksFreed << " blocks freed, " << compactor.failures << " failed, " << compactor.deferredRuns
+        << " deferred), " << compactor.passes << " kcompactd passes" << endl;
+    out << "Pages migrated:   " << compactor.pagesMigrated << " (" << compactor.bytesMigrated << " bytes)" << endl;
+    out << "Large pages:      " << compactor.hugeSuccesses << " of " << compactor.hugeRequests << " ("
+        << compactor.hugeSuccessRate() << "%)" << endl;
+}
+
+void os::printReservationStats(ostream& out) const {
+    out << "Reservations:     " << reservations.size() / 1024 << "KB, " << reservations.made << " made, "
+        << reservations.hits << " hits, " << reservations.fallbacks << " fallbacks, " << reservations.count()
+        << " held (" << reservations.idleFrames() << " frames unmapped)" << endl;
+    out << "Promotions:       " << reservations.promotions << " (" << reservations.demotions << " demoted)" << endl;
+    out << "Broken:           " << reservations.broken << " (" << reservations.brokenForPressure
+        << " for memory pressure, " << reservations.framesReturned << " frames returned), " << reservations.released
+        << " released whole" << endl;
+}
+
+
+uint64_t os::allocateMemory(uint64_t size) {
+    if (size >= layout.userTop) {
+        throw invalid_argument("allocation of " + to_string(size) + " bytes does not fit the address space");
+    }
+    // reclaim first if this allocation cannot be met, kswapd takes care of the watermarks
+    ensureFreeMemory(size);
+
+    uint64_t base = runningProc->heap;
+    uint64_t vpn = base >> 12;   // 12 is 4k page's intra-page offset bits
+    if (reservations.enabled() && !smallPagesOnly) {
+        mapHeap(*runningProc, vpn, size);
+    } else {
+        mapRange(*runningProc, vpn, size);
+    }
     runningProc->allocateMem(size);
+    return base;
+}
+
+void os::mapRange(process& proc, uint64_t vpn, uint64_t size) {
+    while (size > 0) {
+        uint32_t pageSize = layout.firstPageSize(vpn, size);
+        mapFrames(proc, vpn, placeFrames(proc, pageSize));
+        vpn += pageSize / minPageSize;
+        size -= min<uint64_t>(size, pageSize);
+    }
+}
+
+void os::mapHeap(process& proc, uint64_t vpn, uint64_t size) {
+    size_t frames = reservations.frames();
+    while (size > 0) {
+        uint32_t pageSize = layout.firstPageSize(vpn, size);
+        // a page across a region boundary is mapped 4KB at a time, each region taking its part
+        if (pageSize < reservations.size() && vpn / frames != (vpn + pageSize / minPageSize - 1) / frames) {
+            pageSize = minPageSize;
+        }
+        if (pageSize >= reservations.size() || !mapReserved(proc, vpn, pageSize)) {
+            mapFrames(proc, vpn, placeFrames(proc, pageSize));
+        }
+        vpn += pageSize / minPageSize;
+        size -= min<uint64_t>(size, pageSize);
+    }
+}
+
+bool os::mapReserved(process& proc, uint64_t vpn, uint32_t pageSize) {
+    size_t frames = reservations.frames();
+    uint64_t region = vpn / frames * frames;
+    size_t offset = vpn - region;
+    size_t count = pageSize / minPageSize;
+    Reservation* reservation = reservations.find(proc.pid, vpn);
+    if (reservation == nullptr) {
+        // a region with pages mapped elsewhere could never be promoted in place
+        size_t pfn;
+        if (!proc.pageTable.mappings(region, frames).empty()) {
+            return false;
+        }
+        if (!reserveBlock(proc, pfn)) {
+            reservations.fallbacks++;
+            return false;
+        }
+        reservation = &reservations.add(proc.pid, region, pfn);
+        reservations.made++;
+    } else if (reservations.available(*reservation, offset, count)) {
+        reservations.hits++;
+    } else {
+        return false;
+    }
+    mapFrames(proc, vpn, {make_pair(uint32_t(reservation->pfn + offset), pageSize)});
+    reservations.populate(*reservation, offset, count);
+    if (reservations.full(*reservation)) {
+        promote(proc, reservation->pfn);
+    }
+    return true;
+}
+
+bool os::reserveBlock(const process& proc, size_t& pfn) {
+    uint32_t size = reservations.size();
+    // below this kswapd would wake up and break the reservation again
+    if (totalFreeSize < size + size_t(low_watermark)) {
+        return false;
+    }
+    size_t pages = size / minPageSize;
+    uint32_t nodes = nodeStart.size() - 1;
+    uint32_t first = numa.policy == NUMA_PREFERRED ? numa.preferredNode : proc.node;
+    for (uint32_t i = 0; i < nodes; i++) {
+        uint32_t node = (first + i) % nodes;
+        if (nodeFree[node] >= size &&
+            Compactor::findFreeBlock(memoryMap, pages, nodeStart[node], nodeStart[node + 1], pfn)) {
+            setFramesUsed(pfn, pages, true);
+            totalFreeSize -= size;
+            return true;
+        }
+    }
+    return false;
+}
+
+void os::promote(process& proc, uint32_t reservationPfn) {
+    Reservation* reservation = reservations.findFrame(reservationPfn);
+    uint64_t vpn = reservation->vpn;
+    uint32_t size = reservations.size();
+    for (const PTE& pte : proc.pageTable.mappings(vpn, reservations.frames())) {
+        proc.pageTable.free(pte.vpn);
+        reclaimer.untrack(pte.pfn);
+        invalidatePage(proc, pte.vpn);
+    }
+    reservations.remove(reservationPfn);
+    mapFrames(proc, vpn, {make_pair(reservationPfn, size)});
+    reservations.promotions++;
+    SIM_EVENT(SIM_EVENT_PROMOTE, 0, proc.pid, vpn, size);
+}
+
+void os::demote(process& proc, PTE pte) {
+    if (!pte.present) {
+        swapInPage(proc, pte.vpn, pte.page_size);
+        pte = proc.pageTable.entry(pte.vpn << 12);
+    }
+    if (pte.cow) {
+        breakCopyOnWrite(proc, pte);
+        pte = proc.pageTable.entry(pte.vpn << 12);
+    }
+    if (pte.page_size == uint32_t(minPageSize)) {
+        return;
+    }
+    proc.pageTable.free(pte.vpn);
+    reclaimer.untrack(pte.pfn);
+    invalidatePage(proc, pte.vpn);
+    vector<pair<uint32_t, uint32_t> > frames;
+    for (uint32_t i = 0; i < pte.page_size / minPageSize; i++) {
+        frames.push_back(make_pair(pte.pfn + i, minPageSize));
+    }
+    mapFrames(proc, pte.vpn, frames);
+    reservations.demotions++;
+    SIM_EVENT(SIM_EVENT_DEMOTE, 0, proc.pid, pte.vpn, pte.page_size);
+    if (pte.page_size == reservations.size()) {
+        Reservation& reservation = reservations.add(proc.pid, pte.vpn, pte.pfn);
+        reservations.populate(reservation, 0, reservations.frames());
+    }
+}
+
+void os::releaseReservation(uint32_t reservationPfn, bool broken, bool forPressure) {
+    Reservation* reservation = reservations.findFrame(reservationPfn);
+    size_t returned = 0;
+    for (size_t i = 0; i < reservations.frames(); i++) {
+        if (!reservation->mapped[i]) {
+            releaseFrames(reservationPfn + i, minPageSize);
+            returned++;
+        }
+    }
+    if (broken) {
+        reservations.broken++;
+        reservations.brokenForPressure += forPressure;
+        reservations.framesReturned += returned;
+        SIM_EVENT(SIM_EVENT_BREAK, 0, reservation->pid, reservation->vpn, reservations.size());
+    } else {
+        reservations.released++;
+    }
+    reservations.remove(reservationPfn);
 }
 
-void os::freeMemory(uint32_t baseAddress) {
-    uint32_t sizeToFree = (runningProc->heap - baseAddress);
-    uint32_t pagesToFree = sizeToFree / minPageSize;
-    uint32_t sizeFreed = 0;
-    uint32_t vpn = baseAddress >> 12;
+bool os::breakOldestReservation() {
+    Reservation* oldest = reservations.oldest();
+    if (oldest == nullptr) {
+        return false;
+    }
+    releaseReservation(oldest->pfn, true, true);
+    return true;
+}
+
+void os::freeMemory(uint64_t baseAddress) {
+    uint64_t sizeToFree = (runningProc->heap - baseAddress);
+    uint64_t sizeFreed = 0;
+    uint64_t vpn = baseAddress >> 12;
 
     while (sizeFreed != sizeToFree) {
-        auto p = runningProc->pageTable.translate(baseAddress);
+        auto p = runningProc->pageTable.entry(baseAddress);
+        if (!p.valid) {
+            throw runtime_error("Valid bit of pte is 0.");
+        }
+        while (p.vpn < vpn) {
+            // the heap is freed down into a promoted page: split it first
+            demote(*runningProc, p);
+            p = runningProc->pageTable.entry(baseAddress);
+        }
         runningProc->pageTable.free(vpn);
         uint32_t basePfn = p.pfn, pageSize = p.page_size;
-        for (uint32_t pfn = basePfn; pfn < basePfn + pageSize / minPageSize;
-             pfn++) {
-            memoryMap[pfn] = false;
+        if (p.cow && runningProc->cowPages > 0) {
+            runningProc->cowPages--;
+        }
+        if (p.present) {
+            Reservation* reservation = reservations.findFrame(basePfn);
+            if (reservation != nullptr) {
+                // the frames stay reserved for the region, the reservation goes once none is mapped
+                reclaimer.untrack(basePfn);
+                reservations.unpopulate(*reservation, basePfn - reservation->pfn, pageSize / minPageSize);
+                if (reservation->populated == 0) {
+                    releaseReservation(reservation->pfn, false);
+                }
+            } else if (!dropSharer(basePfn, runningProc->pid)) {
+                reclaimer.untrack(basePfn);
+                releaseFrames(basePfn, pageSize);
+            }
+        } else {
+            // swapped out, give back the swap space instead
+            auto it = pageToDiskMap.find(diskKey(runningProc->pid, p.vpn));
+            if (it != pageToDiskMap.end()) {
+                freeDiskBlocks(it->second, pageSize / minPageSize);
+                pageToDiskMap.erase(it);
+            }
         }
+        // Invalidate TLB entry for this VPN
+        invalidatePage(*runningProc, p.vpn);
         vpn += pageSize >> 12;
         sizeFreed += pageSize;
         baseAddress += pageSize;
     }
     runningProc->freeMem(sizeToFree);
-
-    // Invalidate TLB entry for this VPN
 }
 
 uint32_t os::createProcess(long int pid) {
-    process newProcess(pid);
+    process newProcess(pid, layout);
+    newProcess.node = pid % (nodeStart.size() - 1);
+    newProcess.pageTable.setDirectoryFrame(allocateTableFrame());
 
     uint32_t codeSize = 4 * 1024 * 1024;
+    uint32_t stackSize = 4 * 1024 * 1024;
+    // reclaim for both segments up front, the new process cannot be a victim before it is inserted
+    ensureFreeMemory(codeSize + stackSize);
+
     newProcess.code = codeSize - 1;
     newProcess.heap = codeSize;
-    uint32_t code_vpn = 0;
-    auto code_frames = findPhysicalFrames(codeSize);
-    for (auto &p : code_frames) {
-        uint32_t pfn = p.first;
-        uint32_t size = p.second;
-        newProcess.pageTable.setMapping(size, code_vpn, pfn);
-        code_vpn += size / minPageSize;
-    }
+    uint64_t code_vpn = 0;
+    mapRange(newProcess, code_vpn, codeSize);
 
-    uint32_t stackSize = 4 * 1024 * 1024;
-    auto stack_frames = findPhysicalFrames(stackSize);
-    newProcess.stack = 0xFFFFFFFF - stackSize + 1;
-    uint32_t stack_vpn = newProcess.stack / minPageSize;
-    for (auto &p : stack_frames) {
-        uint32_t pfn = p.first;
-        uint32_t size = p.second;
-        newProcess.pageTable.setMapping(size, stack_vpn, pfn);
-        stack_vpn += size / minPageSize;
-    }
-    processes.push_back(newProcess);
+    newProcess.stack = layout.userTop - stackSize;
+    uint64_t stack_vpn = newProcess.stack / minPageSize;
+    mapRange(newProcess, stack_vpn, stackSize);
+    processes.insert(newProcess);
 
     return pid;
 }
 
-/*
 void os::destroyProcess(long int pid) {
-    for (int i = 0; i < processes.size(); i++) {
-      if (processes[i].pid == pid) {
-        freeMemory(processes[i].heap);
-        processes.erase(processes.begin() + i);
-        return;
-      }
+    process* proc = processes.find(pid);
+    if (proc == nullptr) {
+        throw runtime_error("Process with PID " + to_string(pid) + " not found.");
+    }
+
+    for (uint32_t pfn : reservations.ofProcess(pid)) {
+        releaseReservation(pfn, false);
+    }
+    // release code, stack and heap frames, and the swap space of swapped-out pages
+    for (const PTE& pte : proc->pageTable.mappings()) {
+        if (!pte.present) {
+            auto it = pageToDiskMap.find(diskKey(pid, pte.vpn));
+            if (it != pageToDiskMap.end()) {
+                freeDiskBlocks(it->second, pte.page_size / minPageSize);
+                pageToDiskMap.erase(it);
+            }
+            continue;
+        }
+        if (!dropSharer(pte.pfn, pid)) {
+            reclaimer.untrack(pte.pfn);
+            releaseFrames(pte.pfn, pte.page_size);
+        }
+    }
+    for (uint32_t frame : proc->pageTable.tableFrames()) {
+        freeTableFrames.push_back(frame);
+    }
+    tlb.flush_process(pid);
+    if (proc->codeDomain != 0 && --codeDomainMembers[proc->codeDomain] == 0) {
+        codeDomainMembers.erase(proc->codeDomain);
+        tlb.flush_process(TLB_GLOBAL_TAG | proc->codeDomain);
     }
-    throw runtime_error("Process with PID " + to_string(pid) + " not found.");
-}
-*/
 
-void os::swapOutToMeetWatermark(uint32_t sizeToFree) {
-    size_t freedMemory = 0;
-    uint32_t pfnBits = 20;
+    if (runningProc == proc) {
+        runningProc = nullptr;
+    }
+    processes.erase(pid);
+}
 
-    for (process& proc : processes) {
-        if (freedMemory >= sizeToFree) break; 
+void os::forkProcess(uint32_t parentPid, uint32_t childPid) {
+    process* parent = processes.find(parentPid);
+    if (parent == nullptr) {
+        throw runtime_error("Process with PID " + to_string(parentPid) + " not found.");
+    }
+    if (processes.find(childPid) != nullptr) {
+        throw runtime_error("Process with PID " + to_string(childPid) + " already exists.");
+    }
+    // the child would share the reserved pages, the region can no longer be promoted in place
+    for (uint32_t pfn : reservations.ofProcess(parentPid)) {
+        releaseReservation(pfn, true);
+    }
 
-        uint32_t currentAddress = proc.code; // Start from the beginning
-        uint32_t endAddress = proc.heap;
+    // the family caches its code under one tag, so every member has to map the same code frames.
+    // Swapped-in code is taken off the reclaim lists right away, it is about to be shared anyway
+    for (const PTE& pte : parent->pageTable.mappings()) {
+        if (!pte.present && (pte.vpn << 12) <= parent->code) {
+            uint32_t pfn = swapInPage(*parent, pte.vpn, pte.page_size);
+            reclaimer.untrack(pfn);
+        }
+    }
+    if (parent->codeDomain == 0) {
+        parent->codeDomain = ++nextCodeDomain;
+        codeDomainMembers[parent->codeDomain] = 1;
+    }
 
-        while (currentAddress < endAddress && freedMemory < sizeToFree) {
-            auto pteAndPageSize =
-                runningProc->pageTable.translate(currentAddress);
-            uint32_t pageSize = pteAndPageSize.page_size;
-            uint32_t pfn = pteAndPageSize.pfn;
-            uint32_t vpn = currentAddress / pageSize;
+    process child(childPid, layout);
+    child.size = parent->size;
+    child.heapPages = parent->heapPages;
+    child.code = parent->code;
+    child.stack = parent->stack;
+    child.heap = parent->heap;
+    child.codeDomain = parent->codeDomain;
+    child.node = childPid % (nodeStart.size() - 1);
+    child.pageTable.setDirectoryFrame(allocateTableFrame());
 
-            swapOutPage(vpn, pfn); // Call swapOutPage for the calculated VPN
+    for (const PTE& pte : parent->pageTable.mappings()) {
+        for (uint64_t table : child.pageTable.missingTables(pte.page_size, pte.vpn)) {
+            child.pageTable.setTableFrame(table, allocateTableFrame());
+        }
+        child.pageTable.setMapping(pte.page_size, pte.vpn, pte.pfn);
+        if (!pte.present) {
+            // a swapped-out stack or heap page: the child gets its own copy of the swap slots
+            uint32_t blocks = pte.page_size / minPageSize;
+            uint32_t diskBlock = findFreeDiskBlocks(blocks);
+            if (diskBlock == (uint32_t)-1) {
+                throw runtime_error("No free disk block found for swapping");
+            }
+            pageToDiskMap[diskKey(childPid, pte.vpn)] = diskBlock;
+            child.pageTable.updatePresentBit(pte.vpn);
+            continue;
+        }
 
-            freedMemory += pageSize;
-            currentAddress += pageSize; // Move to the next page
+        auto shared = sharedFrames.find(pte.pfn);
+        if (shared == sharedFrames.end()) {
+            reclaimer.untrack(pte.pfn);
+            shared = sharedFrames.insert(make_pair(pte.pfn, SharedFrame{pte.vpn, pte.page_size, {parentPid}})).first;
+        }
+        shared->second.pids.push_back(childPid);
+        sharedBytes += pte.page_size;
 
-            tlb.invalidate_tlb(proc.pid, vpn);
+        if ((pte.vpn << 12) > parent->code) {
+            if (!pte.cow) {
+                parent->pageTable.setCopyOnWrite(pte.vpn, true);
+                parent->cowPages++;
+            }
+            child.pageTable.setCopyOnWrite(pte.vpn, true);
+            child.cowPages++;
         }
     }
+    peakSharedBytes = max(peakSharedBytes, sharedBytes);
+
+    processes.insert(child);
+    codeDomainMembers[child.codeDomain]++;
+    forks++;
 }
 
-void os::swapOutPage(uint32_t vpn, uint32_t pfnToSwapOut) {
+// write a page to swap, mark it not present and drop its TLB entries
+void os::swapOutPage(process& victim, uint64_t vpn, uint32_t pfnToSwapOut, uint32_t pageSize) {
     if (pfnToSwapOut < memoryMap.size() && memoryMap[pfnToSwapOut]) {
-        //disk.push_back(pfnToSwapOut); // Store the page data on the disk
-        size_t diskBlock = findFreeDiskBlock();
-        if (diskBlock == -1) {
+        uint32_t blocks = pageSize / minPageSize;
+        uint32_t diskBlock = findFreeDiskBlocks(blocks);
+        if (diskBlock == (uint32_t)-1) {
             throw runtime_error("No free disk block found for swapping");
         }
 
-        diskMap[diskBlock] = true; // Mark the disk block as used
-        pageToDiskMap[vpn] = diskBlock; 
-        memoryMap[pfnToSwapOut] = false; // Free the page in physical memory
-
-        // Update the map to reflect where the page is stored on disk
-        //pageToDiskMap[vpn] = disk.size() - 1;
+        pageToDiskMap[diskKey(victim.pid, vpn)] = diskBlock;
+        Reservation* reservation = reservations.findFrame(pfnToSwapOut);
+        if (reservation != nullptr) {
+            releaseReservation(reservation->pfn, true);
+        }
+        SIM_EVENT(SIM_EVENT_SWAP_OUT, 0, victim.pid, vpn, pageSize);
+        releaseFrames(pfnToSwapOut, pageSize); // Free the page in physical memory
 
         // update present bit
-        // pt.update(vpn)
+        victim.pageTable.updatePresentBit(vpn);
+        invalidatePage(victim, vpn, true);
     }
-} 
+}
 
-uint32_t os::findFreeDiskBlock() {
-    for (size_t i = 0; i < diskMap.size(); ++i) {
-        if (!diskMap[i]) {
-            return i;
+// next-fit search for count contiguous free disk blocks, marked used on success
+uint32_t os::findFreeDiskBlocks(uint32_t count) {
+    size_t total = diskMap.size();
+    size_t run = 0;
+    for (size_t scanned = 0; scanned < total + count; ++scanned) {
+        size_t i = (diskCursor + scanned) % total;
+        if (i == 0) {
+            run = 0;    // runs do not wrap around the end of the disk
+        }
+        if (diskMap[i]) {
+            run = 0;
+            continue;
+        }
+        run++;
+        if (run == count) {
+            size_t first = i + 1 - count;
+            for (size_t j = first; j <= i; ++j) {
+                diskMap[j] = true; // Mark the disk block as used
+            }
+            diskCursor = (i + 1) % total;
+            return first;
         }
     }
     return -1;
 }
 
+void os::freeDiskBlocks(uint32_t first, uint32_t count) {
+    for (uint32_t i = first; i < first + count; ++i) {
+        diskMap[i] = false;
+    }
+}
+
 
 
 /*
@@ -187,16 +854,22 @@ void handleTLBMiss(uint32_t virtualAddress) {
 }
 */
 
-uint32_t os::swapInPage(uint32_t vpn, uint32_t size) {
-    uint32_t diskBlock = pageToDiskMap[vpn];
-    diskMap[diskBlock] = false;
-    auto frames = findPhysicalFrames(size);
-    for (auto p : frames) {
-        auto pfn = p.first;
-        auto size = p.second;
-        runningProc->pageTable.setMapping(size, vpn, pfn);
-        vpn += size / minPageSize;
+uint32_t os::swapInPage(uint64_t vpn, uint32_t size) {
+    return swapInPage(*runningProc, vpn, size);
+}
+
+uint32_t os::swapInPage(process& proc, uint64_t vpn, uint32_t size) {
+    SIM_EVENT(SIM_EVENT_SWAP_IN, 0, proc.pid, vpn, size);
+    auto it = pageToDiskMap.find(diskKey(proc.pid, vpn));
+    if (it != pageToDiskMap.end()) {
+        freeDiskBlocks(it->second, size / minPageSize);
+        pageToDiskMap.erase(it);
     }
+    ensureFreeMemory(size);
+    auto frames = placeFrames(proc, size);
+    mapFrames(proc, vpn, frames);
+    reclaimer.swapIns++;
+    return frames.front().first;
 }
 
 uint32_t os::findFreeFrame() {
@@ -208,125 +881,449 @@ uint32_t os::findFreeFrame() {
     return -1; 
 }
 
-void os::handleInstruction(const string& instruction, uint32_t value, uint32_t pid) {
-    uint32_t result;
+TraceOp traceOpFromString(const string& instruction) {
     if (instruction == "alloc") {
-      result = allocateMemory(value);
+        return OP_ALLOC;
     } else if (instruction == "free") {
-      freeMemory(value);
+        return OP_FREE;
     } else if (instruction == "access_stak") {
-      result = accessStack(value);
+        return OP_ACCESS_STACK;
     } else if (instruction == "access_heap") {
-      result = accessHeap(value);
+        return OP_ACCESS_HEAP;
     } else if (instruction == "access_code") {
-      result = accessCode(value);
+        return OP_ACCESS_CODE;
     } else if (instruction == "switch") {
-      switchToProcess(pid);
+        return OP_SWITCH;
+    } else if (instruction == "exit") {
+        return OP_EXIT;
+    } else if (instruction == "fork") {
+        return OP_FORK;
+    }
+    return OP_UNKNOWN;
+}
+
+uint64_t os::dispatch(TraceOp op, uint64_t value, uint32_t pid) {
+    uint64_t result = 0;
+    switch (op) {
+    case OP_ALLOC:
+        result = allocateMemory(value);
+        break;
+    case OP_FREE:
+        freeMemory(value);
+        break;
+    case OP_ACCESS_STACK:
+        result = accessStack(value);
+        break;
+    case OP_ACCESS_HEAP:
+        result = accessHeap(value);
+        break;
+    case OP_ACCESS_CODE:
+        result = accessCode(value);
+        break;
+    case OP_SWITCH:
+        switchToProcess(pid);
+        break;
+    case OP_EXIT:
+        destroyProcess(pid);
+        break;
+    case OP_FORK:
+        forkProcess(pid, value);
+        break;
+    default:
+        break;
     }
+    reclaimTick();
+    compactionTick();
+    return result;
 }
 
-int stack_miss = 0;
-int heap_miss = 0;
-int code_miss = 0;
+void os::handleInstruction(const string& instruction, uint64_t value, uint32_t pid) {
+    // with a background reclaimer the os state is shared with the kswapd thread
+    unique_lock<mutex> lock(stateLock, defer_lock);
+    if (backgroundReclaim) {
+        lock.lock();
+    }
+    dispatch(traceOpFromString(instruction), value, pid);
+}
+
+SimStats os::runBatch(const PackedEvent* events, size_t n, uint64_t* physical, size_t* processed) {
+    unique_lock<mutex> lock(stateLock, defer_lock);
+    if (backgroundReclaim) {
+        lock.lock();
+    }
+    SimStats before = collectStats();
+    for (size_t i = 0; i < n; i++) {
+        uint64_t result = dispatch(events[i].op, events[i].value, events[i].pid);
+        if (physical != nullptr) {
+            physical[i] = result;
+        }
+        if (processed != nullptr) {
+            *processed = i + 1;
+        }
+    }
+    SimStats ret = collectStats();
+    ret.subtract(before);
+    return ret;
+}
 
-uint32_t os::accessStack(uint32_t address) {
+uint64_t os::runEvent(const PackedEvent& event) {
+    unique_lock<mutex> lock(stateLock, defer_lock);
+    if (backgroundReclaim) {
+        lock.lock();
+    }
+    return dispatch(event.op, event.value, event.pid);
+}
+
+SimStats os::translateBatch(uint32_t pid, TraceOp access, const uint64_t* addresses, size_t n,
+                            uint64_t* physical, size_t* processed) {
+    if (!isAccessOp(access)) {
+        throw invalid_argument("translateBatch needs an access op");
+    }
+    unique_lock<mutex> lock(stateLock, defer_lock);
+    if (backgroundReclaim) {
+        lock.lock();
+    }
+    SimStats before = collectStats();
+    if (runningProc == nullptr || runningProc->pid != pid) {
+        dispatch(OP_SWITCH, 0, pid);
+    }
+    for (size_t i = 0; i < n; i++) {
+        uint64_t result = dispatch(access, addresses[i], pid);
+        if (physical != nullptr) {
+            physical[i] = result;
+        }
+        if (processed != nullptr) {
+            *processed = i + 1;
+        }
+    }
+    SimStats ret = collectStats();
+    ret.subtract(before);
+    return ret;
+}
+
+thread_local int stack_miss = 0;
+thread_local int heap_miss = 0;
+thread_local int code_miss = 0;
+thread_local int code_access = 0;
+thread_local int itlb_hit = 0;
+
+uint64_t os::accessStack(uint64_t address) {
     // return accessMemory(address);
+    // a trace written for another address width has its stack where this layout has none
+    if (address < runningProc->stack || address >= layout.userTop) {
+        ostringstream message;
+        message << hex << "stack address 0x" << address << " is outside the stack of the " << dec << layout.vaBits
+                << "-bit layout (0x" << hex << runningProc->stack << "-0x" << layout.userTop - 1 << dec
+                << "): was the trace generated for another address width? "
+                << "Regenerate it with test_generator.py --va-bits " << layout.vaBits;
+        throw runtime_error(message.str());
+    }
+    tlb.select_l1(false);
     int temp = TLB_miss;
-    accessMemory(address);
+    uint64_t physical = accessMemory(address, true);
     if (temp != TLB_miss)
         stack_miss++;
+    return physical;
 }
 
-uint32_t os::accessHeap(uint32_t address) {
+uint64_t os::accessHeap(uint64_t address) {
     // return accessMemory(address);
+    tlb.select_l1(false);
     int temp = TLB_miss;
-    accessMemory(address);
+    uint64_t physical = accessMemory(address, true);
     if (temp != TLB_miss)
         heap_miss++;
+    return physical;
 }
 
-uint32_t os::accessCode(uint32_t address) {
+uint64_t os::accessCode(uint64_t address) {
     // return accessMemory(address);
+    tlb.select_l1(true);
     int temp = TLB_miss;
-    accessMemory(address);
+    int l1 = L1_hit;
+    uint64_t physical = accessMemory(address);
     if (temp != TLB_miss)
         code_miss++;
+    // with a split l1 the code accesses' l1 hits are the iTLB's
+    if (tlb.split_l1) {
+        code_access++;
+        itlb_hit += L1_hit - l1;
+    }
+    return physical;
 }
 
-uint32_t os::accessMemory(uint32_t address) {
+uint64_t os::accessMemory(uint64_t address, bool write) {
     memory_access_attempts++;
+    if (write && runningProc->cowPages > 0) {
+        PTE pte = runningProc->pageTable.entry(address);
+        if (pte.valid && pte.present && pte.cow) {
+            breakCopyOnWrite(*runningProc, pte);
+        }
+    }
+    uint32_t tag = tlbTag(*runningProc, address);
+    uint32_t addr;
+    TranslationTimer::Kind timedAs = TranslationTimer::L1_HIT;
+    uint64_t walkCycles = 0;
+    int lowerHits = 0;
+    if (timer.enabled()) {
+        lowerHits = L2_hit + accumulate(Level_hit, Level_hit + TLB_MAX_LEVELS + 1, 0);
+    }
     try {
-        auto addr = tlb.look_up(address, runningProc->pid);
-        return addr;
+        addr = tlb.policy_look_up(address, tag);
+        if (profiler != nullptr) {
+            profiler->record(runningProc->pid, address, runningProc->pageTable.entry(address).page_size, false);
+        }
     } catch (const exception& e) {
+        SIM_EVENT_CLOCK(walkStart);
+        auto entry = runningProc->pageTable.entry(address);
+        if (entry.valid && !entry.present) {
+            // page fault on a page kswapd swapped out
+            swapInPage(entry.vpn, entry.page_size);
+        }
         auto pte = runningProc->pageTable.translate(address);
-        auto tlbEntry = tlb.create_tlb_entry(pte.pfn, pte.page_size, address, runningProc->pid);
-        tlb.l1_insert(tlbEntry);
-        tlb.l2_insert(tlbEntry);
-        auto addr = tlb.look_up(address, runningProc->pid);
-        return addr;
+        int walkRefs = 0;
+        if (caches.enabled() || numaEnabled() || timer.enabled()) {
+            uint64_t entries[PAGE_TABLE_MAX_LEVELS];
+            walkRefs = runningProc->pageTable.walkAddresses(address, entries);
+        }
+        int walkMemoryRefs = caches.enabled() ? walkPageTable(address) : walkRefs;
+        if (timer.enabled()) {
+            const TimingConfig& timing = timer.config();
+            timedAs = TranslationTimer::WALK;
+            walkCycles = uint64_t(walkMemoryRefs) * timing.memoryCycles
+                         + uint64_t(walkRefs - walkMemoryRefs) * timing.cacheCycles;
+        }
+        if (numaEnabled()) {
+            // page tables are allocated on the home node
+            Walk_memory_ns += walkMemoryRefs * numa.localLatency;
+        }
+        // the walker sets the referenced bit on fill
+        reclaimer.markReferenced(pte.pfn);
+        auto tlbEntry = tlb.create_tlb_entry(pte.pfn, pte.page_size, address, tag);
+        tlb.record_walk(tlbEntry);
+        tlb.policy_l1_insert(tlbEntry);
+        tlb.lower_insert(tlbEntry);
+        SIM_EVENT_SPAN(SIM_EVENT_WALK, walkStart, 0, tag, tlbEntry.vpn, pte.page_size);
+        // the frame comes from the entry just filled: looking it up again would count a hit on it
+        addr = Tlb::frame_of(tlbEntry, address);
+        if (profiler != nullptr) {
+            profiler->record(runningProc->pid, address, pte.page_size, true);
+        }
+    }
+    if (timer.enabled()) {
+        if (timedAs != TranslationTimer::WALK
+            && L2_hit + accumulate(Level_hit, Level_hit + TLB_MAX_LEVELS + 1, 0) != lowerHits) {
+            timedAs = TranslationTimer::LOWER_HIT;
+        }
+        // walks are tracked per TLB entry: the tag and the first vpn of the page
+        timer.access(tag, runningProc->pageTable.entry(address).vpn, timedAs, walkCycles);
+    }
+    // look_up returns the 4KB frame holding the address
+    uint64_t physical = (uint64_t(addr) << 12) | (address & 0xFFF);
+    bool memoryLevel = true;
+    if (caches.enabled()) {
+        size_t level = caches.access(physical);
+        Data_served[level]++;
+        memoryLevel = level == CACHE_MEMORY;
+    }
+    if (numaEnabled()) {
+        bool local = nodeOf(addr) == runningProc->node;
+        if (local) {
+            Numa_local++;
+        } else {
+            Numa_remote++;
+        }
+        if (memoryLevel) {
+            Data_memory_ns += local ? numa.localLatency : numa.remoteLatency;
+        }
+    }
+    return physical;
+}
+
+uint32_t os::allocateTableFrame() {
+    if (!freeTableFrames.empty()) {
+        uint32_t frame = freeTableFrames.back();
+        freeTableFrames.pop_back();
+        return frame;
+    }
+    return memoryMap.size() + tableFramesUsed++;
+}
+
+uint32_t os::tlbTag(const process& proc, uint64_t address) const {
+    if (proc.codeDomain != 0 && address <= proc.code) {
+        return TLB_GLOBAL_TAG | proc.codeDomain;
+    }
+    return proc.pid;
+}
+
+void os::invalidatePage(const process& proc, uint64_t vpn, bool swappedOut) {
+    tlb.invalidate_tlb(proc.pid, vpn, swappedOut);
+    if (proc.codeDomain != 0 && (vpn << 12) <= proc.code) {
+        tlb.invalidate_tlb(TLB_GLOBAL_TAG | proc.codeDomain, vpn, swappedOut);
     }
 }
 
+bool os::dropSharer(uint32_t pfn, uint32_t pid) {
+    auto it = sharedFrames.find(pfn);
+    if (it == sharedFrames.end()) {
+        return false;
+    }
+    SharedFrame& frame = it->second;
+    frame.pids.erase(remove(frame.pids.begin(), frame.pids.end(), pid), frame.pids.end());
+    sharedBytes -= frame.pageSize;
+    if (frame.pids.size() == 1) {
+        reclaimer.track(pfn, frame.pids[0], frame.vpn, frame.pageSize);
+        sharedFrames.erase(it);
+    }
+    return true;
+}
+
+// the first write to a copy-on-write page: copy it, or just make it writable again if every other
+// sharer has already copied it or gone
+void os::breakCopyOnWrite(process& proc, const PTE& pte) {
+    cowFaults++;
+    proc.cowPages--;
+    if (sharedFrames.find(pte.pfn) == sharedFrames.end()) {
+        proc.pageTable.setCopyOnWrite(pte.vpn, false);
+        return;
+    }
+    // a shared frame is not on the reclaim lists, so reclaim cannot take it from under us
+    ensureFreeMemory(pte.page_size);
+    auto frames = placeFrames(proc, pte.page_size);
+    dropSharer(pte.pfn, proc.pid);
+    proc.pageTable.free(pte.vpn);
+    mapFrames(proc, pte.vpn, frames);
+    invalidatePage(proc, pte.vpn);
+    cowCopies++;
+    cowCopiedBytes += pte.page_size;
+}
+
+// a walk costs as much as its slowest reference
+int os::walkPageTable(uint64_t address) {
+    uint64_t entries[PAGE_TABLE_MAX_LEVELS];
+    int count = runningProc->pageTable.walkAddresses(address, entries);
+    size_t slowest = 0;
+    int memoryRefs = 0;
+    for (int i = 0; i < count; i++) {
+        size_t level = caches.access(entries[i]);
+        Walk_ref_served[level]++;
+        slowest = max(slowest, level);
+        memoryRefs += level == CACHE_MEMORY;
+    }
+    Walk_served[slowest]++;
+    return memoryRefs;
+}
+
+vector<pair<uint32_t, uint32_t> > os::placeFrames(const process& proc, uint32_t size) {
+    auto frames = placeOnNodes(proc, size);
+    if (size > uint32_t(minPageSize) && !smallPagesOnly) {
+        compactor.hugeRequests++;
+        compactor.hugeSuccesses += frames.size() == 1;
+    }
+    return frames;
+}
+
+vector<pair<uint32_t, uint32_t> > os::placeOnNodes(const process& proc, uint32_t size) {
+    uint32_t nodes = nodeStart.size() - 1;
+    if (nodes == 1) {
+        return findPhysicalFrames(size);
+    }
+    uint32_t first = proc.node;
+    if (numa.policy == NUMA_INTERLEAVE) {
+        first = interleaveNext++ % nodes;
+    } else if (numa.policy == NUMA_PREFERRED) {
+        first = numa.preferredNode;
+    }
+    // the first node with room for the whole mapping, else wherever it fits
+    for (uint32_t i = 0; i < nodes; i++) {
+        uint32_t node = (first + i) % nodes;
+        if (nodeFree[node] >= size) {
+            return findPhysicalFrames(size, nodeStart[node], nodeStart[node + 1]);
+        }
+    }
+    return findPhysicalFrames(size);
+}
+
 void os::switchToProcess(uint32_t pid) {
-    auto it = find_if(processes.begin(), processes.end(), [pid](const process& proc) {
-        return proc.pid == pid;
-    });
+    SIM_EVENT(SIM_EVENT_SWITCH, 0, pid, 0, 0);
+    process* proc = processes.find(pid);
 
-    if (it != processes.end()) {
+    if (proc != nullptr) {
         // Process found, switch to it
-        runningProc = &(*it);
-        tlb.l1_flush();
+        runningProc = proc;
+        if (!asidTagging) {
+            tlb.l1_flush();
+        }
     } else {
         // Process not found, create a new one
         createProcess(pid);
-        runningProc = &processes.back();
+        runningProc = processes.find(pid);
     }
 }
 
 vector<pair<uint32_t, uint32_t> > os::findPhysicalFrames(uint32_t size) {
+    return findPhysicalFrames(size, 0, memoryMap.size());
+}
+
+vector<pair<uint32_t, uint32_t> > os::findPhysicalFrames(uint32_t size, size_t first, size_t end) {
     size_t pagesNeeded = size / minPageSize;
     size_t freePages = 0;
-    size_t start = 0;
+    while (lowestFree < memoryMap.size() && memoryMap[lowestFree]) {
+        lowestFree++;
+    }
+    // no aligned block below the one holding lowestFree can be free
+    size_t start = max((first + pagesNeeded - 1) / pagesNeeded, lowestFree / pagesNeeded) * pagesNeeded;
     vector<pair<uint32_t, uint32_t> > ret;
 
-    // If only 4K pages are supported, uncomment this
-    /*
-    if (size != minPageSize) {
-        auto temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
+    // only 4K pages: take the first free pages in one pass
+    if (smallPagesOnly && size != uint32_t(minPageSize)) {
+        for (size_t pfn = first; pfn < end && ret.size() < pagesNeeded; pfn++) {
+            if (!memoryMap[pfn]) {
+                ret.push_back(make_pair(pfn, minPageSize));
+            }
+        }
+        if (ret.size() < pagesNeeded) {
+            throw runtime_error("Not enough memory to allocate");
+        }
+        for (auto p : ret) {
+            setFramesUsed(p.first, 1, true);
+        }
+        totalFreeSize -= size;
         return ret;
     }
-     */
 
-    for (size_t i = 0; i < memoryMap.size(); ++i) {
-        if (!memoryMap[i]) { // If the page is free
-            if (i % (size / minPageSize) != 0) {
-                continue;
-            }
-            if (freePages == 0) start = i;
+    // try every block aligned to its own size, skipping past the first used page found
+    while (start + pagesNeeded <= end) {
+        freePages = 0;
+        while (freePages < pagesNeeded && !memoryMap[start + freePages]) { // If the page is free
             freePages++;
-            if (freePages == pagesNeeded) {
-                for (size_t j = start; j < start + pagesNeeded; ++j) {
-                    memoryMap[j] = true;  // Mark pages as allocated
-                }
-                ret.push_back(make_pair(start, size));
-                return ret;
-            }
-        } else {
-            freePages = 0;
         }
+        if (freePages == pagesNeeded) {
+            setFramesUsed(start, pagesNeeded, true);  // Mark pages as allocated
+            totalFreeSize -= size;
+            ret.push_back(make_pair(start, size));
+            return ret;
+        }
+        start = ((start + freePages) / pagesNeeded + 1) * pagesNeeded;
     }
-    if (size == minPageSize) {
+    if (size == uint32_t(minPageSize)) {
         throw runtime_error("Not enough memory to allocate");
-    } else {
-        auto temp = findPhysicalFrames(size / 2);
-        ret.insert(ret.end(), temp.begin(), temp.end());
-        temp = findPhysicalFrames(size / 2);
+    }
+    // direct compaction before settling for smaller pages
+    if (compactor.enabled()) {
+        if (compactor.deferred(size)) {
+            compactor.deferredRuns++;
+        } else if (compact(size, first, end, SIZE_MAX)) {
+            return findPhysicalFrames(size, first, end);
+        } else {
+            compactor.defer(size);
+        }
+    }
+    uint32_t smaller = layout.smallerPageSize(size);
+    for (uint32_t piece = 0; piece < size / smaller; piece++) {
+        auto temp = findPhysicalFrames(smaller, first, end);
         ret.insert(ret.end(), temp.begin(), temp.end());
-        return ret;
     }
+    return ret;
 }
 
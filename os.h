@@ -1,9 +1,18 @@
 #ifndef OS_H
 #define OS_H
 
-#include "TwoLevelPageTable.h"
+#include "page-table.h"
 #include "process.h"
 #include "tlb.h"
+#include "reclaimer.h"
+#include "compaction.h"
+#include "reservation.h"
+#include "profiler.h"
+#include "cache.h"
+#include "numa.h"
+#include "timing.h"
+#include "stats.h"
+#include "trace-op.h"
 #include <iostream>
 #include <vector>
 #include <algorithm>
@@ -11,48 +20,225 @@
 #include <cstdint>
 #include <map>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 using namespace std;
 
-extern int memory_access_attempts;
-extern int stack_miss;
-extern int heap_miss;
-extern int code_miss;
+extern thread_local int memory_access_attempts;
+extern thread_local int stack_miss;
+extern thread_local int heap_miss;
+extern thread_local int code_miss;
+// code accesses and their l1 hits, only counted with a split l1 (Tlb::set_split_l1)
+extern thread_local int code_access;
+extern thread_local int itlb_hit;
 
 class os {
 private:
     int minPageSize;
     process* runningProc;
     vector<bool> memoryMap;
-    vector<process> processes;
+    size_t lowestFree;      // every frame below it is in use, frame searches start there
+    ProcessTable processes;
     vector<bool> diskMap;
     uint32_t high_watermark;
     uint32_t low_watermark;
-    uint32_t totalFreeSize;
+    size_t totalFreeSize;
     //std::vector<uint32_t> disk;
-    map<uint32_t, uint32_t> pageToDiskMap;
+    map<pair<uint32_t, uint64_t>, uint32_t> pageToDiskMap;  // (pid, vpn) -> first disk block
+    size_t diskCursor;
     Tlb tlb;
 
+    // kswapd: woken when free memory drops below the low watermark,
+    // reclaims reclaimBatch pages at a time until it is back above the high watermark
+    Reclaimer reclaimer;
+    uint32_t reclaimBatch;
+    bool kswapdAwake;
+    bool backgroundReclaim;
+    bool kswapdStopping;
+    thread kswapd;
+    mutex stateLock;
+    condition_variable kswapdWait;
+    // what the kswapd thread counted, handed to the simulation thread when it is joined
+    SimStats kswapdStats;
+
+    // migrates mappings to rebuild aligned free blocks for large pages (off unless configured)
+    Compactor compactor;
+    // superpage reservations for heap regions (off unless configured)
+    ReservationTable reservations;
+
+    // keep l1 entries across context switches (they are pid-tagged) instead of flushing l1
+    bool asidTagging;
+    // back allocations with 4KB pages only instead of the largest aligned pages that fit
+    bool smallPagesOnly;
+    // virtual address width and page table shape of every process
+    AddressLayout layout;
+
+    // optional per-page miss profiler, not owned (nullptr when profiling is off)
+    PageProfiler* profiler;
+
+    // page tables live in frames past the end of memoryMap, so they never compete with data pages
+    uint32_t tableFramesUsed;
+    vector<uint32_t> freeTableFrames;
+    // data caches shared by page walks and data accesses (disabled when no level is configured)
+    CacheHierarchy caches;
+
+    // frames mapped by more than one process since a fork, by base pfn. Sharers map the frame at the
+    // same vpn with the same size. A shared frame is not tracked by the reclaimer, so it is never
+    // swapped out; the last sharer left takes it back onto the reclaim lists
+    struct SharedFrame {
+        uint64_t vpn;
+        uint32_t pageSize;
+        vector<uint32_t> pids;
+    };
+    map<uint32_t, SharedFrame> sharedFrames;
+    // live members of each fork family (process::codeDomain)
+    map<uint32_t, uint32_t> codeDomainMembers;
+    uint32_t nextCodeDomain;
+    long long forks;
+    long long cowFaults;        // writes to copy-on-write pages
+    long long cowCopies;        // ... that had to copy the frame (the others were its last sharer)
+    long long cowCopiedBytes;
+    long long sharedBytes;      // memory fork sharing saves right now
+    long long peakSharedBytes;
+
+    // memoryMap is split into contiguous nodes: node k owns pfns [nodeStart[k], nodeStart[k + 1])
+    NumaConfig numa;
+    vector<size_t> nodeStart;
+    vector<size_t> nodeFree;        // bytes
+    uint32_t interleaveNext;
+
+    // out-of-order translation timing (off unless configured)
+    TranslationTimer timer;
+
+    void mapFrames(process& proc, uint64_t vpn, const vector<pair<uint32_t, uint32_t> >& frames);
+    void releaseFrames(uint32_t pfn, uint32_t size);
+    // back size bytes at vpn with the largest pages the layout allows there, placed by placeFrames
+    void mapRange(process& proc, uint64_t vpn, uint64_t size);
+    // mapRange for the heap, through reservations where they apply
+    void mapHeap(process& proc, uint64_t vpn, uint64_t size);
+    // map a page from the reservation of its region, making one if there is none; false if it cannot be
+    bool mapReserved(process& proc, uint64_t vpn, uint32_t pageSize);
+    // take a free aligned block of the reservation size for proc, false if there is none or memory is low
+    bool reserveBlock(const process& proc, size_t& pfn);
+    // replace the pages of a filled reservation by one large page on its block
+    void promote(process& proc, uint32_t reservationPfn);
+    // split a page into 4KB pages on the same frames (swapping it in or copying it first if need be);
+    // a page of the reservation size becomes a filled reservation again
+    void demote(process& proc, PTE pte);
+    // free the unmapped frames of a reservation and drop it, its mapped pages stay as they are
+    void releaseReservation(uint32_t reservationPfn, bool broken, bool forPressure = false);
+    // break the least recently filled reservation, false if there is none
+    bool breakOldestReservation();
+    void ensureFreeMemory(size_t size);
+    bool evictOnePage();
+    void reclaimOneBatch();
+    void kswapdLoop();
+    // compact an aligned block of size bytes in pfns [first, end), moving at most budget 4KB pages
+    // returns true if the block is free now
+    bool compact(uint32_t size, size_t first, size_t end, size_t budget);
+    void migrateMapping(const ReclaimVictim& page, uint32_t newPfn);
+    // kcompactd: every interval events, compact the nodes without a free block of the configured size
+    void compactionTick();
+    uint32_t allocateTableFrame();
+    // frames for a mapping of proc, placed by the NUMA policy (counts how often a large page is met in one piece)
+    vector<pair<uint32_t, uint32_t> > placeFrames(const process& proc, uint32_t size);
+    vector<pair<uint32_t, uint32_t> > placeOnNodes(const process& proc, uint32_t size);
+    // findPhysicalFrames within pfns [first, end)
+    vector<pair<uint32_t, uint32_t> > findPhysicalFrames(uint32_t size, size_t first, size_t end);
+    void setFramesUsed(size_t pfn, size_t count, bool used);
+    uint32_t nodeOf(size_t pfn) const;
+    uint32_t swapInPage(process& proc, uint64_t vpn, uint32_t size);
+    // the tag TLB entries of this address get: the family's global tag for forked code, else the pid
+    uint32_t tlbTag(const process& proc, uint64_t address) const;
+    // throw invalid_argument unless size is a page size of the layout larger than 4KB
+    void checkLargePageSize(uint32_t size) const;
+    // drop the TLB entries of a page, under both tags it may be cached with
+    void invalidatePage(const process& proc, uint64_t vpn, bool swappedOut = false);
+    // a process stops mapping a frame: returns false if it was its only user (the caller frees it)
+    bool dropSharer(uint32_t pfn, uint32_t pid);
+    void breakCopyOnWrite(process& proc, const PTE& pte);
+    // reference the entries of a walk, root first, in the caches, return how many reached memory
+    int walkPageTable(uint64_t address);
+    // run one event with the state lock held, returns what the batch entry points report for it
+    uint64_t dispatch(TraceOp op, uint64_t value, uint32_t pid);
 
 public:
     os(size_t memorySize, size_t diskSize, uint32_t high_watermarkGiven, uint32_t low_watermarkGiven);
+    // snapshot copy: runningProc is rebound to the copied process, the background reclaimer is not copied
+    os(const os& other);
     ~os();
 
-    uint32_t allocateMemory(uint32_t size);
-    void freeMemory(uint32_t baseAddress);
+    uint64_t allocateMemory(uint64_t size);
+    void freeMemory(uint64_t baseAddress);
     uint32_t createProcess(long int pid);
-    //void destroyProcess(long int pid);
-    void swapOutToMeetWatermark(uint32_t sizeTobeFree);
-    void swapOutPage(uint32_t vpn, uint32_t pfn);
-    uint32_t swapInPage(uint32_t vpn, uint32_t size);
+    void destroyProcess(long int pid);
+    // clone a process: every frame is shared, the stack and heap copy-on-write, the code for good.
+    // The parent's swapped-out code is brought back first so the whole family shares it
+    void forkProcess(uint32_t parentPid, uint32_t childPid);
+    void swapOutPage(process& victim, uint64_t vpn, uint32_t pfn, uint32_t pageSize);
+    uint32_t swapInPage(uint64_t vpn, uint32_t size);
     uint32_t findFreeFrame();
-    void handleInstruction(const string& string, uint32_t value, uint32_t pid);
-    uint32_t accessStack(uint32_t baseAddress);
-    uint32_t accessHeap(uint32_t baseAddress);
-    uint32_t accessCode(uint32_t baseAddress);
-    uint32_t accessMemory(uint32_t baseAddress);
+    void handleInstruction(const string& string, uint64_t value, uint32_t pid);
+
+    // batched entry points: one lock and no string dispatch for the whole span.
+    // physical (optional, n entries) receives the physical address of every access, the base
+    // virtual address of every alloc and 0 otherwise. *processed (optional) counts the events run
+    // so far and stays valid if an event throws. Returns the counters of this batch.
+    SimStats runBatch(const PackedEvent* events, size_t n, uint64_t* physical = nullptr, size_t* processed = nullptr);
+    // one event under the lock, without the counter snapshots of a batch (for drivers that interleave traces)
+    uint64_t runEvent(const PackedEvent& event);
+    // access n addresses of one segment (OP_ACCESS_*) of process pid, switching to it first if needed
+    SimStats translateBatch(uint32_t pid, TraceOp access, const uint64_t* addresses, size_t n,
+                            uint64_t* physical = nullptr, size_t* processed = nullptr);
+    uint64_t accessStack(uint64_t baseAddress);
+    uint64_t accessHeap(uint64_t baseAddress);
+    uint64_t accessCode(uint64_t baseAddress);
+    // access*() return the physical address
+    // writes (stack and heap accesses) take a copy-on-write fault on a page shared by fork
+    uint64_t accessMemory(uint64_t baseAddress, bool write = false);
     void switchToProcess(uint32_t pid);
     vector<pair<uint32_t, uint32_t> > findPhysicalFrames(uint32_t size);
-    uint32_t findFreeDiskBlock();
+    uint32_t findFreeDiskBlocks(uint32_t count);
+    void freeDiskBlocks(uint32_t first, uint32_t count);
+
+    // reclaim
+    void setReclaimBatch(uint32_t pages);
+    void startBackgroundReclaim();
+    // joins kswapd and adds its counters to the calling thread's
+    void stopBackgroundReclaim();
+    // run one kswapd batch if it is awake (synchronous mode does this after every instruction)
+    void reclaimTick();
+    size_t freeMemorySize() const;
+    const Reclaimer& getReclaimer() const;
+    Tlb& getTlb();
+    void setAsidTagging(bool enabled);
+    void setSmallPagesOnly(bool enabled);
+    // 32, 48 or 57-bit virtual addresses (see AddressLayout); only before any process exists
+    void setAddressBits(int vaBits);
+    const AddressLayout& getAddressLayout() const;
+    // the block size has to be a page size of the address layout above 4KB; throws invalid_argument otherwise
+    void setCompaction(const CompactionConfig& config);
+    const Compactor& getCompactor() const;
+    // reserve aligned blocks of size bytes for heap regions and promote them once filled, 0 turns it off.
+    // The size has to be a page size of the address layout; throws invalid_argument otherwise
+    void setReservations(uint32_t size);
+    const ReservationTable& getReservations() const;
+    // snapshots made with the copy constructor do not profile
+    void setProfiler(PageProfiler* pageProfiler);
+    // model page walks and data accesses in these cache levels (first level first), none to turn it off
+    void setCaches(const vector<CacheConfig>& configs);
+    // split memory into NUMA nodes (one node covering everything by default); only before anything is allocated
+    void setNuma(const NumaConfig& config);
+    bool numaEnabled() const;
+    // time translations with overlapping page walks (width 0 turns it off)
+    void setTiming(const TimingConfig& config);
+    void printNumaStats(ostream& out = cout) const;
+    void printReclaimStats(ostream& out = cout) const;
+    void printCompactionStats(ostream& out = cout) const;
+    void printReservationStats(ostream& out = cout) const;
+    long long forkCount() const;
+    void printSharingStats(ostream& out = cout) const;
 };
 
 #endif // OS_H
@@ -2,110 +2,202 @@
 #include <vector>
 #include <cstdint>
 #include <map>
-#include "TwoLevelPageTable.h"
+#include <algorithm>
+#include <stdexcept>
+#include "page-table.h"
 
 
 using namespace std;
 
-PTE::PTE(uint32_t vpn, uint32_t pfn, uint32_t page_size): vpn(vpn), pfn(pfn), page_size(page_size),
-    present(true), valid(true) {}
+PTE::PTE(uint64_t vpn, uint32_t pfn, uint32_t page_size): vpn(vpn), pfn(pfn), page_size(page_size),
+    present(true), valid(true), cow(false) {}
 
-PTE::PTE(): present(false), valid(false) {}
+PTE::PTE(): vpn(0), pfn(0), page_size(0), present(false), valid(false), cow(false) {}
 
-int memory_hit = 0;
-const int pdeOffset = 10;   // assuming VPN is 20 bits and PDE & PTE index are 10 bits
-const uint32_t tenBitsMask = 0b1111111111;
+thread_local int memory_hit = 0;
 const uint32_t minPageSize = 4096;
 
+AddressLayout addressLayout(int vaBits) {
+    switch (vaBits) {
+        case 32: return AddressLayout{32, 2, 10, 4, 1ULL << 32};
+        // user space is the lower half, below the canonical hole
+        case 48: return AddressLayout{48, 4, 9, 8, 1ULL << 47};
+        case 57: return AddressLayout{57, 5, 9, 8, 1ULL << 56};
+        default: throw invalid_argument("virtual addresses are 32, 48 or 57 bits, not " + to_string(vaBits));
+    }
+}
+
+uint32_t AddressLayout::firstPageSize(uint64_t vpn, uint64_t size) const {
+    if (vaBits == 32) {
+        return size;
+    }
+    // 1GB, 2MB or 4KB
+    for (int level = 2; level > 0; level--) {
+        uint64_t pages = 1ULL << (indexBits * level);
+        if (vpn % pages == 0 && size >= pages * minPageSize) {
+            return pages * minPageSize;
+        }
+    }
+    return minPageSize;
+}
+
+uint32_t AddressLayout::smallerPageSize(uint32_t pageSize) const {
+    if (vaBits == 32) {
+        return pageSize / 2;
+    }
+    return mapLevel(pageSize) <= 1 ? minPageSize : pageSize >> indexBits;
+}
+
+int AddressLayout::mapLevel(uint32_t pageSize) const {
+    return min(levels - 1, (__builtin_ctz(pageSize) - 12) / indexBits);
+}
+
 // 1. constructor
-//    input: pid
-//    initialize page table，mapToPDEs
-TwoLevelPageTable::TwoLevelPageTable(int pidGiven) {
+//    input: pid, address layout
+PageTable::PageTable(int pidGiven, const AddressLayout& layoutGiven) : layout(layoutGiven), directoryFrame(0) {
     pid = pidGiven;
-    for (uint32_t vpnPdeBits = 0; vpnPdeBits <= 0b1111111111; vpnPdeBits++) {
-        mapToPDEs[vpnPdeBits] = map<uint32_t, PTE>();
+}
+
+const AddressLayout& PageTable::getLayout() const {
+    return layout;
+}
+
+uint64_t PageTable::tableId(int level, uint64_t vpn) const {
+    return (uint64_t(level) << 58) | (vpn >> (layout.indexBits * (level + 1)));
+}
+
+map<uint64_t, PTE>::const_iterator PageTable::find(uint64_t vpn) const {
+    auto it = pages.upper_bound(vpn);
+    if (it == pages.begin()) {
+        return pages.end();
     }
+    --it;
+    return vpn - it->first < it->second.page_size / minPageSize ? it : pages.end();
 }
 
 
 // 2. setMapping
 //    input: pageSize, vpn, pfn
-void TwoLevelPageTable::setMapping(uint32_t pageSize, uint32_t vpn, uint32_t pfn) {
-    uint32_t numPTEs = pageSize / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
-
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-                mapToPte.insert_or_assign(j, PTE(vpn, pfn, pageSize));
-        }
-    }
+void PageTable::setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn) {
+    pages.insert_or_assign(vpn, PTE(vpn, pfn, pageSize));
 }
 
 // 3. translate
 //    input: virtual address
 //    output: pte
-PTE TwoLevelPageTable::translate(uint32_t vaddr) {
-    uint32_t vpn = vaddr >> 12;
-    auto& mapToPte = mapToPDEs[vpn >> pdeOffset];
-
-    uint32_t pteIdx = vpn & tenBitsMask;
-    PTE pte = mapToPte[pteIdx];
-    memory_hit += 2;
+PTE PageTable::translate(uint64_t vaddr) {
+    PTE pte = entry(vaddr);
+    // the two-level table has always counted both references, even for a page the directory maps
+    memory_hit += layout.vaBits == 32 ? 2 : layout.levels - (pte.valid ? layout.mapLevel(pte.page_size) : 0);
 
     if (!pte.valid) {
         throw runtime_error("Valid bit of pte is 0.");
     }
     if (!pte.present) {
-        // TODO: Call OS swap in method
-        // Done
-//        os.swapInPage(vpn, pte.page_size);
-//        pte = mapToPte[pteIdx];
-//        memory_hit += 2;
-        //throw runtime_error("Present bit of pte is 0.");
         throw logic_error("Present bit of pte is 0.");
     }
     return pte;
 }
 
+PTE PageTable::entry(uint64_t vaddr) const {
+    auto it = find(vaddr >> 12);
+    return it == pages.end() ? PTE() : it->second;
+}
+
 // 4. free
 //    remove mapping given vpn
-void TwoLevelPageTable::free(uint32_t vpn) {
-    uint32_t firstPteIdx = vpn & tenBitsMask;
-    auto first = mapToPDEs[vpn >> pdeOffset][firstPteIdx];
-    if (!first.valid) {
-        return;
+void PageTable::free(uint64_t vpn) {
+    pages.erase(vpn);
+}
+
+//5.update present bit when swap out
+void PageTable::updatePresentBit(uint64_t vpn) {
+    auto it = pages.find(vpn);
+    if (it != pages.end()) {
+        it->second.present = false;
+    }
+}
+
+//5b.write-protect a page shared by fork, or make it writable again
+void PageTable::setCopyOnWrite(uint64_t vpn, bool cow) {
+    auto it = pages.find(vpn);
+    if (it != pages.end()) {
+        it->second.cow = cow;
+    }
+}
+
+//6.list mappings
+vector<PTE> PageTable::mappings() const {
+    vector<PTE> ret;
+    for (const auto& page : pages) {
+        ret.push_back(page.second);
+    }
+    return ret;
+}
+
+vector<PTE> PageTable::mappings(uint64_t vpn, uint64_t count) const {
+    vector<PTE> ret;
+    auto it = find(vpn);
+    if (it == pages.end()) {
+        it = pages.lower_bound(vpn);
     }
-    uint32_t numPTEs = first.page_size / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
-
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-            mapToPte.erase(j);
+    for (; it != pages.end() && it->first < vpn + count; ++it) {
+        ret.push_back(it->second);
+    }
+    return ret;
+}
+
+
+//7.physical layout of the table itself
+void PageTable::setDirectoryFrame(uint32_t frame) {
+    directoryFrame = frame;
+}
+
+vector<uint64_t> PageTable::missingTables(uint32_t pageSize, uint64_t vpn) const {
+    vector<uint64_t> ret;
+    uint64_t last = vpn + pageSize / minPageSize - 1;
+    for (int level = layout.levels - 2; level >= layout.mapLevel(pageSize); level--) {
+        for (uint64_t id = tableId(level, vpn); id <= tableId(level, last); id++) {
+            if (tables.find(id) == tables.end()) {
+                ret.push_back(id);
+            }
         }
     }
+    return ret;
 }
 
-//5.update present bit when swap out
-void TwoLevelPageTable::updatePresentBit(uint32_t vpn) {
-    uint32_t firstPteIdx = vpn & tenBitsMask;
-    auto first = mapToPDEs[vpn >> pdeOffset][firstPteIdx];
-    uint32_t numPTEs = first.page_size / minPageSize;
-    uint32_t numPDEs = numPTEs / 1024 + (numPTEs % 1024 == 0? 0: 1);
-    uint32_t pdeIdx = vpn >> pdeOffset;
-
-    for (uint32_t i = pdeIdx; i < pdeIdx + numPDEs; i++) {
-        auto& mapToPte = mapToPDEs[pdeIdx]; //presentBit, validBit, ptePfn
-        uint32_t pteIdx = vpn & tenBitsMask;
-        for (uint32_t j = pteIdx; j < pteIdx + numPTEs; j++) {
-            mapToPte[j].present = false;
+void PageTable::setTableFrame(uint64_t table, uint32_t frame) {
+    tables[table] = frame;
+}
+
+int PageTable::walkAddresses(uint64_t vaddr, uint64_t addresses[PAGE_TABLE_MAX_LEVELS]) const {
+    uint64_t vpn = vaddr >> 12;
+    uint64_t indexMask = (1ULL << layout.indexBits) - 1;
+    PTE pte = entry(vaddr);
+    int stop = pte.valid ? layout.mapLevel(pte.page_size) : 0;
+    uint32_t frame = directoryFrame;
+    int count = 0;
+    for (int level = layout.levels - 1; level >= stop; level--) {
+        if (level < layout.levels - 1) {
+            auto table = tables.find(tableId(level, vpn));
+            if (table == tables.end()) {
+                break;
+            }
+            frame = table->second;
         }
+        uint64_t index = (vpn >> (layout.indexBits * level)) & indexMask;
+        addresses[count++] = (uint64_t(frame) << 12) + index * layout.entryBytes;
+    }
+    return count;
+}
+
+vector<uint32_t> PageTable::tableFrames() const {
+    vector<uint32_t> ret;
+    ret.push_back(directoryFrame);
+    for (const auto& table : tables) {
+        ret.push_back(table.second);
     }
+    return ret;
 }
 
 
@@ -113,7 +205,7 @@ void TwoLevelPageTable::updatePresentBit(uint32_t vpn) {
 
 //int main() {
 //    int pid= 1;
-//    TwoLevelPageTable pageTable(pid);
+//    PageTable pageTable(pid);
 //
 //    uint32_t pageSize = pow(2, 12);
 //    // Setting some mappings
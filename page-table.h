@@ -0,0 +1,110 @@
+// page-table.h
+
+#ifndef PAGE_TABLE_H
+#define PAGE_TABLE_H
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <map>
+
+using namespace std;
+
+/**
+ * Create a radix page table for a process, given the PID and the address layout.
+ * Given page size, vpn, and pfn, set a mapping from virtual page to physical frame.
+ * Given a vpn, translate it to a pfn, return pte.
+ * Physical memory up to 2^44 bytes (32-bit pfns of 4KB frames)
+ * Address space 32, 48 or 57 bit
+ * page size from 4KB to 1GB
+ */
+
+extern thread_local int memory_hit;
+
+// the deepest table, five levels for a 57-bit address space
+static const int PAGE_TABLE_MAX_LEVELS = 5;
+
+// virtual address layouts
+//   32: the original two-level table, 10-bit indices and 4-byte entries. Pages may be any power of two,
+//       4MB and larger ones are mapped by the directory (as with PSE)
+//   48: x86-64 four-level table, 9-bit indices and 8-byte entries. 4KB, 2MB and 1GB pages, mapped by
+//       the leaf table and the two levels above it
+//   57: x86-64 five-level table (LA57), the same with one more level on top
+struct AddressLayout {
+    int vaBits;
+    int levels;
+    int indexBits;
+    uint32_t entryBytes;
+    uint64_t userTop;       // end of the user address space, the stack sits right below it
+
+    // the page a mapping of size bytes at vpn starts with: the largest page size it is aligned to that fits.
+    // The 32-bit layout takes the mapping whole, as it always has
+    uint32_t firstPageSize(uint64_t vpn, uint64_t size) const;
+    // the next page size down, what a page that cannot be placed in one piece is split into
+    uint32_t smallerPageSize(uint32_t pageSize) const;
+    // the table level a page of this size is mapped in, 0 being the leaf table
+    int mapLevel(uint32_t pageSize) const;
+};
+
+// 32, 48 or 57; throws invalid_argument for any other width
+AddressLayout addressLayout(int vaBits);
+
+struct PTE {
+    uint64_t vpn;
+    uint32_t pfn;
+    uint32_t page_size;
+    bool present;
+    bool valid;
+    bool cow;   // write-protected frame shared after a fork, the first write copies it
+    PTE(uint64_t vpn, uint32_t pfn, uint32_t page_size);
+    PTE();
+};
+
+
+class PageTable {
+private:
+    uint32_t pid;
+    AddressLayout layout;
+    // one PTE per page, by its first vpn: a large page is found from any address inside it
+    map<uint64_t, PTE> pages;
+    // physical layout: the root frame, and one frame per table below it, by tableId(level, vpn).
+    // Pages are mapped by the entries of their own level (mapLevel), which need no table below
+    uint32_t directoryFrame;
+    map<uint64_t, uint32_t> tables;
+
+    // the table at level (0: leaf) holding the entries of vpn, one id per table
+    uint64_t tableId(int level, uint64_t vpn) const;
+    map<uint64_t, PTE>::const_iterator find(uint64_t vpn) const;
+
+public:
+    PageTable(int pidGiven, const AddressLayout& layoutGiven = addressLayout(32));
+
+    const AddressLayout& getLayout() const;
+
+    void setMapping(uint32_t pageSize, uint64_t vpn, uint32_t pfn);
+
+    PTE translate(uint64_t vaddr);
+
+    // the raw PTE for a virtual address, no walk is counted and nothing is checked (used for fault handling)
+    PTE entry(uint64_t vaddr) const;
+
+    void free(uint64_t vpn);
+    void updatePresentBit(uint64_t vpn);
+    void setCopyOnWrite(uint64_t vpn, bool cow);
+
+    void setDirectoryFrame(uint32_t frame);
+    // tables below the root a mapping of pageSize at vpn needs and has none yet, top level first
+    vector<uint64_t> missingTables(uint32_t pageSize, uint64_t vpn) const;
+    void setTableFrame(uint64_t table, uint32_t frame);
+    // physical addresses of the entries a walk of vaddr reads, root first, returns how many
+    int walkAddresses(uint64_t vaddr, uint64_t addresses[PAGE_TABLE_MAX_LEVELS]) const;
+    // the root and every other table frame, to release them with the process
+    vector<uint32_t> tableFrames() const;
+
+    // every mapping once (one PTE per page, whatever its size), used to tear a process down
+    vector<PTE> mappings() const;
+    // the mappings overlapping pages vpns from vpn, lowest first
+    vector<PTE> mappings(uint64_t vpn, uint64_t count) const;
+};
+
+#endif // PAGE_TABLE_H
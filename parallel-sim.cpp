@@ -0,0 +1,118 @@
+#include "parallel-sim.h"
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <thread>
+
+using namespace std;
+
+SimStats simulateSequential(const os& initial, const vector<TraceEvent>& events) {
+    os sim(initial);
+    resetStats();
+    for (const auto& event : events) {
+        applyEvent(sim, event);
+    }
+    return collectStats();
+}
+
+ParallelSimResult simulateSliced(const os& initial, const vector<TraceEvent>& events, size_t slices,
+                                 size_t warmup, bool compareWithSequential) {
+    ParallelSimResult result;
+    if (slices == 0) {
+        slices = 1;
+    }
+    if (slices > events.size() && !events.empty()) {
+        slices = events.size();
+    }
+
+    for (size_t k = 0; k < slices; k++) {
+        SliceResult slice;
+        slice.begin = events.size() * k / slices;
+        slice.end = events.size() * (k + 1) / slices;
+        slice.warmupBegin = slice.begin > warmup ? slice.begin - warmup : 0;
+        result.slices.push_back(slice);
+    }
+
+    // functional pre-pass: page table and allocator state only, snapshot at every warm-up start
+    vector<unique_ptr<os> > snapshots;
+    {
+        os functional(initial);
+        size_t next = 0;
+        for (size_t i = 0; i <= events.size() && next < slices; i++) {
+            while (next < slices && result.slices[next].warmupBegin == i) {
+                snapshots.push_back(unique_ptr<os>(new os(functional)));
+                next++;
+            }
+            if (i < events.size() && !isAccessInstruction(events[i].instruction)) {
+                applyEvent(functional, events[i]);
+            }
+        }
+    }
+
+    vector<exception_ptr> errors(slices + 1);
+    vector<thread> workers;
+    for (size_t k = 0; k < slices; k++) {
+        workers.emplace_back([&, k]() {
+            try {
+                SliceResult& slice = result.slices[k];
+                os& sim = *snapshots[k];
+                for (size_t i = slice.warmupBegin; i < slice.begin; i++) {
+                    applyEvent(sim, events[i]);
+                }
+                // warm-up accesses fill the TLB but are not counted
+                resetStats();
+                for (size_t i = slice.begin; i < slice.end; i++) {
+                    applyEvent(sim, events[i]);
+                }
+                slice.stats = collectStats();
+            } catch (...) {
+                errors[k] = current_exception();
+            }
+        });
+    }
+    if (compareWithSequential) {
+        workers.emplace_back([&]() {
+            try {
+                result.sequential = simulateSequential(initial, events);
+                result.hasSequential = true;
+            } catch (...) {
+                errors[slices] = current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    for (const auto& slice : result.slices) {
+        result.merged.add(slice.stats);
+    }
+    return result;
+}
+
+void printParallelReport(const ParallelSimResult& result, size_t warmup, ostream& out) {
+    out << "Slices: " << result.slices.size() << ", warm-up: " << warmup << " events" << endl;
+    for (size_t k = 0; k < result.slices.size(); k++) {
+        const SliceResult& slice = result.slices[k];
+        out << "Slice " << k << ": events [" << slice.begin << ", " << slice.end << ")"
+            << ", accesses " << slice.stats.memory_access_attempts
+            << ", TLB misses " << slice.stats.TLB_miss
+            << ", TLB hit rate " << slice.stats.tlbHitRate() << endl;
+    }
+    printStats(result.merged, out);
+
+    if (result.hasSequential) {
+        const SimStats& seq = result.sequential;
+        long long missError = result.merged.TLB_miss - seq.TLB_miss;
+        out << "Sequential TLB misses:   " << seq.TLB_miss << endl;
+        out << "Sequential TLB hit rate: " << seq.tlbHitRate() << endl;
+        out << "TLB miss error:          " << missError << " ("
+            << (seq.TLB_miss == 0 ? 0.0 : 100.0 * missError / seq.TLB_miss) << "%)" << endl;
+        out << "TLB hit rate error:      " << fabs(result.merged.tlbHitRate() - seq.tlbHitRate()) << endl;
+    }
+}
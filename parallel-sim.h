@@ -0,0 +1,44 @@
+// parallel-sim.h
+#ifndef PARALLEL_SIM_H
+#define PARALLEL_SIM_H
+
+#include "os.h"
+#include "stats.h"
+#include "trace.h"
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Time-sliced parallel simulation of one trace.
+ * The trace is cut into `slices` contiguous slices. A functional pre-pass replays only
+ * switch/alloc/free (no TLB work) and snapshots the os before every slice, minus `warmup` events.
+ * Every slice then runs on its own thread: it replays its warm-up prefix to warm the TLB,
+ * discards those counters, and simulates the slice. Per-slice counters are summed.
+ */
+struct SliceResult {
+    size_t begin;   // first event of the slice
+    size_t end;     // one past the last event
+    size_t warmupBegin;
+    SimStats stats;
+};
+
+struct ParallelSimResult {
+    vector<SliceResult> slices;
+    SimStats merged;
+    bool hasSequential = false;
+    SimStats sequential;
+};
+
+// run the trace from start to end on one os, as the plain driver does
+SimStats simulateSequential(const os& initial, const vector<TraceEvent>& events);
+
+// run the trace in slices, optionally with the sequential reference run alongside for error estimation
+ParallelSimResult simulateSliced(const os& initial, const vector<TraceEvent>& events, size_t slices,
+                                 size_t warmup, bool compareWithSequential);
+
+// per-slice stats, merged stats, and the error against the sequential run if it was done
+void printParallelReport(const ParallelSimResult& result, size_t warmup, ostream& out = cout);
+
+#endif // PARALLEL_SIM_H
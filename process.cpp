@@ -1,24 +1,71 @@
 // process.cpp
 #include "process.h"
-#include "TwoLevelPageTable.h"
+#include "page-table.h"
 #include <iostream>
 
 using namespace std;
 
-process::process(long int pidGiven) : pageTable(TwoLevelPageTable(pid)), pid(pidGiven), size(0), heapPages(0), code(0), stack(0), heap(code) {}
+process::process(long int pidGiven, const AddressLayout& layout) : pid(pidGiven), size(0), heapPages(0), code(0), stack(0), heap(code),
+    pageTable(pidGiven, layout), codeDomain(0), cowPages(0), node(0) {}
 
-void process::allocateMem(uint32_t allocatedSize) {
+void process::allocateMem(uint64_t allocatedSize) {
     heapPages++;
     heap += allocatedSize;
     size += allocatedSize;
 }
 
-void process::freeMem(uint32_t freedSize) {
+void process::freeMem(uint64_t freedSize) {
     heapPages--;
     heap -= freedSize;
     size -= freedSize;
 }
 
+ProcessTable::ProcessTable() {}
+
+ProcessTable::ProcessTable(const ProcessTable& other)
+    : slots(other.slots), live(other.live), freeSlots(other.freeSlots), pidToSlot(other.pidToSlot) {}
+
+process* ProcessTable::find(long int pid) {
+    auto it = pidToSlot.find(pid);
+    if (it == pidToSlot.end()) {
+        return nullptr;
+    }
+    return &slots[it->second];
+}
+
+process* ProcessTable::insert(const process& proc) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+        slots[slot] = proc;
+        live[slot] = true;
+    } else {
+        slot = slots.size();
+        slots.push_back(proc);
+        live.push_back(true);
+    }
+    pidToSlot[proc.pid] = slot;
+    return &slots[slot];
+}
+
+void ProcessTable::erase(long int pid) {
+    auto it = pidToSlot.find(pid);
+    if (it == pidToSlot.end()) {
+        return;
+    }
+    uint32_t slot = it->second;
+    pidToSlot.erase(it);
+    // drop the page table now rather than when the slot is reused
+    slots[slot] = process(-1);
+    live[slot] = false;
+    freeSlots.push_back(slot);
+}
+
+size_t ProcessTable::size() const {
+    return pidToSlot.size();
+}
+
 // free  input: size
 // pagetable per process
 // every time os allocate memory, 
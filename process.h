@@ -1,23 +1,70 @@
 #ifndef PROCESS_H
 #define PROCESS_H
 
-#include "TwoLevelPageTable.h"
+#include "page-table.h"
 #include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
 
 class process {
 public:
     long int pid;
     long int size;
     long int heapPages;
-    uint32_t code;
-    uint32_t stack;
-    uint32_t heap;
-    TwoLevelPageTable pageTable;
+    uint64_t code;
+    uint64_t stack;
+    uint64_t heap;
+    PageTable pageTable;
+    // fork family whose shared code is cached under one global TLB tag, 0 if never forked
+    uint32_t codeDomain;
+    // pages that may still be copy-on-write; writes only check the page table while this is non-zero
+    uint32_t cowPages;
+    // NUMA node the process runs on (pid % nodes)
+    uint32_t node;
 
-    process(long int pidGiven);
+    process(long int pidGiven, const AddressLayout& layout = addressLayout(32));
 
-    void allocateMem(uint32_t allocatedSize);
-    void freeMem(uint32_t freedSize);
+    void allocateMem(uint64_t allocatedSize);
+    void freeMem(uint64_t freedSize);
+};
+
+/**
+ * Process table: a pool of process objects plus a pid -> slot hash map.
+ * Slots live in a deque that only grows at the back, so a process never moves once created
+ * and pointers such as os::runningProc stay valid while other processes are created.
+ * Slots of destroyed processes are recycled.
+ */
+class ProcessTable {
+public:
+    ProcessTable();
+    ProcessTable(const ProcessTable& other);
+    ProcessTable& operator=(const ProcessTable& other) = delete;
+
+    // return the process with that pid, nullptr if there is none
+    process* find(long int pid);
+    // add a process (the pid must be new) and return its stable address
+    process* insert(const process& proc);
+    // drop a process, its slot is reused by a later insert
+    void erase(long int pid);
+
+    size_t size() const;
+
+    // visit live processes in slot order
+    template <typename F>
+    void forEach(F f) {
+        for (size_t i = 0; i < slots.size(); i++) {
+            if (live[i]) {
+                f(slots[i]);
+            }
+        }
+    }
+
+private:
+    deque<process> slots;
+    vector<bool> live;
+    vector<uint32_t> freeSlots;
+    unordered_map<long int, uint32_t> pidToSlot;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "profiler.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+static const uint32_t REGION_2M_SHIFT = 21;
+static const uint32_t REGION_1G_SHIFT = 30;
+
+PageProfiler::PageProfiler(bool sketch, uint32_t sketchWidth, uint32_t sketchDepth)
+    : sketch(sketch), accesses(0), misses(0), width(sketchWidth), depth(sketchDepth), heavyCapacity(1024) {
+    if (sketch) {
+        sketchAccesses.assign(size_t(width) * depth, 0);
+        sketchMisses.assign(size_t(width) * depth, 0);
+    }
+}
+
+HotPage PageProfiler::unpack(const PageKey& key, const PageCounts& counts) {
+    HotPage page;
+    page.pid = key.pid;
+    page.vpn = key.vpn;
+    page.page_size = key.page_size;
+    page.counts = counts;
+    return page;
+}
+
+uint32_t PageProfiler::slot(const PageKey& key, uint32_t row) const {
+    uint64_t h = (PageKeyHash()(key) + 0x9E3779B97F4A7C15ULL * (row + 1)) * 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 31;
+    return row * width + (h % width);
+}
+
+void PageProfiler::recordSketch(const PageKey& key, bool miss) {
+    uint32_t estAccesses = UINT32_MAX;
+    uint32_t estMisses = UINT32_MAX;
+    for (uint32_t row = 0; row < depth; row++) {
+        uint32_t idx = slot(key, row);
+        estAccesses = min(estAccesses, ++sketchAccesses[idx]);
+        if (miss) {
+            sketchMisses[idx]++;
+        }
+        estMisses = min(estMisses, sketchMisses[idx]);
+    }
+
+    auto it = heavyHitters.find(key);
+    if (it != heavyHitters.end()) {
+        if (it->second.misses != estMisses) {
+            heavyByMisses.erase(make_pair(it->second.misses, key));
+            heavyByMisses.insert(make_pair(uint64_t(estMisses), key));
+        }
+        it->second.accesses = estAccesses;
+        it->second.misses = estMisses;
+        return;
+    }
+    if (heavyHitters.size() < heavyCapacity) {
+        heavyHitters[key] = PageCounts{estAccesses, estMisses};
+        heavyByMisses.insert(make_pair(uint64_t(estMisses), key));
+        return;
+    }
+    // replace the weakest candidate when this page is now estimated hotter
+    // (only done on misses, which is what the report ranks by)
+    if (!miss) {
+        return;
+    }
+    auto weakest = heavyByMisses.begin();
+    if (weakest->first < estMisses) {
+        heavyHitters.erase(weakest->second);
+        heavyByMisses.erase(weakest);
+        heavyHitters[key] = PageCounts{estAccesses, estMisses};
+        heavyByMisses.insert(make_pair(uint64_t(estMisses), key));
+    }
+}
+
+void PageProfiler::record(uint32_t pid, uint64_t vaddr, uint32_t page_size, bool miss) {
+    accesses++;
+    misses += miss;
+    if (page_size == 0) {
+        page_size = 4096;
+    }
+    PageKey key{pid, (vaddr & ~(uint64_t(page_size) - 1)) >> 12, page_size};
+    if (sketch) {
+        recordSketch(key, miss);
+    } else {
+        PageCounts& counts = pages[key];
+        counts.accesses++;
+        counts.misses += miss;
+    }
+
+    Region2MCounts& r2 = regions2M[PageKey{pid, vaddr >> REGION_2M_SHIFT, 1u << REGION_2M_SHIFT}];
+    RegionCounts& r1 = regions1G[PageKey{pid, vaddr >> REGION_1G_SHIFT, 1u << REGION_1G_SHIFT}];
+    // a 4KB page lies in one 2MB region, so its first touch there is its first touch in the 1GB region too
+    size_t page = (vaddr >> 12) & (r2.touched.size() - 1);
+    bool firstTouch = !r2.touched.test(page);
+    r2.touched.set(page);
+    r2.accesses++;
+    r1.accesses++;
+    r2.misses += miss;
+    r1.misses += miss;
+    r2.pages += firstTouch;
+    r1.pages += firstTouch;
+}
+
+vector<HotPage> PageProfiler::topPages(size_t n) const {
+    const auto& source = sketch ? heavyHitters : pages;
+    vector<HotPage> ret;
+    ret.reserve(source.size());
+    for (const auto& p : source) {
+        ret.push_back(unpack(p.first, p.second));
+    }
+    auto hotter = [](const HotPage& a, const HotPage& b) {
+        if (a.counts.misses != b.counts.misses) {
+            return a.counts.misses > b.counts.misses;
+        }
+        return a.counts.accesses > b.counts.accesses;
+    };
+    if (ret.size() > n) {
+        partial_sort(ret.begin(), ret.begin() + n, ret.end(), hotter);
+        ret.resize(n);
+    } else {
+        sort(ret.begin(), ret.end(), hotter);
+    }
+    return ret;
+}
+
+void PageProfiler::writeHotPages(ostream& out, size_t n) const {
+    out << "# top " << n << " pages by TLB misses" << (sketch ? " (count-min estimates)" : "") << endl;
+    out << "# pid vaddr page_size accesses misses miss_share" << endl;
+    for (const auto& page : topPages(n)) {
+        out << page.pid << " 0x" << hex << (page.vpn << 12) << dec << " " << page.page_size << " "
+            << page.counts.accesses << " " << page.counts.misses << " "
+            << (misses == 0 ? 0.0 : 1.0 * page.counts.misses / misses) << endl;
+    }
+}
+
+void PageProfiler::writeHeatmap(ostream& out) const {
+    out << "pid,region_base,region_size,accesses,misses,pages_touched" << endl;
+    auto dump = [&](const auto& regions, uint32_t shift) {
+        vector<pair<PageKey, RegionCounts> > rows(regions.begin(), regions.end());
+        sort(rows.begin(), rows.end(), [](const pair<PageKey, RegionCounts>& a, const pair<PageKey, RegionCounts>& b) {
+            return a.first < b.first;
+        });
+        for (const auto& row : rows) {
+            uint32_t pid = row.first.pid;
+            uint64_t base = row.first.vpn << shift;
+            out << pid << ",0x" << hex << base << dec << "," << (1ULL << shift) << ","
+                << row.second.accesses << "," << row.second.misses << "," << row.second.pages << endl;
+        }
+    };
+    dump(regions2M, REGION_2M_SHIFT);
+    dump(regions1G, REGION_1G_SHIFT);
+}
+
+void PageProfiler::writeReports(const string& prefix, size_t n) const {
+    ofstream hot(prefix + ".hot.txt");
+    ofstream heatmap(prefix + ".heatmap.csv");
+    if (!hot || !heatmap) {
+        throw runtime_error("Unable to write profile " + prefix);
+    }
+    writeHotPages(hot, n);
+    writeHeatmap(heatmap);
+}
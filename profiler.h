@@ -0,0 +1,113 @@
+// profiler.h
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <bitset>
+#include <cstdint>
+#include <iostream>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Optional per-page TLB profiler.
+ * Counts accesses and misses per (pid, vpn, page size), and per (pid, 2MB region) and
+ * (pid, 1GB region), to show which pages cause the misses and where huge pages would pay off.
+ * Pages are counted exactly in a hash map, or, for traces with too many pages, in a count-min
+ * sketch that only keeps exact keys for the current heavy hitters. Regions are always exact
+ * (one entry per region actually touched); each 2MB region keeps a bitmap of its 4KB pages, and
+ * a 1GB region's pages touched are the sum over its 2MB regions.
+ */
+struct PageCounts {
+    uint64_t accesses = 0;
+    uint64_t misses = 0;
+};
+
+struct HotPage {
+    uint32_t pid;
+    uint64_t vpn;
+    uint32_t page_size;
+    PageCounts counts;
+};
+
+class PageProfiler {
+public:
+    // sketch: count pages in a count-min sketch instead of exactly
+    PageProfiler(bool sketch = false, uint32_t sketchWidth = 1 << 16, uint32_t sketchDepth = 4);
+
+    void record(uint32_t pid, uint64_t vaddr, uint32_t page_size, bool miss);
+
+    // pages with the most misses (ties broken by accesses)
+    vector<HotPage> topPages(size_t n) const;
+
+    // top-n hot pages, one per line
+    void writeHotPages(ostream& out, size_t n) const;
+    // csv: pid,region_base,region_size,accesses,misses,pages_touched
+    void writeHeatmap(ostream& out) const;
+    // write <prefix>.hot.txt and <prefix>.heatmap.csv
+    void writeReports(const string& prefix, size_t n) const;
+
+    uint64_t totalAccesses() const { return accesses; }
+    uint64_t totalMisses() const { return misses; }
+
+private:
+    // a page (vpn and page size) or a region (region number and region size) of a pid
+    struct PageKey {
+        uint32_t pid;
+        uint64_t vpn;
+        uint32_t page_size;
+        bool operator==(const PageKey& other) const {
+            return pid == other.pid && vpn == other.vpn && page_size == other.page_size;
+        }
+        bool operator<(const PageKey& other) const {
+            if (pid != other.pid) {
+                return pid < other.pid;
+            }
+            return vpn != other.vpn ? vpn < other.vpn : page_size < other.page_size;
+        }
+    };
+    // pid | vpn | log2(page size), packed into one word (exact for 32-bit addresses)
+    struct PageKeyHash {
+        size_t operator()(const PageKey& k) const {
+            return (uint64_t(k.pid) << 32) ^ (k.vpn << 5) ^ __builtin_ctz(k.page_size);
+        }
+    };
+
+    struct RegionCounts {
+        uint64_t accesses = 0;
+        uint64_t misses = 0;
+        uint32_t pages = 0;   // distinct 4KB pages touched
+    };
+    struct Region2MCounts : RegionCounts {
+        bitset<512> touched;  // 4KB pages of the region seen so far
+    };
+
+    bool sketch;
+    uint64_t accesses;
+    uint64_t misses;
+
+    // exact mode
+    unordered_map<PageKey, PageCounts, PageKeyHash> pages;
+
+    // sketch mode
+    uint32_t width;
+    uint32_t depth;
+    vector<uint32_t> sketchAccesses;
+    vector<uint32_t> sketchMisses;
+    unordered_map<PageKey, PageCounts, PageKeyHash> heavyHitters;   // estimated counts of the candidates
+    set<pair<uint64_t, PageKey> > heavyByMisses;                   // the candidates by estimated misses, weakest first
+    size_t heavyCapacity;
+
+    unordered_map<PageKey, Region2MCounts, PageKeyHash> regions2M;
+    unordered_map<PageKey, RegionCounts, PageKeyHash> regions1G;
+
+    static HotPage unpack(const PageKey& key, const PageCounts& counts);
+    uint32_t slot(const PageKey& key, uint32_t row) const;
+    void recordSketch(const PageKey& key, bool miss);
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,141 @@
+#include "reclaimer.h"
+
+Reclaimer::Reclaimer() {}
+
+void Reclaimer::pushHead(List& list, uint32_t idx, bool isActive) {
+    Node& node = nodes[idx];
+    node.isActive = isActive;
+    node.prev = NIL;
+    node.next = list.head;
+    if (list.head != NIL) {
+        nodes[list.head].prev = idx;
+    } else {
+        list.tail = idx;
+    }
+    list.head = idx;
+    list.size++;
+}
+
+void Reclaimer::unlink(uint32_t idx) {
+    Node& node = nodes[idx];
+    List& list = node.isActive ? active : inactive;
+    if (node.prev != NIL) {
+        nodes[node.prev].next = node.next;
+    } else {
+        list.head = node.next;
+    }
+    if (node.next != NIL) {
+        nodes[node.next].prev = node.prev;
+    } else {
+        list.tail = node.prev;
+    }
+    list.size--;
+}
+
+void Reclaimer::track(uint32_t pfn, uint32_t pid, uint64_t vpn, uint32_t page_size) {
+    untrack(pfn);
+    uint32_t idx;
+    if (!freeNodes.empty()) {
+        idx = freeNodes.back();
+        freeNodes.pop_back();
+    } else {
+        idx = nodes.size();
+        nodes.push_back(Node());
+    }
+    nodes[idx].page = {pfn, pid, vpn, page_size};
+    nodes[idx].referenced = false;
+    pushHead(inactive, idx, false);
+    pfnToNode[pfn] = idx;
+}
+
+void Reclaimer::untrack(uint32_t pfn) {
+    auto it = pfnToNode.find(pfn);
+    if (it == pfnToNode.end()) {
+        return;
+    }
+    unlink(it->second);
+    freeNodes.push_back(it->second);
+    pfnToNode.erase(it);
+}
+
+void Reclaimer::markReferenced(uint32_t pfn) {
+    auto it = pfnToNode.find(pfn);
+    if (it != pfnToNode.end()) {
+        nodes[it->second].referenced = true;
+    }
+}
+
+bool Reclaimer::lookUp(uint32_t pfn, ReclaimVictim& page) const {
+    auto it = pfnToNode.find(pfn);
+    if (it == pfnToNode.end()) {
+        return false;
+    }
+    page = nodes[it->second].page;
+    return true;
+}
+
+void Reclaimer::move(uint32_t pfn, uint32_t newPfn) {
+    auto it = pfnToNode.find(pfn);
+    if (it == pfnToNode.end()) {
+        return;
+    }
+    uint32_t idx = it->second;
+    pfnToNode.erase(it);
+    nodes[idx].page.pfn = newPfn;
+    pfnToNode[newPfn] = idx;
+}
+
+void Reclaimer::balance(size_t budget) {
+    while (active.size > inactive.size && budget-- > 0) {
+        uint32_t idx = active.tail;
+        Node& node = nodes[idx];
+        scanned++;
+        unlink(idx);
+        if (node.referenced) {
+            // still in use, rotate to the active head
+            node.referenced = false;
+            pushHead(active, idx, true);
+        } else {
+            pushHead(inactive, idx, false);
+            deactivated++;
+        }
+    }
+}
+
+bool Reclaimer::selectVictim(ReclaimVictim& victim) {
+    if (active.size + inactive.size == 0) {
+        return false;
+    }
+    // every page is looked at at most twice, so the scan always ends
+    size_t budget = 2 * (active.size + inactive.size) + 1;
+    while (budget-- > 0) {
+        balance(active.size);
+        if (inactive.size == 0) {
+            break;
+        }
+        uint32_t idx = inactive.tail;
+        Node& node = nodes[idx];
+        scanned++;
+        unlink(idx);
+        if (node.referenced) {
+            // second chance
+            node.referenced = false;
+            pushHead(active, idx, true);
+            activated++;
+            continue;
+        }
+        victim = node.page;
+        freeNodes.push_back(idx);
+        pfnToNode.erase(victim.pfn);
+        reclaimed++;
+        reclaimedBytes += victim.page_size;
+        return true;
+    }
+    // everything was referenced twice in a row, fall back to the oldest page
+    uint32_t idx = inactive.size != 0 ? inactive.tail : active.tail;
+    victim = nodes[idx].page;
+    untrack(victim.pfn);
+    reclaimed++;
+    reclaimedBytes += victim.page_size;
+    return true;
+}
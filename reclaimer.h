@@ -0,0 +1,88 @@
+// reclaimer.h
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Page aging for reclaim, in the style of kswapd's active/inactive lists.
+ * Every mapped page (a code/stack/heap mapping of any page size, keyed by its base pfn) sits on
+ * one of two LRU lists. New pages start at the head of the inactive list. A TLB fill sets the
+ * page's referenced bit. Victims are taken from the inactive tail: a referenced page gets a second
+ * chance and is promoted to the active list, an unreferenced one is evicted. When the active list
+ * outgrows the inactive one, pages from the active tail are demoted (or rotated if referenced).
+ * The os does the actual swap-out; this class only picks victims and counts.
+ */
+struct ReclaimVictim {
+    uint32_t pfn;
+    uint32_t pid;
+    uint64_t vpn;
+    uint32_t page_size;
+};
+
+class Reclaimer {
+public:
+    // counters
+    long long scanned = 0;       // pages looked at on either list
+    long long activated = 0;     // inactive -> active (referenced since last scan)
+    long long deactivated = 0;   // active -> inactive
+    long long reclaimed = 0;     // pages handed out as victims
+    long long reclaimedBytes = 0;
+    long long batches = 0;       // incremental (kswapd) batches run
+    long long directReclaims = 0;    // allocations that had to reclaim synchronously
+    long long swapIns = 0;       // faults on swapped-out pages
+
+    Reclaimer();
+
+    // start tracking a newly mapped page
+    void track(uint32_t pfn, uint32_t pid, uint64_t vpn, uint32_t page_size);
+    // stop tracking (freed, swapped out or process exited)
+    void untrack(uint32_t pfn);
+    // set on TLB fill
+    void markReferenced(uint32_t pfn);
+    // the tracked mapping whose base frame is pfn, false if there is none
+    bool lookUp(uint32_t pfn, ReclaimVictim& page) const;
+    // a tracked mapping migrated to newPfn, keeping its list position and referenced bit
+    void move(uint32_t pfn, uint32_t newPfn);
+    // age the lists and pick the next page to evict, the victim is untracked
+    // return false when nothing is tracked
+    bool selectVictim(ReclaimVictim& victim);
+
+    size_t activeSize() const { return active.size; }
+    size_t inactiveSize() const { return inactive.size; }
+
+private:
+    static const uint32_t NIL = 0xFFFFFFFF;
+
+    struct Node {
+        ReclaimVictim page;
+        uint32_t prev;
+        uint32_t next;
+        bool isActive;
+        bool referenced;
+    };
+
+    struct List {
+        uint32_t head = NIL;
+        uint32_t tail = NIL;
+        size_t size = 0;
+    };
+
+    // index-linked nodes so the whole structure copies by value with the os snapshot
+    vector<Node> nodes;
+    vector<uint32_t> freeNodes;
+    unordered_map<uint32_t, uint32_t> pfnToNode;
+    List active;
+    List inactive;
+
+    void pushHead(List& list, uint32_t idx, bool isActive);
+    void unlink(uint32_t idx);
+    // move pages from the active tail while the active list is the larger one
+    void balance(size_t budget);
+};
+
+#endif // RECLAIMER_H
@@ -0,0 +1,116 @@
+#include "reservation.h"
+
+static const uint32_t FRAME_SIZE = 4096;
+
+ReservationTable::ReservationTable() : reservationSize(0), clock(0) {}
+
+void ReservationTable::configure(uint32_t size) {
+    reservationSize = size;
+}
+
+uint32_t ReservationTable::size() const {
+    return reservationSize;
+}
+
+bool ReservationTable::enabled() const {
+    return reservationSize > 0;
+}
+
+size_t ReservationTable::frames() const {
+    return reservationSize / FRAME_SIZE;
+}
+
+Reservation* ReservationTable::find(uint32_t pid, uint64_t vpn) {
+    auto it = byRegion.find(make_pair(pid, vpn / frames() * frames()));
+    return it == byRegion.end() ? nullptr : &byFrame[it->second];
+}
+
+Reservation* ReservationTable::findFrame(uint32_t pfn) {
+    auto it = byFrame.upper_bound(pfn);
+    if (it == byFrame.begin()) {
+        return nullptr;
+    }
+    --it;
+    return pfn < it->first + frames() ? &it->second : nullptr;
+}
+
+Reservation* ReservationTable::oldest() {
+    Reservation* ret = nullptr;
+    for (auto& entry : byFrame) {
+        if (ret == nullptr || entry.second.lastUse < ret->lastUse) {
+            ret = &entry.second;
+        }
+    }
+    return ret;
+}
+
+vector<uint32_t> ReservationTable::ofProcess(uint32_t pid) const {
+    vector<uint32_t> ret;
+    for (const auto& entry : byFrame) {
+        if (entry.second.pid == pid) {
+            ret.push_back(entry.first);
+        }
+    }
+    return ret;
+}
+
+Reservation& ReservationTable::add(uint32_t pid, uint64_t regionVpn, uint32_t pfn) {
+    Reservation& reservation = byFrame[pfn];
+    reservation.pid = pid;
+    reservation.vpn = regionVpn;
+    reservation.pfn = pfn;
+    reservation.populated = 0;
+    reservation.mapped.assign(frames(), false);
+    reservation.lastUse = ++clock;
+    byRegion[make_pair(pid, regionVpn)] = pfn;
+    return reservation;
+}
+
+void ReservationTable::remove(uint32_t pfn) {
+    auto it = byFrame.find(pfn);
+    if (it == byFrame.end()) {
+        return;
+    }
+    byRegion.erase(make_pair(it->second.pid, it->second.vpn));
+    byFrame.erase(it);
+}
+
+void ReservationTable::populate(Reservation& reservation, size_t offset, size_t count) {
+    for (size_t i = offset; i < offset + count; i++) {
+        reservation.populated += !reservation.mapped[i];
+        reservation.mapped[i] = true;
+    }
+    reservation.lastUse = ++clock;
+}
+
+void ReservationTable::unpopulate(Reservation& reservation, size_t offset, size_t count) {
+    for (size_t i = offset; i < offset + count; i++) {
+        reservation.populated -= reservation.mapped[i];
+        reservation.mapped[i] = false;
+    }
+}
+
+bool ReservationTable::available(const Reservation& reservation, size_t offset, size_t count) const {
+    for (size_t i = offset; i < offset + count; i++) {
+        if (reservation.mapped[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ReservationTable::full(const Reservation& reservation) const {
+    return reservation.populated == frames();
+}
+
+size_t ReservationTable::idleFrames() const {
+    size_t ret = 0;
+    for (const auto& entry : byFrame) {
+        ret += frames() - entry.second.populated;
+    }
+    return ret;
+}
+
+size_t ReservationTable::count() const {
+    return byFrame.size();
+}
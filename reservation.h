@@ -0,0 +1,86 @@
+// reservation.h
+#ifndef RESERVATION_H
+#define RESERVATION_H
+
+#include <stdint.h>
+#include <cstddef>
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// an aligned physical block set aside for an aligned virtual region of one process's heap
+struct Reservation {
+    uint32_t pid;
+    uint64_t vpn;               // first vpn of the region
+    uint32_t pfn;               // first frame of the block
+    uint32_t populated = 0;     // 4KB frames mapped so far
+    vector<bool> mapped;        // by 4KB frame
+    uint64_t lastUse = 0;       // when a frame was last mapped, the oldest reservation is broken first
+};
+
+/**
+ * Superpage reservations, in the style of FreeBSD's vm_reserv.
+ * The first heap allocation in an aligned virtual region of size bytes reserves a free aligned physical
+ * block of the same size; allocations in the region then take the frames at the same offset in the block,
+ * so once every frame is mapped the region is promoted in place to one large page, without copying.
+ * Reserved frames that are not mapped yet are in use as far as the allocator is concerned: under memory
+ * pressure the least recently filled reservation is broken, its mapped pages staying as they are and the
+ * rest of the block going back to the free frames. A promoted page that is partly freed is demoted back
+ * to 4KB pages, and its region becomes a reservation again.
+ * The os maps the frames; this class keeps the reservations and counts.
+ */
+class ReservationTable {
+public:
+    // counters
+    long long made = 0;          // reservations made
+    long long hits = 0;          // allocations served by a reservation made by an earlier one
+    long long fallbacks = 0;     // allocations that found no free block to reserve
+    long long promotions = 0;
+    long long demotions = 0;
+    long long broken = 0;        // reservations broken with frames still unmapped
+    long long brokenForPressure = 0;   // ... to free memory
+    long long released = 0;      // reservations given back whole, every frame freed or the process gone
+    long long framesReturned = 0;      // unmapped frames freed by breaking
+
+    ReservationTable();
+
+    // size 0 turns reservations off
+    void configure(uint32_t size);
+    uint32_t size() const;
+    bool enabled() const;
+    // 4KB frames in a reservation
+    size_t frames() const;
+
+    // the reservation of pid's region holding vpn, nullptr if there is none
+    Reservation* find(uint32_t pid, uint64_t vpn);
+    // the reservation whose block holds pfn, nullptr if there is none
+    Reservation* findFrame(uint32_t pfn);
+    // the least recently filled reservation, nullptr if there is none
+    Reservation* oldest();
+    // base frames of the reservations of pid
+    vector<uint32_t> ofProcess(uint32_t pid) const;
+
+    Reservation& add(uint32_t pid, uint64_t regionVpn, uint32_t pfn);
+    void remove(uint32_t pfn);
+
+    // mark count frames from offset mapped or unmapped
+    void populate(Reservation& reservation, size_t offset, size_t count);
+    void unpopulate(Reservation& reservation, size_t offset, size_t count);
+    // whether count frames from offset are all unmapped
+    bool available(const Reservation& reservation, size_t offset, size_t count) const;
+    bool full(const Reservation& reservation) const;
+
+    // reserved frames not mapped yet, over every reservation
+    size_t idleFrames() const;
+    size_t count() const;
+
+private:
+    uint32_t reservationSize;
+    map<uint32_t, Reservation> byFrame;                 // by base pfn
+    map<pair<uint32_t, uint64_t>, uint32_t> byRegion;   // (pid, region vpn) -> base pfn
+    uint64_t clock;
+};
+
+#endif // RESERVATION_H
@@ -0,0 +1,191 @@
+#include "scheduler.h"
+#include "tlb.h"
+#include "page-table.h"
+#include "timing.h"
+#include "trace.h"
+#include <iomanip>
+#include <stdexcept>
+
+// events read from a trace at a time
+static const size_t SCHEDULER_CHUNK = 256;
+// pids of a workload are shifted into the high half, below the global TLB tag
+static const uint32_t WORKLOAD_PID_BITS = 16;
+static const uint32_t MAX_WORKLOADS = TLB_GLOBAL_TAG >> WORKLOAD_PID_BITS;
+
+const char* schedulerPolicyName(SchedulerPolicy policy) {
+    return policy == SCHED_CFS ? "cfs" : "rr";
+}
+
+SchedulerPolicy parseSchedulerPolicy(const string& name) {
+    if (name == "rr") {
+        return SCHED_ROUND_ROBIN;
+    }
+    if (name == "cfs") {
+        return SCHED_CFS;
+    }
+    throw invalid_argument("unknown scheduler " + name);
+}
+
+TraceScheduler::TraceScheduler(const SchedulerConfig& config) : settings(config) {
+    if (settings.quantum == 0 && settings.timeQuantum == 0) {
+        throw invalid_argument("the quantum must be positive");
+    }
+}
+
+void TraceScheduler::addTrace(const string& spec) {
+    if (traces.size() >= MAX_WORKLOADS) {
+        throw invalid_argument("at most " + to_string(MAX_WORKLOADS) + " traces");
+    }
+    unique_ptr<Workload> workload(new Workload());
+    workload->path = spec;
+    // a trailing :digits is the weight, anything else belongs to the path
+    size_t colon = spec.rfind(':');
+    if (colon != string::npos && colon + 1 < spec.size() &&
+        spec.find_first_not_of("0123456789", colon + 1) == string::npos) {
+        unsigned long weight = stoul(spec.substr(colon + 1));
+        if (weight == 0 || weight > 1000000) {
+            throw invalid_argument("bad weight " + spec.substr(colon + 1));
+        }
+        workload->weight = weight;
+        workload->path = spec.substr(0, colon);
+    }
+    workload->input.open(workload->path);
+    if (!workload->input) {
+        throw runtime_error("unable to open " + workload->path);
+    }
+    workload->id = traces.size();
+    traces.push_back(move(workload));
+}
+
+size_t TraceScheduler::workloads() const {
+    return traces.size();
+}
+
+bool TraceScheduler::peek(Workload& workload, PackedEvent& event) {
+    if (workload.finished) {
+        return false;
+    }
+    if (workload.next == workload.buffer.size()) {
+        workload.buffer.clear();
+        workload.next = 0;
+        string line;
+        PackedEvent packed;
+        while (workload.buffer.size() < SCHEDULER_CHUNK && getline(workload.input, line)) {
+            if (!packTraceLine(line, packed)) {
+                continue;
+            }
+            uint32_t high = workload.id << WORKLOAD_PID_BITS;
+            if (packed.pid >> WORKLOAD_PID_BITS != 0 || (packed.op == OP_FORK && packed.value >> WORKLOAD_PID_BITS != 0)) {
+                throw runtime_error(workload.path + ": pids must be below " + to_string(1u << WORKLOAD_PID_BITS));
+            }
+            packed.pid |= high;
+            if (packed.op == OP_FORK) {
+                packed.value |= high;
+            }
+            workload.buffer.push_back(packed);
+        }
+        if (workload.buffer.empty()) {
+            workload.finished = true;
+            return false;
+        }
+    }
+    event = workload.buffer[workload.next];
+    return true;
+}
+
+int TraceScheduler::pick(int previous) {
+    PackedEvent event;
+    int n = traces.size();
+    if (settings.policy == SCHED_ROUND_ROBIN) {
+        for (int i = 1; i <= n; i++) {
+            int k = (previous + i) % n;
+            if (peek(*traces[k], event)) {
+                return k;
+            }
+        }
+        return -1;
+    }
+    int best = -1;
+    for (int k = 0; k < n; k++) {
+        if (peek(*traces[k], event) && (best < 0 || traces[k]->vruntime < traces[best]->vruntime)) {
+            best = k;
+        }
+    }
+    return best;
+}
+
+void TraceScheduler::runSlice(os& osInstance, Workload& workload) {
+    uint64_t limit = settings.timeQuantum > 0 ? settings.timeQuantum : settings.quantum;
+    uint64_t used = 0;
+    PackedEvent event;
+    slices++;
+    workload.slices++;
+    while (used < limit && peek(workload, event)) {
+        workload.next++;
+        int missesBefore = TLB_miss;
+        int memoryBefore = memory_hit;
+        long long cyclesBefore = Timing_cycles;
+        osInstance.runEvent(event);
+
+        bool access = isAccessOp(event.op);
+        long long cycles = settings.timed ? Timing_cycles - cyclesBefore
+                                          : (access ? settings.hitCycles : 0) +
+                                                (long long)(memory_hit - memoryBefore) * settings.memoryCycles;
+        workload.events++;
+        workload.cycles += cycles;
+        if (access) {
+            workload.accesses++;
+            workload.misses += TLB_miss - missesBefore;
+        }
+        used += settings.timeQuantum > 0 ? cycles : access;
+
+        if (event.op == OP_SWITCH) {
+            workload.hasPid = true;
+            workload.pid = event.pid;
+        } else if (event.op == OP_EXIT && workload.hasPid && event.pid == workload.pid) {
+            workload.hasPid = false;
+        }
+    }
+    workload.vruntime += used * 1024 / workload.weight;
+}
+
+void TraceScheduler::run(os& osInstance) {
+    int previous = -1;
+    int k;
+    while ((k = pick(previous)) >= 0) {
+        Workload& workload = *traces[k];
+        if (k != previous) {
+            if (previous >= 0) {
+                contextSwitches++;
+            }
+            // resume the process the workload last ran, unless its trace switches right away
+            PackedEvent event;
+            if (workload.hasPid && peek(workload, event) && event.op != OP_SWITCH) {
+                PackedEvent resume;
+                resume.value = 0;
+                resume.pid = workload.pid;
+                resume.op = OP_SWITCH;
+                osInstance.runEvent(resume);
+            }
+        }
+        runSlice(osInstance, workload);
+        previous = k;
+    }
+}
+
+void TraceScheduler::printReport(ostream& out) const {
+    out << "Scheduler:        " << schedulerPolicyName(settings.policy) << ", "
+        << (settings.timeQuantum > 0 ? settings.timeQuantum : settings.quantum)
+        << (settings.timeQuantum > 0 ? " cycles" : " accesses") << " per slice, " << traces.size() << " workloads"
+        << endl;
+    out << "Slices:           " << slices << " (" << contextSwitches << " context switches)" << endl;
+    for (const auto& workload : traces) {
+        double hitRate = workload->accesses == 0 ? 0.0
+                                                 : 100.0 * (workload->accesses - workload->misses) / workload->accesses;
+        string label = "Workload " + to_string(workload->id) + ":";
+        out << left << setw(18) << label << right << workload->path << ", weight " << workload->weight << ": "
+            << workload->events << " events, " << workload->accesses << " accesses, " << workload->misses
+            << " TLB misses (" << hitRate << "%), " << workload->slices << " slices, " << workload->cycles
+            << " cycles" << endl;
+    }
+}
@@ -0,0 +1,90 @@
+// scheduler.h
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "os.h"
+#include "trace-op.h"
+#include <stdint.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// how the next workload is picked when a slice ends
+//   rr:   round robin, every workload in turn
+//   cfs:  the one with the least virtual runtime, which grows by the slice used times 1024 over the weight
+enum SchedulerPolicy { SCHED_ROUND_ROBIN, SCHED_CFS };
+
+struct SchedulerConfig {
+    SchedulerPolicy policy = SCHED_ROUND_ROBIN;
+    uint64_t quantum = 1000;        // accesses per slice
+    uint64_t timeQuantum = 0;       // or cycles per slice, 0: count accesses
+    // what a slice costs in cycles: the timing model's cycles when it runs, else
+    // every access at hitCycles plus every page-table reference that reached memory at memoryCycles
+    bool timed = false;
+    uint32_t hitCycles = 1;
+    uint32_t memoryCycles = 200;
+};
+
+const char* schedulerPolicyName(SchedulerPolicy policy);
+// "rr" or "cfs"; throws invalid_argument otherwise
+SchedulerPolicy parseSchedulerPolicy(const string& name);
+
+/**
+ * Runs several independent traces on one os, one workload per trace, as a scheduler would.
+ * Every trace is read lazily, a small chunk at a time, so traces of any length can be mixed.
+ * A workload runs for a slice (quantum accesses, or timeQuantum cycles), then the policy picks the next
+ * one and the os is switched to the process that workload last ran. Pids are made distinct by
+ * workload: pid p of workload k becomes (k << 16) | p, so workload 0 keeps its own pids.
+ * The switches inside a trace run as they are, they only change which process of the workload runs.
+ */
+class TraceScheduler {
+public:
+    explicit TraceScheduler(const SchedulerConfig& config);
+
+    // "path[:weight]", the weight (default 1024, the nice 0 weight) only matters to cfs;
+    // throws runtime_error if the file cannot be opened, invalid_argument on a bad weight
+    void addTrace(const string& spec);
+    size_t workloads() const;
+
+    // run every trace to its end
+    void run(os& osInstance);
+
+    void printReport(ostream& out = cout) const;
+
+private:
+    struct Workload {
+        string path;
+        uint32_t id = 0;            // the workload number, the high half of its pids
+        uint32_t weight = 1024;
+        ifstream input;
+        vector<PackedEvent> buffer;
+        size_t next = 0;
+        bool finished = false;
+        bool hasPid = false;        // the process that last ran is still alive
+        uint32_t pid = 0;           // ... and its (remapped) pid
+        uint64_t vruntime = 0;
+        // counters
+        long long slices = 0;
+        long long events = 0;
+        long long accesses = 0;
+        long long misses = 0;
+        long long cycles = 0;
+    };
+
+    SchedulerConfig settings;
+    vector<unique_ptr<Workload> > traces;
+    long long slices = 0;
+    long long contextSwitches = 0;  // slices that went to another workload than the one before
+
+    // the next event of a workload, remapped, false at the end of its trace
+    bool peek(Workload& workload, PackedEvent& event);
+    // the workload the next slice goes to, -1 when every trace is done
+    int pick(int previous);
+    void runSlice(os& osInstance, Workload& workload);
+};
+
+#endif // SCHEDULER_H
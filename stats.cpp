@@ -0,0 +1,387 @@
+#include "stats.h"
+#include <algorithm>
+#include <iomanip>
+#include "os.h"
+#include "tlb.h"
+#include "page-table.h"
+
+void SimStats::add(const SimStats& other) {
+    memory_access_attempts += other.memory_access_attempts;
+    code_miss += other.code_miss;
+    stack_miss += other.stack_miss;
+    heap_miss += other.heap_miss;
+    TLB_miss += other.TLB_miss;
+    L1_hit += other.L1_hit;
+    code_access += other.code_access;
+    itlb_hit += other.itlb_hit;
+    L2_hit += other.L2_hit;
+    victim_hit += other.victim_hit;
+    for (int k = 0; k <= TLB_MAX_LEVELS; k++) {
+        level_hit[k] += other.level_hit[k];
+    }
+    memory_hit += other.memory_hit;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        walk_served[k] += other.walk_served[k];
+        walk_ref_served[k] += other.walk_ref_served[k];
+        data_served[k] += other.data_served[k];
+    }
+    numa_local += other.numa_local;
+    numa_remote += other.numa_remote;
+    walk_memory_ns += other.walk_memory_ns;
+    data_memory_ns += other.data_memory_ns;
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        replacement_ops[p] += other.replacement_ops[p];
+    }
+    ship_dead_fills += other.ship_dead_fills;
+    timing_accesses += other.timing_accesses;
+    timing_cycles += other.timing_cycles;
+    timing_blocking_cycles += other.timing_blocking_cycles;
+    timing_walks += other.timing_walks;
+    timing_merged += other.timing_merged;
+    timing_walk_cycles += other.timing_walk_cycles;
+    timing_walk_busy_cycles += other.timing_walk_busy_cycles;
+    timing_window_stall += other.timing_window_stall;
+    timing_mshr_stall += other.timing_mshr_stall;
+    timing_max_walks = max(timing_max_walks, other.timing_max_walks);
+    for (const auto& entry : other.miss_classes) {
+        MissClassCounts& counts = miss_classes.emplace(entry.first, MissClassCounts()).first->second;
+        for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+            counts[c] += entry.second[c];
+        }
+    }
+}
+
+void SimStats::subtract(const SimStats& other) {
+    memory_access_attempts -= other.memory_access_attempts;
+    code_miss -= other.code_miss;
+    stack_miss -= other.stack_miss;
+    heap_miss -= other.heap_miss;
+    TLB_miss -= other.TLB_miss;
+    L1_hit -= other.L1_hit;
+    code_access -= other.code_access;
+    itlb_hit -= other.itlb_hit;
+    L2_hit -= other.L2_hit;
+    victim_hit -= other.victim_hit;
+    for (int k = 0; k <= TLB_MAX_LEVELS; k++) {
+        level_hit[k] -= other.level_hit[k];
+    }
+    memory_hit -= other.memory_hit;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        walk_served[k] -= other.walk_served[k];
+        walk_ref_served[k] -= other.walk_ref_served[k];
+        data_served[k] -= other.data_served[k];
+    }
+    numa_local -= other.numa_local;
+    numa_remote -= other.numa_remote;
+    walk_memory_ns -= other.walk_memory_ns;
+    data_memory_ns -= other.data_memory_ns;
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        replacement_ops[p] -= other.replacement_ops[p];
+    }
+    ship_dead_fills -= other.ship_dead_fills;
+    timing_accesses -= other.timing_accesses;
+    timing_cycles -= other.timing_cycles;
+    timing_blocking_cycles -= other.timing_blocking_cycles;
+    timing_walks -= other.timing_walks;
+    timing_merged -= other.timing_merged;
+    timing_walk_cycles -= other.timing_walk_cycles;
+    timing_walk_busy_cycles -= other.timing_walk_busy_cycles;
+    timing_window_stall -= other.timing_window_stall;
+    timing_mshr_stall -= other.timing_mshr_stall;
+    for (const auto& entry : other.miss_classes) {
+        MissClassCounts& counts = miss_classes.emplace(entry.first, MissClassCounts()).first->second;
+        for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+            counts[c] -= entry.second[c];
+        }
+    }
+}
+
+double SimStats::tlbHitRate() const {
+    return 1.0 * (memory_access_attempts - TLB_miss) / memory_access_attempts;
+}
+
+double SimStats::l1HitRate() const {
+    return 1.0 * L1_hit / memory_access_attempts;
+}
+
+double SimStats::itlbHitRate() const {
+    return 1.0 * itlb_hit / code_access;
+}
+
+double SimStats::dtlbHitRate() const {
+    return 1.0 * (L1_hit - itlb_hit) / (memory_access_attempts - code_access);
+}
+
+double SimStats::levelHitRate(int level) const {
+    long long hits = level == 2 ? L2_hit : level_hit[level];
+    long long reached = hits + TLB_miss;
+    for (int k = max(level + 1, 3); k <= TLB_MAX_LEVELS; k++) {
+        reached += level_hit[k];
+    }
+    return 1.0 * hits / reached;
+}
+
+double SimStats::l2HitRate() const {
+    return levelHitRate(2);
+}
+
+double SimStats::walkConcurrency() const {
+    return timing_walk_busy_cycles == 0 ? 0.0 : 1.0 * timing_walk_cycles / timing_walk_busy_cycles;
+}
+
+SimStats collectStats() {
+    SimStats stats;
+    stats.memory_access_attempts = memory_access_attempts;
+    stats.code_miss = code_miss;
+    stats.stack_miss = stack_miss;
+    stats.heap_miss = heap_miss;
+    stats.TLB_miss = TLB_miss;
+    stats.L1_hit = L1_hit;
+    stats.code_access = code_access;
+    stats.itlb_hit = itlb_hit;
+    stats.L2_hit = L2_hit;
+    stats.victim_hit = Victim_hit;
+    for (int k = 0; k <= TLB_MAX_LEVELS; k++) {
+        stats.level_hit[k] = Level_hit[k];
+    }
+    stats.memory_hit = memory_hit;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        stats.walk_served[k] = Walk_served[k];
+        stats.walk_ref_served[k] = Walk_ref_served[k];
+        stats.data_served[k] = Data_served[k];
+    }
+    stats.numa_local = Numa_local;
+    stats.numa_remote = Numa_remote;
+    stats.walk_memory_ns = Walk_memory_ns;
+    stats.data_memory_ns = Data_memory_ns;
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        stats.replacement_ops[p] = Replacement_ops[p];
+    }
+    stats.ship_dead_fills = Ship_dead_fills;
+    stats.timing_accesses = Timing_accesses;
+    stats.timing_cycles = Timing_cycles;
+    stats.timing_blocking_cycles = Timing_blocking_cycles;
+    stats.timing_walks = Timing_walks;
+    stats.timing_merged = Timing_merged;
+    stats.timing_walk_cycles = Timing_walk_cycles;
+    stats.timing_walk_busy_cycles = Timing_walk_busy_cycles;
+    stats.timing_max_walks = Timing_max_walks;
+    stats.timing_window_stall = Timing_window_stall;
+    stats.timing_mshr_stall = Timing_mshr_stall;
+    stats.miss_classes = Miss_classes;
+    return stats;
+}
+
+void resetStats() {
+    memory_access_attempts = 0;
+    code_miss = 0;
+    stack_miss = 0;
+    heap_miss = 0;
+    TLB_miss = 0;
+    L1_hit = 0;
+    code_access = 0;
+    itlb_hit = 0;
+    L2_hit = 0;
+    Victim_hit = 0;
+    for (int k = 0; k <= TLB_MAX_LEVELS; k++) {
+        Level_hit[k] = 0;
+    }
+    memory_hit = 0;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        Walk_served[k] = 0;
+        Walk_ref_served[k] = 0;
+        Data_served[k] = 0;
+    }
+    Numa_local = 0;
+    Numa_remote = 0;
+    Walk_memory_ns = 0;
+    Data_memory_ns = 0;
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        Replacement_ops[p] = 0;
+    }
+    Ship_dead_fills = 0;
+    Timing_accesses = 0;
+    Timing_cycles = 0;
+    Timing_blocking_cycles = 0;
+    Timing_walks = 0;
+    Timing_merged = 0;
+    Timing_walk_cycles = 0;
+    Timing_walk_busy_cycles = 0;
+    Timing_max_walks = 0;
+    Timing_window_stall = 0;
+    Timing_mshr_stall = 0;
+    Miss_classes.clear();
+}
+
+void addStats(const SimStats& stats) {
+    memory_access_attempts += stats.memory_access_attempts;
+    code_miss += stats.code_miss;
+    stack_miss += stats.stack_miss;
+    heap_miss += stats.heap_miss;
+    TLB_miss += stats.TLB_miss;
+    L1_hit += stats.L1_hit;
+    code_access += stats.code_access;
+    itlb_hit += stats.itlb_hit;
+    L2_hit += stats.L2_hit;
+    Victim_hit += stats.victim_hit;
+    for (int k = 0; k <= TLB_MAX_LEVELS; k++) {
+        Level_hit[k] += stats.level_hit[k];
+    }
+    memory_hit += stats.memory_hit;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        Walk_served[k] += stats.walk_served[k];
+        Walk_ref_served[k] += stats.walk_ref_served[k];
+        Data_served[k] += stats.data_served[k];
+    }
+    Numa_local += stats.numa_local;
+    Numa_remote += stats.numa_remote;
+    Walk_memory_ns += stats.walk_memory_ns;
+    Data_memory_ns += stats.data_memory_ns;
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        Replacement_ops[p] += stats.replacement_ops[p];
+    }
+    Ship_dead_fills += stats.ship_dead_fills;
+    Timing_accesses += stats.timing_accesses;
+    Timing_cycles += stats.timing_cycles;
+    Timing_blocking_cycles += stats.timing_blocking_cycles;
+    Timing_walks += stats.timing_walks;
+    Timing_merged += stats.timing_merged;
+    Timing_walk_cycles += stats.timing_walk_cycles;
+    Timing_walk_busy_cycles += stats.timing_walk_busy_cycles;
+    Timing_max_walks = max<long long>(Timing_max_walks, stats.timing_max_walks);
+    Timing_window_stall += stats.timing_window_stall;
+    Timing_mshr_stall += stats.timing_mshr_stall;
+    for (const auto& entry : stats.miss_classes) {
+        MissClassCounts& counts = Miss_classes.emplace(entry.first, MissClassCounts()).first->second;
+        for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+            counts[c] += entry.second[c];
+        }
+    }
+}
+
+// "L1D 120 L2 30 L3 10 memory 5", up to the last cache level that served anything
+static void printServed(const char* title, const long long served[], ostream& out) {
+    int last = -1;
+    for (int k = 0; k < CACHE_MAX_LEVELS; k++) {
+        if (served[k] > 0) {
+            last = k;
+        }
+    }
+    out << title;
+    for (int k = 0; k <= last; k++) {
+        out << (k == 0 ? " L1D " : " L" + to_string(k + 1) + " ") << served[k];
+    }
+    out << " memory " << served[CACHE_MEMORY] << endl;
+}
+
+static string tlbLevelName(int level) {
+    return level == 0 ? "iTLB" : "L" + to_string(level);
+}
+
+static void printMissRow(const string& name, const MissClassCounts& counts, ostream& out) {
+    out << "  " << left << setw(20) << name << right;
+    for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+        out << setw(14) << counts[c];
+    }
+    out << endl;
+}
+
+// one row per level, then per segment and per pid within the level
+static void printMissClasses(const map<MissClassKey, MissClassCounts>& classes, ostream& out) {
+    map<int, MissClassCounts> byLevel;
+    map<pair<int, int>, MissClassCounts> bySegment;
+    map<pair<int, uint32_t>, MissClassCounts> byPid;
+    for (const auto& entry : classes) {
+        const MissClassKey& key = entry.first;
+        MissClassCounts& level = byLevel.emplace(key.level, MissClassCounts()).first->second;
+        MissClassCounts& segment = bySegment.emplace(make_pair(key.level, int(key.segment)), MissClassCounts()).first->second;
+        MissClassCounts& pid = byPid.emplace(make_pair(key.level, key.process_id), MissClassCounts()).first->second;
+        for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+            level[c] += entry.second[c];
+            segment[c] += entry.second[c];
+            pid[c] += entry.second[c];
+        }
+    }
+    static const char* segmentNames[] = {"code", "heap", "stack"};
+    out << "Miss classes:" << string(17, ' ');
+    for (int c = 0; c < MISS_CLASS_COUNT; c++) {
+        out << setw(14) << miss_class_name(MissClass(c));
+    }
+    out << endl;
+    for (const auto& level : byLevel) {
+        string name = tlbLevelName(level.first);
+        printMissRow(name, level.second, out);
+        for (const auto& segment : bySegment) {
+            if (segment.first.first == level.first) {
+                printMissRow(name + " " + segmentNames[segment.first.second], segment.second, out);
+            }
+        }
+        for (const auto& pid : byPid) {
+            if (pid.first.first != level.first) {
+                continue;
+            }
+            uint32_t tag = pid.first.second;
+            string owner = tag & TLB_GLOBAL_TAG ? "code domain " + to_string(tag & ~TLB_GLOBAL_TAG)
+                                                : "pid " + to_string(tag);
+            printMissRow(name + " " + owner, pid.second, out);
+        }
+    }
+}
+
+void printStats(const SimStats& stats, ostream& out) {
+    out << "Total memory access attempts: " << stats.memory_access_attempts << endl;
+    out << "Code miss:    " << stats.code_miss << endl;
+    out << "Stack miss:   " << stats.stack_miss << endl;
+    out << "Heap miss:    " << stats.heap_miss << endl;
+    out << "TLB misses:   " << stats.TLB_miss << endl;
+    out << "TLB hit rate: " << stats.tlbHitRate() << endl;
+    out << "L1 hit rate:  " << stats.l1HitRate() << endl;
+    out << "L2 hit rate:  " << stats.l2HitRate() << endl;
+    if (stats.code_access > 0) {
+        out << "iTLB hit rate: " << stats.itlbHitRate() << endl;
+        out << "dTLB hit rate: " << stats.dtlbHitRate() << endl;
+    }
+    for (int k = 3; k <= TLB_MAX_LEVELS; k++) {
+        if (stats.level_hit[k] > 0) {
+            out << "L" << k << " hit rate:  " << stats.levelHitRate(k) << endl;
+        }
+    }
+    if (stats.victim_hit > 0) {
+        out << "Victim hits:  " << stats.victim_hit << endl;
+    }
+    long long walks = 0;
+    for (int k = 0; k <= CACHE_MAX_LEVELS; k++) {
+        walks += stats.walk_served[k];
+    }
+    if (walks > 0) {
+        printServed("Page walks served by:", stats.walk_served, out);
+        printServed("Walk references served by:", stats.walk_ref_served, out);
+        printServed("Data accesses served by:", stats.data_served, out);
+    }
+    if (stats.numa_local + stats.numa_remote > 0) {
+        out << "NUMA local accesses:  " << stats.numa_local << endl;
+        out << "NUMA remote accesses: " << stats.numa_remote << endl;
+        out << "Memory time (ns):     " << stats.walk_memory_ns + stats.data_memory_ns << " (walks "
+            << stats.walk_memory_ns << ", data " << stats.data_memory_ns << ")" << endl;
+    }
+    for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+        if (stats.replacement_ops[p] > 0) {
+            out << "Replacement ops (" << tlb_policy_name(TlbPolicy(p)) << "): " << stats.replacement_ops[p] << " ("
+                << 1.0 * stats.replacement_ops[p] / stats.memory_access_attempts << " per access)" << endl;
+        }
+    }
+    if (stats.ship_dead_fills > 0) {
+        out << "SHiP dead-on-arrival fills: " << stats.ship_dead_fills << endl;
+    }
+    if (stats.timing_accesses > 0) {
+        out << "Translation cycles:   " << stats.timing_cycles << " (blocking walks: " << stats.timing_blocking_cycles
+            << ")" << endl;
+        out << "Page walks:           " << stats.timing_walks << ", merged misses " << stats.timing_merged << endl;
+        out << "Walk concurrency:     " << stats.walkConcurrency() << " (max " << stats.timing_max_walks << ")" << endl;
+        out << "Stall cycles:         window " << stats.timing_window_stall << ", miss-status table "
+            << stats.timing_mshr_stall << endl;
+    }
+    if (!stats.miss_classes.empty()) {
+        printMissClasses(stats.miss_classes, out);
+    }
+}
@@ -0,0 +1,83 @@
+// stats.h
+#ifndef STATS_H
+#define STATS_H
+
+#include <iostream>
+#include "tlb-level.h"
+#include "tlb-miss.h"
+#include "cache.h"
+#include "numa.h"
+#include "timing.h"
+
+using namespace std;
+
+/**
+ * Snapshot of the simulation counters.
+ * The counters themselves are thread_local globals owned by os.cpp, tlb.cpp and page-table.cpp,
+ * so every simulation thread counts on its own and the results are merged through SimStats.
+ */
+struct SimStats {
+    long long memory_access_attempts = 0;
+    long long code_miss = 0;
+    long long stack_miss = 0;
+    long long heap_miss = 0;
+    long long TLB_miss = 0;
+    long long L1_hit = 0;
+    long long code_access = 0;      // with a split l1: code accesses and the iTLB's share of L1_hit
+    long long itlb_hit = 0;
+    long long L2_hit = 0;
+    long long victim_hit = 0;
+    long long level_hit[TLB_MAX_LEVELS + 1] = {};   // levels 3 and below, by level
+    long long memory_hit = 0;
+    // by the data cache level that served them, CACHE_MEMORY for memory (all zero without a cache model)
+    long long walk_served[CACHE_MAX_LEVELS + 1] = {};
+    long long walk_ref_served[CACHE_MAX_LEVELS + 1] = {};
+    long long data_served[CACHE_MAX_LEVELS + 1] = {};
+    // NUMA accounting (all zero with a single node)
+    long long numa_local = 0;
+    long long numa_remote = 0;
+    long long walk_memory_ns = 0;
+    long long data_memory_ns = 0;
+    // adaptive replacement work, by TlbPolicy (all zero with the base policies)
+    long long replacement_ops[TLB_POLICY_COUNT] = {};
+    long long ship_dead_fills = 0;
+    // translation timing (all zero unless os::setTiming turned it on)
+    long long timing_accesses = 0;
+    long long timing_cycles = 0;
+    long long timing_blocking_cycles = 0;
+    long long timing_walks = 0;
+    long long timing_merged = 0;
+    long long timing_walk_cycles = 0;
+    long long timing_walk_busy_cycles = 0;
+    long long timing_max_walks = 0;     // a maximum: add keeps the larger one, subtract leaves it
+    long long timing_window_stall = 0;
+    long long timing_mshr_stall = 0;
+    // misses by level, pid and segment, broken down by class (empty unless classification is on)
+    map<MissClassKey, MissClassCounts> miss_classes;
+
+    void add(const SimStats& other);
+    void subtract(const SimStats& other);
+    double tlbHitRate() const;
+    double l1HitRate() const;
+    double itlbHitRate() const;
+    double dtlbHitRate() const;
+    // hits of a level over the lookups that reached it (level >= 2)
+    double levelHitRate(int level) const;
+    double l2HitRate() const;
+    // average walks in flight while any was
+    double walkConcurrency() const;
+};
+
+// copy the counters of the calling thread
+SimStats collectStats();
+
+// zero the counters of the calling thread
+void resetStats();
+
+// add stats to the counters of the calling thread, e.g. what a helper thread counted before it exited
+void addStats(const SimStats& stats);
+
+// print the end-of-run report (the format is parsed by plot.py and plot_final.py)
+void printStats(const SimStats& stats, ostream& out = cout);
+
+#endif // STATS_H
@@ -5,8 +5,9 @@ from io import TextIOWrapper
 import numpy as np
 import argparse
 '''
-Usage: python test_generator.py <num_tests> <process list>
+Usage: python test_generator.py [--va-bits 32|48|57] <num_tests> <process list>
 E.g.: python3 test_generator.py 10000 0.5:1024 0.6:102400 0.95:`expr 1024 \\* 1024 \\* 1024`
+With --va-bits 48 or 57 the stack sits at the top of the lower half of the address space, as in the simulator
 For each process, two parameters are needed to be specified: locality and max memory
 
 For each process, it could be
@@ -208,8 +209,12 @@ def main() -> None:
     parser = argparse.ArgumentParser()
     parser.add_argument('num_tests', type = int, help='Num of tests generated')
     parser.add_argument('process_configs', nargs='+', type=parse_process_params)
+    parser.add_argument('--va-bits', type=int, choices=[32, 48, 57], default=32, help='Virtual address width')
 
     args = parser.parse_args()
+    global MAX_ADDR, MIN_STACK_ADDR
+    MAX_ADDR = (1 << (32 if args.va_bits == 32 else args.va_bits - 1)) - 1
+    MIN_STACK_ADDR = MAX_ADDR - 4 * 1024 * 1024
     num_tests = args.num_tests
     process_configs = args.process_configs
     processes = []
@@ -0,0 +1,167 @@
+#include "timing.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+thread_local long long Timing_accesses = 0;
+thread_local long long Timing_cycles = 0;
+thread_local long long Timing_blocking_cycles = 0;
+thread_local long long Timing_walks = 0;
+thread_local long long Timing_merged = 0;
+thread_local long long Timing_walk_cycles = 0;
+thread_local long long Timing_walk_busy_cycles = 0;
+thread_local int Timing_max_walks = 0;
+thread_local long long Timing_window_stall = 0;
+thread_local long long Timing_mshr_stall = 0;
+
+static vector<uint32_t> parseCounts(const string& text, char separator, size_t most) {
+    vector<uint32_t> ret;
+    stringstream ss(text);
+    string field;
+    while (getline(ss, field, separator)) {
+        size_t end = 0;
+        unsigned long value;
+        try {
+            value = stoul(field, &end);
+        } catch (const exception&) {
+            throw invalid_argument("bad number " + field);
+        }
+        if (end != field.size()) {
+            throw invalid_argument("bad number " + field);
+        }
+        ret.push_back(value);
+    }
+    if (ret.empty() || ret.size() > most) {
+        throw invalid_argument("expected at most " + to_string(most) + " numbers");
+    }
+    return ret;
+}
+
+void parseTimingSpec(const string& spec, TimingConfig& config) {
+    vector<uint32_t> values = parseCounts(spec, ':', 3);
+    config.width = values[0];
+    if (values.size() > 1) {
+        config.walkers = values[1];
+    }
+    if (values.size() > 2) {
+        config.mshrs = values[2];
+    }
+    if (config.width == 0 || config.walkers == 0 || config.mshrs == 0) {
+        throw invalid_argument("width, walkers and miss-status entries must be positive");
+    }
+}
+
+void parseTimingCycles(const string& list, TimingConfig& config) {
+    vector<uint32_t> values = parseCounts(list, ',', 4);
+    if (values.size() != 4) {
+        throw invalid_argument("expected hit,lower,cache,memory cycles");
+    }
+    config.hitCycles = values[0];
+    config.lowerHitCycles = values[1];
+    config.cacheCycles = values[2];
+    config.memoryCycles = values[3];
+}
+
+TranslationTimer::TranslationTimer() : cycle(0), lastRetire(0), lastDone(0), walkBusyUntil(0) {}
+
+void TranslationTimer::configure(const TimingConfig& config) {
+    settings = config;
+    cycle = 0;
+    lastRetire = 0;
+    lastDone = 0;
+    window.clear();
+    pending.clear();
+    walkerFree.assign(config.walkers, 0);
+    walkBusyUntil = 0;
+}
+
+bool TranslationTimer::enabled() const {
+    return settings.width > 0;
+}
+
+const TimingConfig& TranslationTimer::config() const {
+    return settings;
+}
+
+void TranslationTimer::expire(uint64_t now) {
+    for (auto it = pending.begin(); it != pending.end();) {
+        if (it->second <= now) {
+            it = pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+uint64_t TranslationTimer::startWalk(const Page& page, uint64_t now, uint64_t walkCycles) {
+    size_t walker = min_element(walkerFree.begin(), walkerFree.end()) - walkerFree.begin();
+    uint64_t start = max(now, walkerFree[walker]);
+    uint64_t end = start + walkCycles;
+    int inFlight = 1;
+    for (size_t w = 0; w < walkerFree.size(); w++) {
+        if (w != walker && walkerFree[w] > start) {
+            inFlight++;
+        }
+    }
+    Timing_max_walks = max(Timing_max_walks, inFlight);
+    walkerFree[walker] = end;
+    // walks start in cycle order (both the issue cycle and the earliest free walker only move forward),
+    // so the cycles with a walk in flight add up from the end of the last busy stretch
+    Timing_walk_busy_cycles += end - max(start, min(end, walkBusyUntil));
+    walkBusyUntil = max(walkBusyUntil, end);
+    Timing_walks++;
+    Timing_walk_cycles += walkCycles;
+    pending[page] = end;
+    return end;
+}
+
+void TranslationTimer::access(uint32_t tag, uint64_t vpn, Kind kind, uint64_t walkCycles) {
+    Page page(tag, vpn);
+    Timing_accesses++;
+    uint64_t now = cycle;
+    // a full window issues again when its oldest access retires
+    if (window.size() >= settings.width) {
+        lastRetire = max(lastRetire, window.front());
+        window.pop_front();
+        if (lastRetire > now) {
+            Timing_window_stall += lastRetire - now;
+            now = lastRetire;
+        }
+    }
+    expire(now);
+
+    uint64_t done;
+    auto it = pending.find(page);
+    if (it != pending.end()) {
+        // the functional simulation already filled the TLB, but the walk has not finished
+        Timing_merged++;
+        done = it->second;
+    } else if (kind == L1_HIT) {
+        done = now + settings.hitCycles;
+    } else if (kind == LOWER_HIT) {
+        done = now + settings.lowerHitCycles;
+    } else {
+        if (pending.size() >= settings.mshrs) {
+            uint64_t first = pending.begin()->second;
+            for (const auto& entry : pending) {
+                first = min(first, entry.second);
+            }
+            Timing_mshr_stall += first - now;
+            now = first;
+            expire(now);
+        }
+        done = startWalk(page, now + settings.lowerHitCycles, walkCycles);
+    }
+
+    switch (kind) {
+        case L1_HIT: Timing_blocking_cycles += settings.hitCycles; break;
+        case LOWER_HIT: Timing_blocking_cycles += settings.lowerHitCycles; break;
+        default: Timing_blocking_cycles += settings.lowerHitCycles + walkCycles; break;
+    }
+    window.push_back(done);
+    if (done > lastDone) {
+        Timing_cycles += done - lastDone;
+        lastDone = done;
+    }
+    cycle = now + 1;
+}
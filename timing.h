@@ -0,0 +1,84 @@
+// timing.h
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// thread_local counters of the timing model, all zero when it is off
+extern thread_local long long Timing_accesses;
+extern thread_local long long Timing_cycles;           // until the last access completed
+extern thread_local long long Timing_blocking_cycles;  // the same accesses with every miss handled before the next
+extern thread_local long long Timing_walks;
+extern thread_local long long Timing_merged;           // misses that joined a walk already in flight
+extern thread_local long long Timing_walk_cycles;      // summed over walks
+extern thread_local long long Timing_walk_busy_cycles; // cycles with at least one walk in flight
+extern thread_local int Timing_max_walks;              // most walks in flight at once
+extern thread_local long long Timing_window_stall;     // issue cycles lost to a full window
+extern thread_local long long Timing_mshr_stall;       // ... to a full miss-status table
+
+struct TimingConfig {
+    uint32_t width = 0;            // accesses in flight (the window), 0: timing off
+    uint32_t walkers = 1;          // concurrent page walks
+    uint32_t mshrs = 8;            // miss-status entries, distinct pages with a walk pending
+    uint32_t hitCycles = 1;        // l1 (or victim buffer) hit
+    uint32_t lowerHitCycles = 8;   // hit below l1, also the time to find out that every level missed
+    uint32_t cacheCycles = 20;     // walk reference served by a data cache
+    uint32_t memoryCycles = 200;   // walk reference served by memory
+};
+
+// "width[:walkers[:mshrs]]", e.g. "32:2:8"; throws invalid_argument on a malformed spec
+void parseTimingSpec(const string& spec, TimingConfig& config);
+// "hit,lower,cache,memory" cycles; throws invalid_argument on a malformed list
+void parseTimingCycles(const string& list, TimingConfig& config);
+
+/**
+ * Event-driven timing of address translation for an out-of-order core, kept next to the functional
+ * simulation: the os still resolves every access in order, and tells the model how each one was translated.
+ * Accesses issue one per cycle into a window of width entries and retire in order, so an access
+ * cannot issue before the one width places earlier has retired. A walk needs a miss-status entry
+ * for its page and a free walker; a miss (or a hit on an entry whose walk has not finished yet)
+ * to a page with a walk in flight merges into that walk instead.
+ */
+class TranslationTimer {
+public:
+    enum Kind { L1_HIT, LOWER_HIT, WALK };
+
+    TranslationTimer();
+
+    void configure(const TimingConfig& config);
+    bool enabled() const;
+    const TimingConfig& config() const;
+
+    // one access to the page of TLB tag tag starting at vpn, walkCycles only for a walk
+    void access(uint32_t tag, uint64_t vpn, Kind kind, uint64_t walkCycles);
+
+private:
+    typedef pair<uint32_t, uint64_t> Page;   // (tag, vpn), walks are tracked per TLB entry
+    struct PageHash {
+        size_t operator()(const Page& p) const {
+            return (uint64_t(p.first) << 32) ^ p.second;
+        }
+    };
+
+    TimingConfig settings;
+    uint64_t cycle;                            // earliest issue cycle of the next access
+    uint64_t lastRetire;
+    uint64_t lastDone;                         // latest completion so far
+    deque<uint64_t> window;                    // completion cycles, oldest access first
+    unordered_map<Page, uint64_t, PageHash> pending; // page -> cycle its walk completes (the miss-status table)
+    vector<uint64_t> walkerFree;               // cycle each walker is done
+    uint64_t walkBusyUntil;
+
+    // drop the walks done by cycle now from the miss-status table
+    void expire(uint64_t now);
+    uint64_t startWalk(const Page& page, uint64_t now, uint64_t walkCycles);
+};
+
+#endif // TIMING_H
@@ -0,0 +1,346 @@
+#include "tlb-l2.h"
+#include "tlb.h"
+#include <algorithm>
+
+SharedL2::SharedL2(uint32_t capacity) : capacity(capacity), used(0), slots(capacity), ghead(NIL), gtail(NIL),
+  partitioning(false), interval(100000), total_lookups(0), since_repartition(0) {
+  for (uint32_t i = capacity; i > 0; i--) {
+    free_slots.push_back(i - 1);
+  }
+}
+
+SharedL2::Tenant& SharedL2::tenant(uint32_t process_id) {
+  auto iter = tenants.find(process_id);
+  if (iter == tenants.end()) {
+    iter = tenants.emplace(process_id, Tenant()).first;
+    iter->second.utility.assign(CHUNKS, 0);
+    // a newcomer gets an even share until the next repartition
+    iter->second.quota = capacity / tenants.size();
+  }
+  return iter->second;
+}
+
+// link idx at the MRU end of both lists
+void SharedL2::link(uint32_t idx) {
+  Slot& s = slots[idx];
+  Tenant& t = tenants[s.pid];
+  s.prev = NIL;
+  s.next = t.head;
+  if (t.head != NIL) {
+    slots[t.head].prev = idx;
+  } else {
+    t.tail = idx;
+  }
+  t.head = idx;
+
+  s.gprev = NIL;
+  s.gnext = ghead;
+  if (ghead != NIL) {
+    slots[ghead].gprev = idx;
+  } else {
+    gtail = idx;
+  }
+  ghead = idx;
+}
+
+void SharedL2::unlink(uint32_t idx) {
+  Slot& s = slots[idx];
+  Tenant& t = tenants[s.pid];
+  if (s.prev != NIL) {
+    slots[s.prev].next = s.next;
+  } else {
+    t.head = s.next;
+  }
+  if (s.next != NIL) {
+    slots[s.next].prev = s.prev;
+  } else {
+    t.tail = s.prev;
+  }
+
+  if (s.gprev != NIL) {
+    slots[s.gprev].gnext = s.gnext;
+  } else {
+    ghead = s.gnext;
+  }
+  if (s.gnext != NIL) {
+    slots[s.gnext].gprev = s.gprev;
+  } else {
+    gtail = s.gprev;
+  }
+}
+
+void SharedL2::touch(uint32_t idx) {
+  if (ghead == idx) {
+    return;
+  }
+  unlink(idx);
+  link(idx);
+}
+
+void SharedL2::remove(uint32_t idx) {
+  Slot& s = slots[idx];
+  unlink(idx);
+  index.erase(Key{s.pid, s.page_size, s.vpn});
+  Tenant& t = tenants[s.pid];
+  t.occupancy--;
+  auto size_count = t.page_sizes.find(s.page_size);
+  if (--size_count->second == 0) {
+    t.page_sizes.erase(size_count);
+  }
+  free_slots.push_back(idx);
+  used--;
+}
+
+bool SharedL2::look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) {
+  total_lookups++;
+  Tenant& t = tenant(process_id);
+  t.interval_accesses++;
+  if (partitioning && ++since_repartition >= interval) {
+    repartition();
+  }
+
+  // probe once per page size this pid has in l2
+  for (const auto& size_count : t.page_sizes) {
+    uint32_t page_size = size_count.first;
+    uint64_t vpn = (virtual_addr & ~(uint64_t(page_size) - 1)) >> 12;
+    auto iter = index.find(Key{process_id, page_size, vpn});
+    if (iter != index.end()) {
+      uint32_t idx = iter->second;
+      Slot& s = slots[idx];
+      s.frequency++;
+      touch(idx);
+      t.hits++;
+      if (partitioning) {
+        umon_record(t, page_size, vpn);
+      }
+      found = TlbEntry(s.pid, s.page_size, s.vpn, s.pfn);
+      found.frequency = s.frequency;
+      return true;
+    }
+  }
+  t.misses++;
+  return false;
+}
+
+TlbLevel* SharedL2::clone() const {
+  return new SharedL2(*this);
+}
+
+bool SharedL2::insert(const TlbEntry& entry, TlbEntry& evicted) {
+  Key key{entry.process_id, entry.page_size, entry.vpn};
+  auto iter = index.find(key);
+  if (iter != index.end()) {
+    slots[iter->second].pfn = entry.pfn;
+    touch(iter->second);
+    return false;
+  }
+
+  Tenant& t = tenant(entry.process_id);
+  if (partitioning) {
+    // the miss that caused this fill is an access the shadow tags must see
+    umon_record(t, entry.page_size, entry.vpn);
+  }
+  bool replaced = free_slots.empty();
+  if (replaced) {
+    uint32_t victim = select_victim(entry.process_id);
+    const Slot& v = slots[victim];
+    evicted = TlbEntry(v.pid, v.page_size, v.vpn, v.pfn);
+    evicted.frequency = v.frequency;
+    remove(victim);
+  }
+  uint32_t idx = free_slots.back();
+  free_slots.pop_back();
+  Slot& s = slots[idx];
+  s.pid = entry.process_id;
+  s.page_size = entry.page_size;
+  s.vpn = entry.vpn;
+  s.pfn = entry.pfn;
+  s.frequency = entry.frequency;
+  link(idx);
+  index[key] = idx;
+  t.occupancy++;
+  t.page_sizes[entry.page_size]++;
+  used++;
+  return replaced;
+}
+
+void SharedL2::remove(const TlbEntry& entry) {
+  auto iter = index.find(Key{entry.process_id, entry.page_size, entry.vpn});
+  if (iter != index.end()) {
+    remove(iter->second);
+  }
+}
+
+uint32_t SharedL2::select_victim(uint32_t process_id) {
+  if (!partitioning) {
+    return gtail;
+  }
+  Tenant& t = tenants[process_id];
+  if (t.occupancy >= t.quota && t.tail != NIL) {
+    // at its quota: replace its own LRU entry
+    return t.tail;
+  }
+  // under its quota: take the least recently used entry of a pid that is over its quota
+  for (uint32_t idx = gtail; idx != NIL; idx = slots[idx].gprev) {
+    const Tenant& owner = tenants[slots[idx].pid];
+    if (owner.occupancy > owner.quota) {
+      return idx;
+    }
+  }
+  return t.tail != NIL ? t.tail : gtail;
+}
+
+void SharedL2::invalidate(uint32_t process_id, uint64_t vpn) {
+  auto t = tenants.find(process_id);
+  if (t == tenants.end()) {
+    return;
+  }
+  // the vpn identifies the page whatever its size, check each size the pid uses
+  vector<uint32_t> sizes;
+  for (const auto& size_count : t->second.page_sizes) {
+    sizes.push_back(size_count.first);
+  }
+  for (uint32_t page_size : sizes) {
+    auto iter = index.find(Key{process_id, page_size, vpn});
+    if (iter != index.end()) {
+      remove(iter->second);
+    }
+  }
+}
+
+void SharedL2::flush_process(uint32_t process_id) {
+  auto t = tenants.find(process_id);
+  if (t == tenants.end()) {
+    return;
+  }
+  while (t->second.head != NIL) {
+    remove(t->second.head);
+  }
+  tenants.erase(t);
+}
+
+void SharedL2::set_partitioning(bool enabled, uint32_t interval_given) {
+  partitioning = enabled;
+  interval = interval_given == 0 ? 1 : interval_given;
+  since_repartition = 0;
+  for (auto& t : tenants) {
+    t.second.quota = capacity / tenants.size();
+  }
+}
+
+uint32_t SharedL2::occupancy(uint32_t process_id) const {
+  auto t = tenants.find(process_id);
+  return t == tenants.end() ? 0 : t->second.occupancy;
+}
+
+// UMON: LRU stack of sampled tags, a hit at depth d means the pid needs about d * UMON_SAMPLE entries
+void SharedL2::umon_record(Tenant& t, uint32_t page_size, uint64_t vpn) {
+  // vpn rotated by a word: the same tags as a plain (vpn << 32) | page_size for 32-bit vpns
+  uint64_t tag = ((vpn << 32) | (vpn >> 32)) ^ page_size;
+  if ((tag * 0x9E3779B97F4A7C15ULL >> 61) != 0) {
+    return;   // not sampled (keeps 1 in 8)
+  }
+  auto pos = find(t.shadow.begin(), t.shadow.end(), tag);
+  if (pos != t.shadow.end()) {
+    uint32_t depth = pos - t.shadow.begin();
+    uint32_t chunk_size = max<uint32_t>(1, capacity / CHUNKS);
+    uint32_t chunk = min<uint32_t>(CHUNKS - 1, depth * UMON_SAMPLE / chunk_size);
+    t.utility[chunk]++;
+    t.shadow.erase(pos);
+  } else if (t.shadow.size() >= capacity / UMON_SAMPLE) {
+    t.shadow.pop_back();
+  }
+  t.shadow.insert(t.shadow.begin(), tag);
+}
+
+// lookahead partitioning (Qureshi & Patt, UCP): hand out chunks to the pid with the best
+// marginal utility per chunk, looking ahead over every possible grant size
+void SharedL2::repartition() {
+  since_repartition = 0;
+  uint32_t chunk_size = max<uint32_t>(1, capacity / CHUNKS);
+  uint32_t chunks = capacity / chunk_size;
+
+  vector<uint32_t> active;
+  for (auto& t : tenants) {
+    if (t.second.interval_accesses > 0) {
+      active.push_back(t.first);
+    }
+  }
+  sort(active.begin(), active.end());
+
+  map<uint32_t, uint32_t> alloc;
+  uint32_t balance = chunks;
+  if (active.size() <= chunks) {
+    for (uint32_t pid : active) {
+      alloc[pid] = 1;
+    }
+    balance -= active.size();
+  }
+
+  while (balance > 0 && !active.empty()) {
+    uint32_t best_pid = active[0];
+    uint32_t best_k = 0;
+    double best_mu = 0;
+    for (uint32_t pid : active) {
+      const vector<uint32_t>& u = tenants[pid].utility;
+      uint32_t a = alloc[pid];
+      long long gain = 0;
+      for (uint32_t k = 1; k <= balance && a + k <= chunks; k++) {
+        gain += u[a + k - 1];
+        double mu = 1.0 * gain / k;
+        if (mu > best_mu) {
+          best_mu = mu;
+          best_pid = pid;
+          best_k = k;
+        }
+      }
+    }
+    if (best_k == 0) {
+      // nobody gains from more entries, spread the rest evenly
+      for (uint32_t i = 0; balance > 0; i = (i + 1) % active.size(), balance--) {
+        alloc[active[i]]++;
+      }
+      break;
+    }
+    alloc[best_pid] += best_k;
+    balance -= best_k;
+  }
+
+  for (auto t = tenants.begin(); t != tenants.end();) {
+    if (t->second.occupancy == 0 && t->second.interval_accesses == 0) {
+      // idle and holding nothing, forget it
+      t = tenants.erase(t);
+      continue;
+    }
+    auto a = alloc.find(t->first);
+    t->second.quota = a == alloc.end() ? 0 : a->second * chunk_size;
+    t->second.interval_accesses = 0;
+    // age the counters so the partition follows phase changes
+    for (auto& hits : t->second.utility) {
+      hits /= 2;
+    }
+    ++t;
+  }
+}
+
+void SharedL2::print_occupancy(ostream& out, uint32_t max_rows) const {
+  vector<pair<uint32_t, uint32_t> > rows;   // occupancy, pid
+  for (const auto& t : tenants) {
+    rows.push_back(make_pair(t.second.occupancy, t.first));
+  }
+  sort(rows.rbegin(), rows.rend());
+  out << "L2 occupancy:  " << used << " / " << capacity << " entries, " << tenants.size() << " pids"
+      << (partitioning ? " (utility partitioned)" : " (shared LRU)") << endl;
+  for (uint32_t i = 0; i < rows.size() && i < max_rows; i++) {
+    const Tenant& t = tenants.at(rows[i].second);
+    long long accesses = t.hits + t.misses;
+    out << "  pid " << rows[i].second << ": " << t.occupancy << " entries";
+    if (partitioning) {
+      out << ", quota " << t.quota;
+    }
+    out << ", L2 hit rate " << (accesses == 0 ? 0.0 : 1.0 * t.hits / accesses) << endl;
+  }
+  if (rows.size() > max_rows) {
+    out << "  ... " << rows.size() - max_rows << " more pids" << endl;
+  }
+}
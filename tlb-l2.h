@@ -0,0 +1,111 @@
+// tlb-l2.h
+#ifndef TLB_L2_H
+#define TLB_L2_H
+
+#include <stdint.h>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include "tlb-level.h"
+
+using namespace std;
+
+/**
+ * Shared, ASID-tagged, fully-associative LRU TLB level (the default l2).
+ * All processes share the l2_size entries; every entry is tagged with its pid, so nothing is
+ * flushed when a new process shows up. Lookups go through a (pid, page size, vpn) hash index and
+ * probe only the page sizes the process currently has in l2. Replacement is LRU.
+ *
+ * Optional utility-based partitioning (UCP): each pid keeps sampled shadow tags (UMON) that count
+ * hits per LRU stack depth, i.e. how many more hits it would get with more entries. Every
+ * `interval` l2 lookups the capacity is re-divided in chunks with the lookahead algorithm.
+ * A pid under its quota evicts from pids over theirs; a pid at its quota evicts its own LRU.
+ */
+class SharedL2 : public TlbLevel {
+public:
+  SharedL2(uint32_t capacity);
+
+  TlbLevel* clone() const override;
+  bool look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) override;
+  bool insert(const TlbEntry& entry, TlbEntry& evicted) override;
+  void remove(const TlbEntry& entry) override;
+  void invalidate(uint32_t process_id, uint64_t vpn) override;
+  void flush_process(uint32_t process_id) override;
+
+  void set_partitioning(bool enabled, uint32_t interval);
+  bool partitioned() const { return partitioning; }
+
+  long long lookups() const { return total_lookups; }
+  uint32_t size() const { return used; }
+  uint32_t occupancy(uint32_t process_id) const;
+
+  // per-pid occupancy, quota and hit rate, largest tenants first
+  void print_occupancy(ostream& out, uint32_t max_rows = 16) const;
+
+private:
+  static const uint32_t NIL = 0xFFFFFFFF;
+  static const uint32_t UMON_SAMPLE = 8;     // one shadow tag per 8 tags
+  static const uint32_t CHUNKS = 64;         // allocation granularity of the partitioner
+
+  struct Key {
+    uint32_t pid;
+    uint32_t page_size;
+    uint64_t vpn;
+    bool operator==(const Key& other) const {
+      return pid == other.pid && page_size == other.page_size && vpn == other.vpn;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const {
+      uint64_t h = (uint64_t(k.pid) << 32) ^ (uint64_t(k.page_size) << 20) ^ k.vpn;
+      return h * 0x9E3779B97F4A7C15ULL >> 16;
+    }
+  };
+
+  struct Slot {
+    uint32_t pid;
+    uint32_t page_size;
+    uint64_t vpn;
+    uint32_t pfn;
+    uint32_t frequency;
+    uint32_t prev, next;     // the pid's own LRU list
+    uint32_t gprev, gnext;   // global LRU list
+  };
+
+  struct Tenant {
+    uint32_t head = NIL, tail = NIL;  // head is MRU
+    uint32_t occupancy = 0;
+    uint32_t quota = 0;
+    long long hits = 0;
+    long long misses = 0;
+    long long interval_accesses = 0;
+    map<uint32_t, uint32_t> page_sizes;   // page size -> entries of that size
+    vector<uint64_t> shadow;              // sampled UMON tags, MRU first
+    vector<uint32_t> utility;             // UMON hits per stack-depth chunk
+  };
+
+  uint32_t capacity;
+  uint32_t used;
+  vector<Slot> slots;
+  vector<uint32_t> free_slots;
+  uint32_t ghead, gtail;
+  unordered_map<Key, uint32_t, KeyHash> index;
+  unordered_map<uint32_t, Tenant> tenants;
+
+  bool partitioning;
+  uint32_t interval;
+  long long total_lookups;
+  long long since_repartition;
+
+  Tenant& tenant(uint32_t process_id);
+  void touch(uint32_t idx);
+  void link(uint32_t idx);
+  void unlink(uint32_t idx);
+  void remove(uint32_t idx);
+  uint32_t select_victim(uint32_t process_id);
+  void umon_record(Tenant& t, uint32_t page_size, uint64_t vpn);
+  void repartition();
+};
+
+#endif // TLB_L2_H
@@ -0,0 +1,281 @@
+#include "tlb-level.h"
+#include "tlb.h"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+const char* tlb_inclusion_name(TlbInclusion inclusion) {
+  switch (inclusion) {
+    case TLB_INCLUSIVE: return "inclusive";
+    case TLB_EXCLUSIVE: return "exclusive";
+    default: return "nine";
+  }
+}
+
+bool parse_tlb_inclusion(const string& name, TlbInclusion& inclusion) {
+  for (TlbInclusion i : {TLB_INCLUSIVE, TLB_EXCLUSIVE, TLB_NINE}) {
+    if (name == tlb_inclusion_name(i)) {
+      inclusion = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t parse_count(const string& text, const string& what) {
+  char* end;
+  unsigned long value = strtoul(text.c_str(), &end, 10);
+  if (text.empty() || *end != '\0') {
+    throw invalid_argument("bad " + what + ": " + text);
+  }
+  return value;
+}
+
+static TlbLevelConfig make_level(const vector<string>& fields) {
+  if (fields.empty() || fields.size() > 4) {
+    throw invalid_argument("expected entries[:ways[:policy[:inclusion]]]");
+  }
+  TlbLevelConfig config{0, 0, TLB_LRU, TLB_NINE};
+  config.entries = parse_count(fields[0], "entries");
+  if (fields.size() > 1 && fields[1] != "full") {
+    config.ways = parse_count(fields[1], "ways");
+  }
+  if (fields.size() > 2 && !parse_tlb_policy(fields[2], config.policy)) {
+    throw invalid_argument("bad policy: " + fields[2]);
+  }
+  if (fields.size() > 3 && !parse_tlb_inclusion(fields[3], config.inclusion)) {
+    throw invalid_argument("bad inclusion: " + fields[3]);
+  }
+  if (config.entries == 0 || (config.ways != 0 && config.entries % config.ways != 0)) {
+    throw invalid_argument("entries must be a non-zero multiple of ways");
+  }
+  return config;
+}
+
+TlbLevelConfig parse_tlb_level(const string& spec) {
+  vector<string> fields;
+  stringstream ss(spec);
+  string field;
+  while (getline(ss, field, ':')) {
+    fields.push_back(field);
+  }
+  return make_level(fields);
+}
+
+string tlb_level_spec(const TlbLevelConfig& config) {
+  return to_string(config.entries) + ":" + (config.ways == 0 ? string("full") : to_string(config.ways)) + ":"
+         + tlb_policy_name(config.policy) + ":" + tlb_inclusion_name(config.inclusion);
+}
+
+TlbHierarchyConfig parse_tlb_config(istream& in) {
+  TlbHierarchyConfig config;
+  bool have_l1 = false;
+  string line;
+  for (int number = 1; getline(in, line); number++) {
+    line = line.substr(0, line.find('#'));
+    istringstream iss(line);
+    vector<string> fields;
+    string field;
+    while (iss >> field) {
+      fields.push_back(field);
+    }
+    if (fields.empty()) {
+      continue;
+    }
+    try {
+      if (fields[0] == "victim") {
+        if (fields.size() != 2) {
+          throw invalid_argument("expected victim <entries>");
+        }
+        config.victim_size = parse_count(fields[1], "entries");
+        continue;
+      }
+      if (fields[0] == "itlb") {
+        if (fields.size() < 2 || fields.size() > 3) {
+          throw invalid_argument("expected itlb <entries> [policy]");
+        }
+        config.itlb_size = parse_count(fields[1], "entries");
+        if (fields.size() == 3 && !parse_tlb_policy(fields[2], config.itlb_policy)) {
+          throw invalid_argument("unknown policy " + fields[2]);
+        }
+        continue;
+      }
+      TlbLevelConfig level = make_level(fields);
+      if (!have_l1) {
+        if (level.ways != 0) {
+          throw invalid_argument("l1 is fully associative");
+        }
+        config.l1_size = level.entries;
+        config.l1_policy = level.policy;
+        have_l1 = true;
+      } else {
+        config.levels.push_back(level);
+      }
+    } catch (const invalid_argument& e) {
+      throw runtime_error("TLB config line " + to_string(number) + ": " + e.what());
+    }
+  }
+  if (!have_l1) {
+    throw runtime_error("TLB config has no levels");
+  }
+  if (config.levels.size() + 1 > TLB_MAX_LEVELS) {
+    throw runtime_error("TLB config has more than " + to_string(TLB_MAX_LEVELS) + " levels");
+  }
+  return config;
+}
+
+TlbHierarchyConfig load_tlb_config(const string& path) {
+  ifstream in(path);
+  if (!in) {
+    throw runtime_error("Unable to open file " + path);
+  }
+  return parse_tlb_config(in);
+}
+
+SetAssocTlb::SetAssocTlb(uint32_t entries, uint32_t ways_given, TlbPolicy policy)
+    : ways(ways_given == 0 ? entries : ways_given), policy(policy), clock(0),
+      replacement(policy, entries / ways, ways), adaptive(AdaptiveReplacement::is_adaptive(policy)) {
+  sets = entries / ways;
+  table.resize(size_t(sets) * ways);
+}
+
+TlbLevel* SetAssocTlb::clone() const {
+  return new SetAssocTlb(*this);
+}
+
+// the set comes from the virtual page number at the entry's own page size
+uint32_t SetAssocTlb::set_of(uint64_t vpn, uint32_t page_size) const {
+  return (vpn >> (__builtin_ctz(page_size) - 12)) % sets;
+}
+
+SetAssocTlb::Way* SetAssocTlb::find(uint32_t process_id, uint32_t page_size, uint64_t vpn) {
+  Way* set = &table[size_t(set_of(vpn, page_size)) * ways];
+  for (uint32_t w = 0; w < ways; w++) {
+    if (set[w].valid && set[w].pid == process_id && set[w].page_size == page_size && set[w].vpn == vpn) {
+      return &set[w];
+    }
+  }
+  return nullptr;
+}
+
+void SetAssocTlb::drop(Way& way) {
+  way.valid = false;
+  if (--page_sizes[way.page_size] == 0) {
+    page_sizes.erase(way.page_size);
+  }
+}
+
+bool SetAssocTlb::look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) {
+  for (const auto& size_count : page_sizes) {
+    uint32_t page_size = size_count.first;
+    Way* way = find(process_id, page_size, (virtual_addr & ~(uint64_t(page_size) - 1)) >> 12);
+    if (way != nullptr) {
+      way->frequency++;
+      if (policy == TLB_LRU) {
+        way->stamp = ++clock;
+      } else if (adaptive) {
+        replacement.on_hit(way->meta);
+      }
+      found = TlbEntry(way->pid, way->page_size, way->vpn, way->pfn);
+      found.frequency = way->frequency;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SetAssocTlb::insert(const TlbEntry& entry, TlbEntry& evicted) {
+  Way* way = find(entry.process_id, entry.page_size, entry.vpn);
+  if (way != nullptr) {
+    way->pfn = entry.pfn;
+    if (policy == TLB_LRU) {
+      way->stamp = ++clock;
+    } else if (adaptive) {
+      replacement.on_hit(way->meta);
+    }
+    return false;
+  }
+
+  uint32_t set_index = set_of(entry.vpn, entry.page_size);
+  Way* set = &table[size_t(set_index) * ways];
+  if (adaptive) {
+    replacement.on_miss(set_index, entry.process_id, entry.vpn, entry.page_size);
+  }
+  Way* target = nullptr;
+  for (uint32_t w = 0; w < ways && target == nullptr; w++) {
+    if (!set[w].valid) {
+      target = &set[w];
+    }
+  }
+  bool replaced = target == nullptr;
+  if (replaced) {
+    target = &set[0];
+    if (adaptive) {
+      target = adaptive_victim(set_index, set);
+    } else if (policy == TLB_RANDOM) {
+      target = &set[rand() % ways];
+    } else {
+      for (uint32_t w = 1; w < ways; w++) {
+        bool older = policy == TLB_LFU ? set[w].frequency < target->frequency : set[w].stamp < target->stamp;
+        if (older) {
+          target = &set[w];
+        }
+      }
+    }
+    evicted = TlbEntry(target->pid, target->page_size, target->vpn, target->pfn);
+    evicted.frequency = target->frequency;
+    drop(*target);
+  }
+
+  target->valid = true;
+  target->pid = entry.process_id;
+  target->page_size = entry.page_size;
+  target->vpn = entry.vpn;
+  target->pfn = entry.pfn;
+  target->frequency = entry.frequency;
+  target->stamp = ++clock;
+  if (adaptive) {
+    replacement.on_fill(set_index, target->meta);
+  }
+  page_sizes[entry.page_size]++;
+  return replaced;
+}
+
+SetAssocTlb::Way* SetAssocTlb::adaptive_victim(uint32_t set_index, Way* set) {
+  vector<ReplacementMeta*> metas(ways);
+  for (uint32_t w = 0; w < ways; w++) {
+    metas[w] = &set[w].meta;
+  }
+  Way* victim = &set[replacement.victim(set_index, metas)];
+  replacement.on_evict(set_index, victim->pid, victim->vpn, victim->page_size, victim->meta);
+  return victim;
+}
+
+void SetAssocTlb::remove(const TlbEntry& entry) {
+  Way* way = find(entry.process_id, entry.page_size, entry.vpn);
+  if (way != nullptr) {
+    drop(*way);
+  }
+}
+
+void SetAssocTlb::invalidate(uint32_t process_id, uint64_t vpn) {
+  vector<uint32_t> sizes;
+  for (const auto& size_count : page_sizes) {
+    sizes.push_back(size_count.first);
+  }
+  for (uint32_t page_size : sizes) {
+    Way* way = find(process_id, page_size, vpn);
+    if (way != nullptr) {
+      drop(*way);
+    }
+  }
+}
+
+void SetAssocTlb::flush_process(uint32_t process_id) {
+  for (auto& way : table) {
+    if (way.valid && way.pid == process_id) {
+      drop(way);
+    }
+  }
+}
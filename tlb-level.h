@@ -0,0 +1,122 @@
+// tlb-level.h
+#ifndef TLB_LEVEL_H
+#define TLB_LEVEL_H
+
+#include <stdint.h>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+#include "tlb-replacement.h"
+
+using namespace std;
+
+class TlbEntry;
+
+// l1 holds level 1; levels 2 to TLB_MAX_LEVELS sit below it
+static const int TLB_MAX_LEVELS = 8;
+
+// entries whose process_id has this bit are global: they belong to a fork family's shared code
+// rather than to one pid, and l1_flush keeps them
+static const uint32_t TLB_GLOBAL_TAG = 0x80000000u;
+
+// how a level relates to the levels above it
+//   inclusive: filled on every walk, its evictions are invalidated in the levels above
+//   exclusive: only holds what the level above evicts, a hit moves the entry up and out of it
+//   nine:      filled on every walk, evictions are not propagated (non-inclusive non-exclusive)
+enum TlbInclusion { TLB_INCLUSIVE, TLB_EXCLUSIVE, TLB_NINE };
+
+const char* tlb_inclusion_name(TlbInclusion inclusion);
+bool parse_tlb_inclusion(const string& name, TlbInclusion& inclusion);
+
+struct TlbLevelConfig {
+  uint32_t entries;
+  uint32_t ways;           // 0: fully associative
+  TlbPolicy policy;
+  TlbInclusion inclusion;
+};
+
+// "entries[:ways|full[:policy[:inclusion]]]", e.g. "1536:12:lru:inclusive"; defaults full, lru, nine.
+// throws invalid_argument on a malformed spec
+TlbLevelConfig parse_tlb_level(const string& spec);
+string tlb_level_spec(const TlbLevelConfig& config);
+
+// a whole hierarchy as read from a config file
+struct TlbHierarchyConfig {
+  uint32_t l1_size = 64;
+  TlbPolicy l1_policy = TLB_RANDOM;
+  uint32_t victim_size = 0;
+  uint32_t itlb_size = 0;          // 0: unified l1
+  TlbPolicy itlb_policy = TLB_RANDOM;
+  vector<TlbLevelConfig> levels;   // level 2 first
+};
+
+// one level per line from the top, "<entries> <ways|full> <policy> [inclusion]"; the first line is l1
+// (fully associative, inclusion ignored). "victim <entries>" adds a victim buffer, "itlb <entries> [policy]"
+// splits l1 so that the first line is the dTLB. # starts a comment.
+// throws runtime_error with the line number on malformed input
+TlbHierarchyConfig parse_tlb_config(istream& in);
+TlbHierarchyConfig load_tlb_config(const string& path);
+
+/**
+ * A TLB level below l1. Entries are tagged with the pid and may have any page size.
+ */
+class TlbLevel {
+public:
+  virtual ~TlbLevel() {}
+  virtual TlbLevel* clone() const = 0;
+
+  // find the entry translating virtual_addr for process_id and copy it to found, false if miss
+  virtual bool look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) = 0;
+  // insert (or refresh) an entry; if another entry had to make room, copy it to evicted and return true
+  virtual bool insert(const TlbEntry& entry, TlbEntry& evicted) = 0;
+  // drop the entry of this pid, page size and vpn if present
+  virtual void remove(const TlbEntry& entry) = 0;
+  // drop the page of this pid starting at vpn, whatever its size
+  virtual void invalidate(uint32_t process_id, uint64_t vpn) = 0;
+  virtual void flush_process(uint32_t process_id) = 0;
+};
+
+/**
+ * Set-associative level: entries / ways sets, indexed by the virtual page number at each page size.
+ * A lookup probes one set per page size currently held in the level.
+ */
+class SetAssocTlb : public TlbLevel {
+public:
+  SetAssocTlb(uint32_t entries, uint32_t ways, TlbPolicy policy);
+
+  TlbLevel* clone() const override;
+  bool look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) override;
+  bool insert(const TlbEntry& entry, TlbEntry& evicted) override;
+  void remove(const TlbEntry& entry) override;
+  void invalidate(uint32_t process_id, uint64_t vpn) override;
+  void flush_process(uint32_t process_id) override;
+
+private:
+  struct Way {
+    bool valid = false;
+    uint32_t pid;
+    uint32_t page_size;
+    uint64_t vpn;
+    uint32_t pfn;
+    uint32_t frequency;
+    uint64_t stamp;   // last use (lru) or fill (fifo)
+    ReplacementMeta meta;
+  };
+
+  uint32_t sets;
+  uint32_t ways;
+  TlbPolicy policy;
+  uint64_t clock;
+  vector<Way> table;                    // set s is table[s * ways, (s + 1) * ways)
+  map<uint32_t, uint32_t> page_sizes;   // page size -> entries of that size
+  AdaptiveReplacement replacement;      // state of arc, drrip and ship (unused by the base policies)
+  bool adaptive;
+
+  uint32_t set_of(uint64_t vpn, uint32_t page_size) const;
+  Way* find(uint32_t process_id, uint32_t page_size, uint64_t vpn);
+  Way* adaptive_victim(uint32_t set_index, Way* set);
+  void drop(Way& way);
+};
+
+#endif // TLB_LEVEL_H
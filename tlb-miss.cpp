@@ -0,0 +1,100 @@
+#include "tlb-miss.h"
+
+thread_local map<MissClassKey, MissClassCounts> Miss_classes;
+
+const char* miss_class_name(MissClass miss_class) {
+  switch (miss_class) {
+    case MISS_COMPULSORY: return "compulsory";
+    case MISS_CAPACITY: return "capacity";
+    case MISS_CONFLICT: return "conflict";
+    case MISS_FLUSH: return "flush";
+    default: return "invalidation";
+  }
+}
+
+TlbMissClassifier::TlbMissClassifier(const vector<uint32_t>& sizes) {
+  levels.resize(sizes.size());
+  for (size_t k = 0; k < sizes.size(); k++) {
+    levels[k].size = sizes[k];
+  }
+}
+
+TlbMissClassifier::Key TlbMissClassifier::key_of(uint32_t process_id, uint32_t page_size, uint64_t vpn) {
+  return Key((uint64_t(process_id) << 8) | __builtin_ctz(page_size), vpn);
+}
+
+TlbMissClassifier::Key TlbMissClassifier::page_of(uint32_t process_id, uint64_t vpn) {
+  return Key(uint64_t(process_id) << 8, vpn);
+}
+
+bool TlbMissClassifier::touch(Level& level, const Key& key) {
+  auto it = level.shadow.find(key);
+  bool found = it != level.shadow.end();
+  if (found) {
+    level.shadow_order.erase(it->second);
+  } else if (level.shadow.size() >= level.size) {
+    auto lru = level.shadow_order.begin();
+    level.shadow.erase(lru->second);
+    level.shadow_order.erase(lru);
+  }
+  level.shadow[key] = ++level.clock;
+  level.shadow_order[level.clock] = key;
+  return found;
+}
+
+void TlbMissClassifier::hit(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn) {
+  Level& l = levels[level];
+  if (l.size == 0) {
+    return;
+  }
+  Key key = key_of(process_id, page_size, vpn);
+  touch(l, key);
+  l.seen.insert(key);
+}
+
+void TlbMissClassifier::miss(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn) {
+  Level& l = levels[level];
+  if (l.size == 0) {
+    return;
+  }
+  Key key = key_of(process_id, page_size, vpn);
+  bool remapped = l.remapped.erase(page_of(process_id, vpn)) > 0;
+  bool compulsory = l.seen.insert(key).second || remapped;
+  bool invalidated = l.invalidated.erase(page_of(process_id, vpn)) > 0;
+  bool flushed = l.flushed.erase(key) > 0;
+  bool shadow_hit = touch(l, key);
+
+  MissClass miss_class;
+  if (compulsory) {
+    miss_class = MISS_COMPULSORY;
+  } else if (invalidated) {
+    miss_class = MISS_INVALIDATION;
+  } else if (!shadow_hit) {
+    miss_class = MISS_CAPACITY;
+  } else {
+    miss_class = flushed ? MISS_FLUSH : MISS_CONFLICT;
+  }
+  Miss_classes[MissClassKey{level, process_id, tlb_segment(vpn)}][miss_class]++;
+}
+
+void TlbMissClassifier::flushed(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn) {
+  if (levels[level].size > 0) {
+    levels[level].flushed.insert(key_of(process_id, page_size, vpn));
+  }
+}
+
+void TlbMissClassifier::invalidated(uint32_t process_id, uint64_t vpn) {
+  for (Level& l : levels) {
+    if (l.size > 0) {
+      l.invalidated.insert(page_of(process_id, vpn));
+    }
+  }
+}
+
+void TlbMissClassifier::remapped(uint32_t process_id, uint64_t vpn) {
+  for (Level& l : levels) {
+    if (l.size > 0) {
+      l.remapped.insert(page_of(process_id, vpn));
+    }
+  }
+}
@@ -0,0 +1,97 @@
+// tlb-miss.h
+#ifndef TLB_MISS_H
+#define TLB_MISS_H
+
+#include <stdint.h>
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "tlb-replacement.h"
+
+using namespace std;
+
+// why a TLB level missed
+//   compulsory:   first reference to the page at this level, or to a new translation of it: the page was freed,
+//                 migrated, copied on write, promoted or demoted since its last use
+//   invalidation: the page was swapped out since its last use
+//   flush:        a context switch flushed the entry, and a fully-associative lru of the same size would still hold it
+//   capacity:     that fully-associative lru misses too
+//   conflict:     it would hit, the level's own organisation and policy lost the entry
+enum MissClass { MISS_COMPULSORY, MISS_CAPACITY, MISS_CONFLICT, MISS_FLUSH, MISS_INVALIDATION, MISS_CLASS_COUNT };
+
+const char* miss_class_name(MissClass miss_class);
+
+// level 1 is l1 (the dTLB when l1 is split), 2 and up the lower levels, 0 the iTLB of a split l1
+struct MissClassKey {
+  int level;
+  uint32_t process_id;
+  TlbSegment segment;
+
+  bool operator<(const MissClassKey& other) const {
+    if (level != other.level) {
+      return level < other.level;
+    }
+    if (process_id != other.process_id) {
+      return process_id < other.process_id;
+    }
+    return segment < other.segment;
+  }
+};
+
+typedef array<long long, MISS_CLASS_COUNT> MissClassCounts;
+
+// thread_local counters, only counted with classification enabled (Tlb::set_miss_classification)
+extern thread_local map<MissClassKey, MissClassCounts> Miss_classes;
+
+/**
+ * Classifies the misses of every TLB level. Each level keeps a shadow fully-associative lru of its own
+ * size, fed with the references that reach the level, the pages it has ever seen, and the pages that a
+ * flush or an invalidation took out of it since their last use.
+ */
+class TlbMissClassifier {
+public:
+  // sizes[level], 0 for a level that does not exist (level 0 without a split l1)
+  explicit TlbMissClassifier(const vector<uint32_t>& sizes);
+
+  void hit(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn);
+  // classify and count a miss, then reference the page like a hit
+  void miss(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn);
+  // a context switch flushed the entry out of the level
+  void flushed(int level, uint32_t process_id, uint32_t page_size, uint64_t vpn);
+  // the page of this pid starting at vpn was swapped out, its entries invalidated at every level
+  void invalidated(uint32_t process_id, uint64_t vpn);
+  // the page of this pid starting at vpn got a new translation, its entries invalidated at every level
+  void remapped(uint32_t process_id, uint64_t vpn);
+
+private:
+  // (pid and page size, vpn): vpns take up to 45 bits, so a page does not fit one word with its pid
+  typedef pair<uint64_t, uint64_t> Key;
+  struct KeyHash {
+    size_t operator()(const Key& k) const {
+      return (k.first * 0x9E3779B97F4A7C15ULL) ^ k.second;
+    }
+  };
+
+  struct Level {
+    uint32_t size;
+    uint64_t clock = 0;
+    unordered_map<Key, uint64_t, KeyHash> shadow;   // key -> last use
+    map<uint64_t, Key> shadow_order;                // last use -> key, the lru first
+    unordered_set<Key, KeyHash> seen;
+    unordered_set<Key, KeyHash> flushed;
+    unordered_set<Key, KeyHash> invalidated;        // pid and vpn only, whatever the page size
+    unordered_set<Key, KeyHash> remapped;           // likewise
+  };
+
+  vector<Level> levels;
+
+  static Key key_of(uint32_t process_id, uint32_t page_size, uint64_t vpn);
+  static Key page_of(uint32_t process_id, uint64_t vpn);
+  // reference the key in the level's shadow lru, true if it was there
+  static bool touch(Level& level, const Key& key);
+};
+
+#endif // TLB_MISS_H
@@ -0,0 +1,229 @@
+#include "tlb-replacement.h"
+#include <algorithm>
+
+thread_local long long Replacement_ops[TLB_POLICY_COUNT] = {};
+thread_local int Ship_dead_fills = 0;
+
+static const uint8_t TLB_RRPV_MAX = 3;         // 2-bit rrpv: 3 is "distant", the next victim
+static const uint32_t PSEL_MAX = 1023;          // 10-bit policy selector
+static const uint32_t BRRIP_LONG_EVERY = 32;    // brrip inserts at the long rrpv once per this many fills
+static const uint32_t DUEL_STRIDE = 32;         // one srrip and one brrip leader set per this many sets
+static const uint32_t DUEL_WINDOW_BITS = 8;     // single set: leader windows of 256 accesses
+static const size_t SHCT_SIZE = 1024;
+static const uint8_t SHCT_MAX = 7;              // 3-bit saturating counters
+
+const char* tlb_policy_name(TlbPolicy policy) {
+  switch (policy) {
+    case TLB_FIFO: return "fifo";
+    case TLB_LFU: return "lfu";
+    case TLB_LRU: return "lru";
+    case TLB_ARC: return "arc";
+    case TLB_DRRIP: return "drrip";
+    case TLB_SHIP: return "ship";
+    default: return "random";
+  }
+}
+
+bool parse_tlb_policy(const string& name, TlbPolicy& policy) {
+  for (int p = 0; p < TLB_POLICY_COUNT; p++) {
+    if (name == tlb_policy_name(TlbPolicy(p))) {
+      policy = TlbPolicy(p);
+      return true;
+    }
+  }
+  return false;
+}
+
+TlbSegment tlb_segment(uint64_t vpn) {
+  if (vpn < 0x400) {
+    return TLB_CODE;
+  }
+  // the 4MB stack sits at the top of the 32-bit, 48-bit or 57-bit user address space
+  for (int top_bits : {20, 35, 44}) {
+    uint64_t top = 1ULL << top_bits;
+    if (vpn < top && vpn >= top - 0x400) {
+      return TLB_STACK;
+    }
+  }
+  return TLB_HEAP;
+}
+
+AdaptiveReplacement::AdaptiveReplacement(TlbPolicy policy, uint32_t sets, uint32_t ways)
+    : policy(policy), sets(sets), ways(ways), clock(0), pending_ghost(0), psel(PSEL_MAX / 2), accesses(0),
+      brrip_fills(0), pending_signature(0) {
+  if (policy == TLB_ARC) {
+    target.assign(sets, 0);
+    recent_ghosts.resize(sets);
+    frequent_ghosts.resize(sets);
+  } else if (policy == TLB_SHIP) {
+    // weakly reused to begin with, so that nothing is predicted dead before the counters learn
+    shct.assign(SHCT_SIZE, 1);
+  }
+}
+
+bool AdaptiveReplacement::is_adaptive(TlbPolicy policy) {
+  return policy == TLB_ARC || policy == TLB_DRRIP || policy == TLB_SHIP;
+}
+
+AdaptiveReplacement::Leader AdaptiveReplacement::leader(uint32_t set) const {
+  uint32_t slot;
+  if (sets >= 2 * DUEL_STRIDE) {
+    slot = set % DUEL_STRIDE;
+  } else if (sets >= 2) {
+    slot = set;
+  } else {
+    slot = (accesses >> DUEL_WINDOW_BITS) % DUEL_STRIDE;
+  }
+  return slot == 0 ? LEADER_SRRIP : slot == 1 ? LEADER_BRRIP : LEADER_NONE;
+}
+
+void AdaptiveReplacement::on_hit(ReplacementMeta& meta) {
+  Replacement_ops[policy]++;
+  switch (policy) {
+    case TLB_ARC:
+      meta.frequent = true;
+      meta.stamp = ++clock;
+      break;
+    case TLB_DRRIP:
+      accesses++;
+      meta.rrpv = 0;
+      break;
+    case TLB_SHIP:
+      meta.rrpv = 0;
+      meta.reused = true;
+      if (shct[meta.signature] < SHCT_MAX) {
+        shct[meta.signature]++;
+      }
+      Replacement_ops[policy]++;
+      break;
+    default:
+      break;
+  }
+}
+
+bool AdaptiveReplacement::take_ghost(deque<Ghost>& ghosts, uint32_t process_id, uint64_t vpn, uint32_t page_size) {
+  for (auto it = ghosts.begin(); it != ghosts.end(); ++it) {
+    Replacement_ops[policy]++;
+    if (it->pid == process_id && it->vpn == vpn && it->page_size == page_size) {
+      ghosts.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void AdaptiveReplacement::on_miss(uint32_t set, uint32_t process_id, uint64_t vpn, uint32_t page_size) {
+  Replacement_ops[policy]++;
+  if (policy == TLB_ARC) {
+    deque<Ghost>& recent = recent_ghosts[set];
+    deque<Ghost>& frequent = frequent_ghosts[set];
+    pending_ghost = 0;
+    // a page t1 let go of too early: give t1 more room, one t2 let go of: give t2 more room
+    // (the + 1 puts back the ghost just taken)
+    if (take_ghost(recent, process_id, vpn, page_size)) {
+      uint32_t delta = max<uint32_t>(1, frequent.size() / (recent.size() + 1));
+      target[set] = min(ways, target[set] + delta);
+      pending_ghost = 1;
+    } else if (take_ghost(frequent, process_id, vpn, page_size)) {
+      uint32_t delta = max<uint32_t>(1, recent.size() / (frequent.size() + 1));
+      target[set] = target[set] > delta ? target[set] - delta : 0;
+      pending_ghost = 2;
+    }
+  } else if (policy == TLB_DRRIP) {
+    Leader l = leader(set);
+    accesses++;
+    // a miss in a leader set counts against its policy
+    if (l == LEADER_SRRIP && psel < PSEL_MAX) {
+      psel++;
+    } else if (l == LEADER_BRRIP && psel > 0) {
+      psel--;
+    }
+  } else if (policy == TLB_SHIP) {
+    uint32_t key = process_id * 3 + tlb_segment(vpn);
+    pending_signature = (key * 2654435761u) >> 22;
+  }
+}
+
+uint32_t AdaptiveReplacement::rrip_victim(const vector<ReplacementMeta*>& metas) {
+  while (true) {
+    for (uint32_t w = 0; w < metas.size(); w++) {
+      Replacement_ops[policy]++;
+      if (metas[w]->rrpv >= TLB_RRPV_MAX) {
+        return w;
+      }
+    }
+    // nothing distant yet: age the whole set
+    for (ReplacementMeta* meta : metas) {
+      meta->rrpv++;
+    }
+    Replacement_ops[policy] += metas.size();
+  }
+}
+
+uint32_t AdaptiveReplacement::arc_victim(uint32_t set, const vector<ReplacementMeta*>& metas) {
+  uint32_t t1 = 0;
+  for (const ReplacementMeta* meta : metas) {
+    t1 += meta->frequent ? 0 : 1;
+  }
+  Replacement_ops[policy] += metas.size();
+  bool from_t1 = t1 > 0 && (t1 == metas.size() || t1 > target[set] || (pending_ghost == 2 && t1 == target[set]));
+  uint32_t victim = metas.size();
+  for (uint32_t w = 0; w < metas.size(); w++) {
+    if (metas[w]->frequent != from_t1 && (victim == metas.size() || metas[w]->stamp < metas[victim]->stamp)) {
+      victim = w;
+    }
+  }
+  Replacement_ops[policy] += metas.size();
+  return victim;
+}
+
+uint32_t AdaptiveReplacement::victim(uint32_t set, const vector<ReplacementMeta*>& metas) {
+  return policy == TLB_ARC ? arc_victim(set, metas) : rrip_victim(metas);
+}
+
+void AdaptiveReplacement::on_evict(uint32_t set, uint32_t process_id, uint64_t vpn, uint32_t page_size,
+                                   const ReplacementMeta& meta) {
+  Replacement_ops[policy]++;
+  if (policy == TLB_ARC) {
+    deque<Ghost>& ghosts = meta.frequent ? frequent_ghosts[set] : recent_ghosts[set];
+    ghosts.push_back(Ghost{process_id, vpn, page_size});
+    if (ghosts.size() > ways) {
+      ghosts.pop_front();
+    }
+  } else if (policy == TLB_SHIP && !meta.reused && shct[meta.signature] > 0) {
+    // dead on arrival: fills of this signature are worth less
+    shct[meta.signature]--;
+  }
+}
+
+void AdaptiveReplacement::on_fill(uint32_t set, ReplacementMeta& meta) {
+  Replacement_ops[policy]++;
+  meta = ReplacementMeta();
+  switch (policy) {
+    case TLB_ARC:
+      // back from a ghost list: it has been used twice, so it goes to t2
+      meta.frequent = pending_ghost != 0;
+      meta.stamp = ++clock;
+      pending_ghost = 0;
+      break;
+    case TLB_DRRIP: {
+      Leader l = leader(set);
+      bool brrip = l == LEADER_BRRIP || (l == LEADER_NONE && psel > PSEL_MAX / 2);
+      meta.rrpv = TLB_RRPV_MAX - 1;
+      if (brrip && ++brrip_fills % BRRIP_LONG_EVERY != 0) {
+        meta.rrpv = TLB_RRPV_MAX;
+      }
+      break;
+    }
+    case TLB_SHIP:
+      meta.signature = pending_signature;
+      meta.rrpv = TLB_RRPV_MAX - 1;
+      if (shct[pending_signature] == 0) {
+        meta.rrpv = TLB_RRPV_MAX;
+        Ship_dead_fills++;
+      }
+      break;
+    default:
+      break;
+  }
+}
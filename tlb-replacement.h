@@ -0,0 +1,97 @@
+// tlb-replacement.h
+#ifndef TLB_REPLACEMENT_H
+#define TLB_REPLACEMENT_H
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// replacement policy of a TLB level (for l1 it picks which look_up/l1_insert overloads the os uses);
+// arc, drrip and ship are the adaptive ones, backed by AdaptiveReplacement
+enum TlbPolicy { TLB_RANDOM, TLB_FIFO, TLB_LFU, TLB_LRU, TLB_ARC, TLB_DRRIP, TLB_SHIP, TLB_POLICY_COUNT };
+
+const char* tlb_policy_name(TlbPolicy policy);
+// "random", "fifo", "lfu", "lru", "arc", "drrip" or "ship"; returns false for anything else
+bool parse_tlb_policy(const string& name, TlbPolicy& policy);
+
+// metadata work of the adaptive policies (ghost list probes, victim scans, rrpv aging, psel and
+// predictor updates), indexed by TlbPolicy; the base policies count nothing
+extern thread_local long long Replacement_ops[TLB_POLICY_COUNT];
+// ship fills predicted dead on arrival, i.e. inserted at the distant rrpv
+extern thread_local int Ship_dead_fills;
+
+// per-entry state of the adaptive policies, kept in the entry itself so that it follows the entry around
+struct ReplacementMeta {
+  uint64_t stamp = 0;       // arc: last use, the lru order inside t1 and t2
+  uint8_t rrpv = 0;         // drrip, ship: re-reference prediction value, evicted at TLB_RRPV_MAX
+  bool frequent = false;    // arc: in t2 (used at least twice) rather than t1
+  bool reused = false;      // ship: hit since the fill
+  uint16_t signature = 0;   // ship: predictor entry of the fill
+};
+
+// segment of a virtual page in the layout os hands out: code in the first 4MB, stack in the last 4MB
+enum TlbSegment { TLB_CODE, TLB_HEAP, TLB_STACK };
+TlbSegment tlb_segment(uint64_t vpn);
+
+/**
+ * Replacement state of the adaptive policies for a structure of sets x ways entries (l1 is one set):
+ *   arc:   t1 (seen once) and t2 (seen again) with ghost lists of their recent evictions per set; a
+ *          ghost hit moves the per-set target size of t1 towards the list that would have kept the page
+ *   drrip: 2-bit rrpv, srrip and brrip leader sets duel through a psel counter, the other sets follow
+ *          the winner; a single set duels over time instead, with leader windows of 256 accesses
+ *   ship:  srrip victims, the insertion rrpv comes from saturating counters indexed by a signature of
+ *          (pid, segment) that learn whether the fills of that signature get reused before eviction
+ * An insert calls on_miss, then victim and on_evict if the set is full, then on_fill.
+ */
+class AdaptiveReplacement {
+public:
+  AdaptiveReplacement(TlbPolicy policy, uint32_t sets, uint32_t ways);
+
+  static bool is_adaptive(TlbPolicy policy);
+
+  void on_hit(ReplacementMeta& meta);
+  void on_miss(uint32_t set, uint32_t process_id, uint64_t vpn, uint32_t page_size);
+  // the way to evict from a full set, metas[w] being the state of way w
+  uint32_t victim(uint32_t set, const vector<ReplacementMeta*>& metas);
+  void on_evict(uint32_t set, uint32_t process_id, uint64_t vpn, uint32_t page_size, const ReplacementMeta& meta);
+  // set up the state of the entry filled for the last on_miss
+  void on_fill(uint32_t set, ReplacementMeta& meta);
+
+private:
+  struct Ghost {
+    uint32_t pid;
+    uint64_t vpn;
+    uint32_t page_size;
+  };
+  enum Leader { LEADER_NONE, LEADER_SRRIP, LEADER_BRRIP };
+
+  TlbPolicy policy;
+  uint32_t sets;
+  uint32_t ways;
+  uint64_t clock;
+
+  // arc
+  vector<uint32_t> target;              // per set: the size t1 aims for
+  vector<deque<Ghost> > recent_ghosts;  // per set: evicted from t1, oldest first
+  vector<deque<Ghost> > frequent_ghosts;
+  int pending_ghost;                    // 0, or the ghost list (1: t1, 2: t2) the missing page was found in
+
+  // drrip
+  uint32_t psel;
+  uint64_t accesses;
+  uint64_t brrip_fills;
+
+  // ship
+  vector<uint8_t> shct;
+  uint16_t pending_signature;
+
+  Leader leader(uint32_t set) const;
+  uint32_t rrip_victim(const vector<ReplacementMeta*>& metas);
+  uint32_t arc_victim(uint32_t set, const vector<ReplacementMeta*>& metas);
+  bool take_ghost(deque<Ghost>& ghosts, uint32_t process_id, uint64_t vpn, uint32_t page_size);
+};
+
+#endif // TLB_REPLACEMENT_H
@@ -0,0 +1,174 @@
+#include "tlb-simd.h"
+#include "tlb.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TLB_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// padding slots use mask 0 and a base no address can produce, so they never match
+static const uint32_t EMPTY_BASE = 0xFFFFFFFF;
+
+L1SearchIndex::L1SearchIndex(uint32_t capacity) : capacity((capacity + 7) / 8 * 8), count(0) {
+  allocate();
+  search = search_scalar;
+#ifdef TLB_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    search = search_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    search = search_sse2;
+  }
+#endif
+  const char* forced = getenv("TLB_L1_SEARCH");
+  if (forced != nullptr) {
+    if (strcmp(forced, "scalar") == 0) {
+      search = search_scalar;
+    }
+#ifdef TLB_SIMD_X86
+    else if (strcmp(forced, "sse2") == 0) {
+      search = search_sse2;
+    } else if (strcmp(forced, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+      search = search_avx2;
+    }
+#endif
+  }
+}
+
+L1SearchIndex::L1SearchIndex(const L1SearchIndex& other) : capacity(other.capacity), count(other.count), search(other.search) {
+  allocate();
+  memcpy(base, other.base, capacity * sizeof(uint32_t));
+  memcpy(base_hi, other.base_hi, capacity * sizeof(uint32_t));
+  memcpy(mask, other.mask, capacity * sizeof(uint32_t));
+  memcpy(pid, other.pid, capacity * sizeof(uint32_t));
+  memcpy(pfn, other.pfn, capacity * sizeof(uint32_t));
+}
+
+L1SearchIndex::~L1SearchIndex() {
+  free(base);
+  free(base_hi);
+  free(mask);
+  free(pid);
+  free(pfn);
+}
+
+void L1SearchIndex::allocate() {
+  size_t bytes = capacity * sizeof(uint32_t);
+  if (bytes == 0) {
+    bytes = 32;
+  }
+  base = static_cast<uint32_t*>(aligned_alloc(32, bytes));
+  base_hi = static_cast<uint32_t*>(aligned_alloc(32, bytes));
+  mask = static_cast<uint32_t*>(aligned_alloc(32, bytes));
+  pid = static_cast<uint32_t*>(aligned_alloc(32, bytes));
+  pfn = static_cast<uint32_t*>(aligned_alloc(32, bytes));
+  if (base == nullptr || base_hi == nullptr || mask == nullptr || pid == nullptr || pfn == nullptr) {
+    throw bad_alloc();
+  }
+  for (uint32_t i = 0; i < capacity; i++) {
+    clear_slot(i);
+  }
+}
+
+void L1SearchIndex::clear_slot(uint32_t idx) {
+  base[idx] = EMPTY_BASE;
+  base_hi[idx] = 0;
+  mask[idx] = 0;
+  pid[idx] = 0;
+  pfn[idx] = 0;
+}
+
+void L1SearchIndex::set(uint32_t idx, const TlbEntry& entry) {
+  base[idx] = entry.vpn << 12;
+  base_hi[idx] = entry.vpn >> 20;
+  mask[idx] = ~(entry.page_size - 1);
+  pid[idx] = entry.process_id;
+  pfn[idx] = entry.pfn;
+  if (idx >= count) {
+    count = idx + 1;
+  }
+}
+
+void L1SearchIndex::rebuild(const vector<TlbEntry>& entries) {
+  uint32_t n = entries.size();
+  for (uint32_t i = 0; i < n; i++) {
+    set(i, entries[i]);
+  }
+  for (uint32_t i = n; i < count; i++) {
+    clear_slot(i);
+  }
+  count = n;
+}
+
+const char* L1SearchIndex::implementation() const {
+  if (search == search_avx2) {
+    return "avx2";
+  }
+  if (search == search_sse2) {
+    return "sse2";
+  }
+  return "scalar";
+}
+
+int L1SearchIndex::search_scalar(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id) {
+  for (uint32_t i = 0; i < index->count; i++) {
+    if ((uint32_t(virtual_addr) & index->mask[i]) == index->base[i] && index->base_hi[i] == uint32_t(virtual_addr >> 32)
+        && index->pid[i] == process_id) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+#ifdef TLB_SIMD_X86
+__attribute__((target("sse2")))
+int L1SearchIndex::search_sse2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id) {
+  __m128i addr = _mm_set1_epi32(uint32_t(virtual_addr));
+  __m128i addr_hi = _mm_set1_epi32(uint32_t(virtual_addr >> 32));
+  __m128i proc = _mm_set1_epi32(process_id);
+  for (uint32_t i = 0; i < index->count; i += 4) {
+    __m128i m = _mm_load_si128(reinterpret_cast<const __m128i*>(index->mask + i));
+    __m128i b = _mm_load_si128(reinterpret_cast<const __m128i*>(index->base + i));
+    __m128i p = _mm_load_si128(reinterpret_cast<const __m128i*>(index->pid + i));
+    __m128i h = _mm_load_si128(reinterpret_cast<const __m128i*>(index->base_hi + i));
+    __m128i hit = _mm_and_si128(_mm_cmpeq_epi32(_mm_and_si128(addr, m), b), _mm_cmpeq_epi32(p, proc));
+    hit = _mm_and_si128(hit, _mm_cmpeq_epi32(h, addr_hi));
+    int bits = _mm_movemask_ps(_mm_castsi128_ps(hit));
+    if (bits != 0) {
+      return i + __builtin_ctz(bits);
+    }
+  }
+  return -1;
+}
+
+__attribute__((target("avx2")))
+int L1SearchIndex::search_avx2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id) {
+  __m256i addr = _mm256_set1_epi32(uint32_t(virtual_addr));
+  __m256i addr_hi = _mm256_set1_epi32(uint32_t(virtual_addr >> 32));
+  __m256i proc = _mm256_set1_epi32(process_id);
+  for (uint32_t i = 0; i < index->count; i += 8) {
+    __m256i m = _mm256_load_si256(reinterpret_cast<const __m256i*>(index->mask + i));
+    __m256i b = _mm256_load_si256(reinterpret_cast<const __m256i*>(index->base + i));
+    __m256i p = _mm256_load_si256(reinterpret_cast<const __m256i*>(index->pid + i));
+    __m256i h = _mm256_load_si256(reinterpret_cast<const __m256i*>(index->base_hi + i));
+    __m256i hit = _mm256_and_si256(_mm256_cmpeq_epi32(_mm256_and_si256(addr, m), b), _mm256_cmpeq_epi32(p, proc));
+    hit = _mm256_and_si256(hit, _mm256_cmpeq_epi32(h, addr_hi));
+    int bits = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+    if (bits != 0) {
+      return i + __builtin_ctz(bits);
+    }
+  }
+  return -1;
+}
+#else
+int L1SearchIndex::search_sse2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id) {
+  return search_scalar(index, virtual_addr, process_id);
+}
+
+int L1SearchIndex::search_avx2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id) {
+  return search_scalar(index, virtual_addr, process_id);
+}
+#endif
@@ -0,0 +1,58 @@
+// tlb-simd.h
+#ifndef TLB_SIMD_H
+#define TLB_SIMD_H
+
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+class TlbEntry;
+
+/**
+ * Structure-of-arrays mirror of the fully-associative l1 list, used only for searching.
+ * Each slot keeps the masked virtual base (vpn << 12) split into its low and high words, the page-size
+ * mask, the pid and the pfn in separate 32-byte aligned arrays, so a lookup is
+ * (addr & mask[i]) == base[i] && addr >> 32 == base_hi[i] && pid[i] == pid over all slots at once
+ * (pages are at most 1GB, so the high word is never masked): 8 slots per AVX2 compare, 4 per SSE2 compare, or a scalar loop.
+ * The implementation is picked at runtime from the cpu features (TLB_L1_SEARCH=scalar|sse2|avx2 overrides).
+ * Slot i always mirrors (*l1_list)[i], the Tlb keeps them in sync.
+ */
+class L1SearchIndex {
+public:
+  L1SearchIndex(uint32_t capacity);
+  L1SearchIndex(const L1SearchIndex& other);
+  L1SearchIndex& operator=(const L1SearchIndex& other) = delete;
+  ~L1SearchIndex();
+
+  // mirror a single slot (insert into an empty or replaced slot)
+  void set(uint32_t idx, const TlbEntry& entry);
+  // mirror the whole list after an erase, a sort or a flush
+  void rebuild(const vector<TlbEntry>& entries);
+
+  // return the index of the first matching slot, -1 if none
+  int find(uint64_t virtual_addr, uint32_t process_id) const {
+    return search(this, virtual_addr, process_id);
+  }
+
+  const char* implementation() const;
+
+private:
+  uint32_t capacity;  // rounded up to a multiple of 8
+  uint32_t count;
+  uint32_t* base;
+  uint32_t* base_hi;
+  uint32_t* mask;
+  uint32_t* pid;
+  uint32_t* pfn;
+  int (*search)(const L1SearchIndex*, uint64_t, uint32_t);
+
+  void allocate();
+  void clear_slot(uint32_t idx);
+
+  static int search_scalar(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id);
+  static int search_sse2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id);
+  static int search_avx2(const L1SearchIndex* index, uint64_t virtual_addr, uint32_t process_id);
+};
+
+#endif // TLB_SIMD_H
@@ -1,47 +1,282 @@
 #include <iostream>
 #include <algorithm>
 #include "tlb.h"
+#include "event-trace.h"
 
-int L1_hit = 0;
-int L2_hit = 0;
-int TLB_miss = 0;
+thread_local int L1_hit = 0;
+thread_local int L2_hit = 0;
+thread_local int TLB_miss = 0;
+thread_local int Victim_hit = 0;
+thread_local int Level_hit[TLB_MAX_LEVELS + 1] = {};
 
 // constructor
-TlbEntry::TlbEntry(uint32_t process_id, uint32_t page_size, uint32_t vpn, uint32_t pfn) : process_id(process_id),page_size(page_size),vpn(vpn), pfn(pfn), reference(1), frequency(1) {}
+TlbEntry::TlbEntry(uint32_t process_id, uint32_t page_size, uint64_t vpn, uint32_t pfn) : process_id(process_id),page_size(page_size),vpn(vpn), pfn(pfn), stamp(0), frequency(1) {}
 
 
-//two-level tlb
+//tlb hierarchy
 //constructor
-Tlb::Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed) : l1_size(l1_size), l2_size(l2_size), max_process_allowed(max_process_allowed) {
-  // by default: l1 size 64, l2 size 1024, max process allowed is 4
+Tlb::Tlb(uint32_t l1_size, uint32_t l2_size) : l1_size(l1_size), l2_size(0), victim_size(0), l1_policy(TLB_RANDOM),
+    l1_replacement(nullptr), l1_clock(0), split_l1(false), itlb_active(false), idle_l1_list(nullptr), idle_l1_index(nullptr),
+    idle_l1_size(0), idle_l1_policy(TLB_RANDOM), idle_l1_replacement(nullptr), classifier(nullptr) {
+  // by default: l1 size 64, no l2
   l1_list = new vector<TlbEntry>();
-  l2_list = new vector<vector<TlbEntry>*>();
-
-  l2_size_per_process = l2_size / max_process_allowed;
-  for (int i = 0; i < max_process_allowed; i++) {
-    l2_list->push_back(new vector<TlbEntry>());
+  l1_index = new L1SearchIndex(l1_size);
+  victim_list = new vector<TlbEntry>();
+  levels = new vector<TlbLevel*>();
+  if (l2_size > 0) {
+    configure_levels({TlbLevelConfig{l2_size, 0, TLB_LRU, TLB_NINE}});
   }
   
   srand(time(NULL));
-  cout << "TLB initialized" << endl;
+}
+
+// copy constructor: every level is owned, so copy them too
+Tlb::Tlb(const Tlb& other) : level_configs(other.level_configs), l1_size(other.l1_size), l2_size(other.l2_size),
+    victim_size(other.victim_size), l1_policy(other.l1_policy), l1_replacement(nullptr), l1_clock(other.l1_clock), split_l1(other.split_l1),
+    itlb_active(other.itlb_active), idle_l1_list(nullptr), idle_l1_index(nullptr), idle_l1_size(other.idle_l1_size),
+    idle_l1_policy(other.idle_l1_policy), idle_l1_replacement(nullptr), classifier(nullptr) {
+  l1_list = new vector<TlbEntry>(*other.l1_list);
+  if (other.l1_replacement != nullptr) {
+    l1_replacement = new AdaptiveReplacement(*other.l1_replacement);
+  }
+  if (other.idle_l1_replacement != nullptr) {
+    idle_l1_replacement = new AdaptiveReplacement(*other.idle_l1_replacement);
+  }
+  if (other.classifier != nullptr) {
+    classifier = new TlbMissClassifier(*other.classifier);
+  }
+  l1_index = new L1SearchIndex(*other.l1_index);
+  if (other.split_l1) {
+    idle_l1_list = new vector<TlbEntry>(*other.idle_l1_list);
+    idle_l1_index = new L1SearchIndex(*other.idle_l1_index);
+  }
+  victim_list = new vector<TlbEntry>(*other.victim_list);
+  levels = new vector<TlbLevel*>();
+  for (TlbLevel* level : *other.levels) {
+    levels->push_back(level->clone());
+  }
 }
 
 // destructor
 Tlb::~Tlb() {
   delete l1_list;
-  for (int i=0; i<max_process_allowed; i++) {
-    delete (*l2_list)[i];
+  delete l1_index;
+  delete idle_l1_list;
+  delete idle_l1_index;
+  delete l1_replacement;
+  delete idle_l1_replacement;
+  delete classifier;
+  delete victim_list;
+  for (TlbLevel* level : *levels) {
+    delete level;
+  }
+  delete levels;
+}
+
+void Tlb::reconfigure(uint32_t new_l1_size, uint32_t new_l2_size) {
+  set_split_l1(0, TLB_RANDOM);
+  delete l1_index;
+  l1_size = new_l1_size;
+  l1_list->clear();
+  victim_list->clear();
+  l1_index = new L1SearchIndex(l1_size);
+  set_l1_policy(l1_policy);
+  vector<TlbLevelConfig> configs;
+  if (new_l2_size > 0) {
+    configs.push_back(TlbLevelConfig{new_l2_size, 0, TLB_LRU, TLB_NINE});
+  }
+  configure_levels(configs);
+}
+
+void Tlb::set_split_l1(uint32_t itlb_size, TlbPolicy itlb_policy) {
+  select_l1(false);
+  delete idle_l1_list;
+  delete idle_l1_index;
+  delete idle_l1_replacement;
+  idle_l1_list = nullptr;
+  idle_l1_index = nullptr;
+  idle_l1_replacement = nullptr;
+  split_l1 = itlb_size > 0;
+  if (split_l1) {
+    idle_l1_list = new vector<TlbEntry>();
+    idle_l1_index = new L1SearchIndex(itlb_size);
+    idle_l1_size = itlb_size;
+    idle_l1_policy = itlb_policy;
+    if (AdaptiveReplacement::is_adaptive(itlb_policy)) {
+      idle_l1_replacement = new AdaptiveReplacement(itlb_policy, 1, itlb_size);
+    }
+  }
+  if (classifier != nullptr) {
+    set_miss_classification(true);
+  }
+}
+
+void Tlb::select_l1(bool instruction) {
+  if (split_l1 && instruction != itlb_active) {
+    swap_l1_sides();
+  }
+}
+
+void Tlb::swap_l1_sides() {
+  swap(l1_list, idle_l1_list);
+  swap(l1_index, idle_l1_index);
+  swap(l1_size, idle_l1_size);
+  swap(l1_policy, idle_l1_policy);
+  swap(l1_replacement, idle_l1_replacement);
+  itlb_active = !itlb_active;
+}
+
+template <typename F> void Tlb::for_each_l1(F f) {
+  f();
+  if (split_l1) {
+    swap_l1_sides();
+    f();
+    swap_l1_sides();
+  }
+}
+
+void Tlb::configure_levels(const vector<TlbLevelConfig>& configs) {
+  for (TlbLevel* level : *levels) {
+    delete level;
+  }
+  levels->clear();
+  level_configs = configs;
+  for (const auto& config : configs) {
+    // fully-associative lru is the shared, partitionable kind with a hash index
+    if (config.ways == 0 && config.policy == TLB_LRU) {
+      levels->push_back(new SharedL2(config.entries));
+    } else {
+      levels->push_back(new SetAssocTlb(config.entries, config.ways, config.policy));
+    }
+  }
+  l2_size = configs.empty() ? 0 : configs[0].entries;
+  if (classifier != nullptr) {
+    set_miss_classification(true);
+  }
+}
+
+SharedL2* Tlb::shared_l2() const {
+  return levels->empty() ? nullptr : dynamic_cast<SharedL2*>((*levels)[0]);
+}
+
+void Tlb::set_l1_policy(TlbPolicy policy) {
+  l1_policy = policy;
+  delete l1_replacement;
+  l1_replacement = nullptr;
+  if (AdaptiveReplacement::is_adaptive(policy)) {
+    l1_replacement = new AdaptiveReplacement(policy, 1, l1_size);
+  }
+}
+
+void Tlb::set_victim_size(uint32_t size) {
+  victim_size = size;
+  while (victim_list->size() > victim_size) {
+    victim_list->erase(victim_list->begin());
+  }
+}
+
+void Tlb::set_miss_classification(bool enabled) {
+  delete classifier;
+  classifier = nullptr;
+  if (!enabled) {
+    return;
+  }
+  // level 0 is the iTLB, 1 the dTLB (or the unified l1), then the lower levels
+  vector<uint32_t> sizes = {0, l1_size};
+  if (split_l1) {
+    sizes[0] = itlb_active ? l1_size : idle_l1_size;
+    sizes[1] = itlb_active ? idle_l1_size : l1_size;
+  }
+  for (const auto& config : level_configs) {
+    sizes.push_back(config.entries);
+  }
+  classifier = new TlbMissClassifier(sizes);
+}
+
+int Tlb::l1_level() const {
+  return split_l1 && itlb_active ? 0 : 1;
+}
+
+void Tlb::classify_misses(const TlbEntry& entry, size_t missed_levels) {
+  classifier->miss(l1_level(), entry.process_id, entry.page_size, entry.vpn);
+  for (size_t j = 0; j < missed_levels; j++) {
+    classifier->miss(j + 2, entry.process_id, entry.page_size, entry.vpn);
+  }
+}
+
+void Tlb::record_walk(const TlbEntry& entry) {
+  if (classifier != nullptr) {
+    classify_misses(entry, levels->size());
+  }
+}
+
+void Tlb::l1_evicted(const TlbEntry& entry) {
+  SIM_EVENT(SIM_EVENT_EVICT, l1_level(), entry.process_id, entry.vpn, entry.page_size);
+  TlbEntry leaving = entry;
+  if (victim_size > 0) {
+    if (victim_list->size() < victim_size) {
+      victim_list->push_back(entry);
+      return;
+    }
+    leaving = victim_list->front();
+    victim_insert(entry);
+  }
+  if (!levels->empty() && level_configs[0].inclusion == TLB_EXCLUSIVE) {
+    level_insert(0, leaving);
+  }
+}
+
+void Tlb::victim_insert(const TlbEntry& entry) {
+  if (victim_size == 0) {
+    return;
+  }
+  if (victim_list->size() >= victim_size) {
+    victim_list->erase(victim_list->begin());
+  }
+  victim_list->push_back(entry);
+}
+
+bool Tlb::victim_look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found) {
+  for (size_t i = 0; i < victim_list->size(); i++) {
+    const TlbEntry& e = (*victim_list)[i];
+    if (e.process_id == process_id && ((virtual_addr & ~(uint64_t(e.page_size) - 1)) >> 12) == e.vpn) {
+      found = e;
+      // take it out first, so the l1 entry it displaces has room
+      victim_list->erase(victim_list->begin() + i);
+      policy_l1_insert(found);
+      return true;
+    }
+  }
+  return false;
+}
+
+int Tlb::policy_look_up(uint64_t virtual_addr, uint32_t process_id) {
+  if (l1_policy == TLB_LRU) {
+    return look_up(virtual_addr, process_id, 0);
+  }
+  return look_up(virtual_addr, process_id);
+}
+
+int Tlb::policy_l1_insert(TlbEntry entry) {
+  SIM_EVENT(SIM_EVENT_FILL, l1_level(), entry.process_id, entry.vpn, entry.page_size);
+  switch (l1_policy) {
+    case TLB_FIFO: return l1_insert(entry, 0);
+    case TLB_LFU: return l1_insert(entry, 0, 0);
+    case TLB_LRU: return l1_insert(entry, 0, 0, 0);
+    case TLB_ARC:
+    case TLB_DRRIP:
+    case TLB_SHIP: return l1_insert_adaptive(entry);
+    default: return l1_insert(entry);
   }
-  delete l2_list;
 }
 
 
 // pfn and page_size is obtained from page table entry obj
-TlbEntry Tlb::create_tlb_entry(uint32_t pfn, uint32_t page_size, uint32_t virtual_addr, uint32_t process_id) {
+TlbEntry Tlb::create_tlb_entry(uint32_t pfn, uint32_t page_size, uint64_t virtual_addr, uint32_t process_id) {
   // calculate mask: number of bits to right shift to extract vpn.
   // e.g. set mask to 12 when page size is 4KB and physical mem is 4GB (thus 20-bit vpn).
-  uint32_t mask = ~(page_size - 1);
-  uint32_t vpn = (virtual_addr & mask) >> 12;
+  uint64_t mask = ~(uint64_t(page_size) - 1);
+  uint64_t vpn = (virtual_addr & mask) >> 12;
 
   TlbEntry tlb_entry = TlbEntry(process_id, page_size, vpn, pfn);
   return tlb_entry;
@@ -49,121 +284,140 @@ TlbEntry Tlb::create_tlb_entry(uint32_t pfn, uint32_t page_size, uint32_t virtua
 
 
 // look_up(): given a virtual addr, look it up in both l1 and l2
-// return pfn if found, -1 if miss
-// this look_up method applies to random, fifo, and least frequently used policies
-int Tlb::look_up(uint32_t virtual_addr, uint32_t process_id) {
+// return the 4KB frame holding virtual_addr if found, throw on a miss
+// this look_up method applies to random, fifo, least frequently used and the adaptive policies
+int Tlb::look_up(uint64_t virtual_addr, uint32_t process_id) {
   // first, check l1
-  // loop through l1, compute the virtual addr vpn using tlb entry page size, and compare the 2 vpns
-  for (int i = 0; i < l1_list->size(); i++) {
-    uint32_t page_size = (*l1_list)[i].page_size;
-    uint32_t mask = ~(page_size - 1);
-    uint32_t vpn = (virtual_addr & mask) >> 12;
-    if (vpn == (*l1_list)[i].vpn) {
-      L1_hit++;
-      // update frequency of that tlb entry
-      (*l1_list)[i].frequency++;
-      return (*l1_list)[i].pfn;
+  // the index compares the virtual addr against every entry's masked vpn at once, whatever the page sizes
+  int i = l1_index->find(virtual_addr, process_id);
+  if (i >= 0) {
+    L1_hit++;
+    // update frequency of that tlb entry
+    (*l1_list)[i].frequency++;
+    if (l1_replacement != nullptr) {
+      l1_replacement->on_hit((*l1_list)[i].meta);
+    }
+    if (classifier != nullptr) {
+      const TlbEntry& e = (*l1_list)[i];
+      classifier->hit(l1_level(), e.process_id, e.page_size, e.vpn);
     }
+    return frame_of((*l1_list)[i], virtual_addr);
   }
 
-  // If only 1 level TLB is supported, uncomment this
-  
-  TLB_miss++;
-  L1_hit--;
-  throw logic_error("TLB miss");
-  
-
-  // not in l1, check l2:
-  // first, check if the process is already in l2
-  for (int i = 0; i < l2_list->size(); i++) {
-    if ((*l2_list)[i]->empty())
-      continue;
-    if ((*l2_list)[i]->back().process_id != process_id)
-      continue;
-    for (int j = 0; j < (*l2_list)[i]->size(); j++) {
-      TlbEntry entry = (*((*l2_list)[i]))[j];
-      uint32_t page_size = entry.page_size;
-      uint32_t mask = ~(page_size - 1);
-      uint32_t vpn = (virtual_addr & mask) >> 12;
-      if (vpn == entry.vpn) {
-        // found in l2, insert this one into l1
-        l1_insert(entry);
-        L2_hit++;
-        return entry.pfn;
-      }
+  // not in l1, check the victim buffer
+  TlbEntry victim(0, 0, 0, 0);
+  if (victim_size > 0 && victim_look_up(virtual_addr, process_id, victim)) {
+    Victim_hit++;
+    if (classifier != nullptr) {
+      classify_misses(victim, 0);
     }
+    return frame_of(victim, virtual_addr);
   }
-  // otherwise, l2 miss, go to page table with virtual addr and get a page table entry
-  TLB_miss++;
-  L1_hit--;
-  throw logic_error("TLB miss");
+
+  return lower_look_up(virtual_addr, process_id);
 }
 
-int Tlb::look_up(uint32_t virtual_addr, uint32_t process_id, int lru) {
+int Tlb::look_up(uint64_t virtual_addr, uint32_t process_id, int /* lru */) {
   // first, check l1
-  // loop through l1, compute the virtual addr vpn using tlb entry page size, and compare the 2 vpns
-  for (int i = 0; i < l1_list->size(); i++) {
-    uint32_t page_size = (*l1_list)[i].page_size;
-    uint32_t mask = ~(page_size - 1);
-    uint32_t vpn = (virtual_addr & mask) >> 12;
-    if (vpn == (*l1_list)[i].vpn) {
-      TlbEntry temp = (*l1_list)[i];
-      int j = i + 1;
-      for (; j < l1_list->size(); j++) {
-        (*l1_list)[j-1] = (*l1_list)[j];
-      }
-      (*l1_list)[j-1] = temp;
-      L1_hit++;
-      return (*l1_list)[i].pfn;
+  int i = l1_index->find(virtual_addr, process_id);
+  if (i >= 0) {
+    // restamp the slot: the entries never move, so the index needs no update
+    TlbEntry& hit = (*l1_list)[i];
+    hit.stamp = ++l1_clock;
+    L1_hit++;
+    if (classifier != nullptr) {
+      classifier->hit(l1_level(), hit.process_id, hit.page_size, hit.vpn);
     }
+    return frame_of(hit, virtual_addr);
   }
   
-  // If only 1 level TLB is supported, uncomment this
-  
-  TLB_miss++;
-  L1_hit--;
-  throw logic_error("TLB miss");
-  
+  // not in l1, check the victim buffer
+  TlbEntry victim(0, 0, 0, 0);
+  if (victim_size > 0 && victim_look_up(virtual_addr, process_id, victim)) {
+    Victim_hit++;
+    if (classifier != nullptr) {
+      classify_misses(victim, 0);
+    }
+    return frame_of(victim, virtual_addr);
+  }
 
-  // not in l1, check l2:
-  // first, check if the process is already in l2
-  for (int i = 0; i < l2_list->size(); i++) {
-    if ((*l2_list)[i]->empty())
-      continue;
-    if ((*l2_list)[i]->back().process_id != process_id)
+  return lower_look_up(virtual_addr, process_id);
+}
+
+int Tlb::lower_look_up(uint64_t virtual_addr, uint32_t process_id) {
+  // not in l1, walk down the lower levels
+  TlbEntry entry(0, 0, 0, 0);
+  for (size_t k = 0; k < levels->size(); k++) {
+    if (!(*levels)[k]->look_up(virtual_addr, process_id, entry)) {
       continue;
-    for (int j = 0; j < (*l2_list)[i]->size(); j++) {
-      TlbEntry entry = (*((*l2_list)[i]))[j];
-      uint32_t page_size = entry.page_size;
-      uint32_t mask = ~(page_size - 1);
-      uint32_t vpn = (virtual_addr & mask) >> 12;
-      if (vpn == entry.vpn) {
-        // found in l2, insert this one into l1
-        l1_insert(entry);
-        L2_hit++;
-        return entry.pfn;
+    }
+    // an exclusive level gives the entry up to the levels above
+    if (level_configs[k].inclusion == TLB_EXCLUSIVE) {
+      (*levels)[k]->remove(entry);
+    }
+    for (size_t j = 0; j < k; j++) {
+      if (level_configs[j].inclusion != TLB_EXCLUSIVE) {
+        level_insert(j, entry);
       }
     }
+    policy_l1_insert(entry);
+    if (classifier != nullptr) {
+      classify_misses(entry, k);
+      classifier->hit(k + 2, entry.process_id, entry.page_size, entry.vpn);
+    }
+    if (k == 0) {
+      L2_hit++;
+    } else {
+      Level_hit[k + 2]++;
+    }
+    return frame_of(entry, virtual_addr);
   }
-  // otherwise, l2 miss, go to page table with virtual addr and get a page table entry
+  // missed everywhere, go to page table with virtual addr and get a page table entry
   TLB_miss++;
-  L1_hit--;
   throw logic_error("TLB miss");
 }
 
+void Tlb::level_insert(size_t k, const TlbEntry& entry) {
+  TlbEntry evicted(0, 0, 0, 0);
+  SIM_EVENT(SIM_EVENT_FILL, k + 2, entry.process_id, entry.vpn, entry.page_size);
+  if (!(*levels)[k]->insert(entry, evicted)) {
+    return;
+  }
+  SIM_EVENT(SIM_EVENT_EVICT, k + 2, evicted.process_id, evicted.vpn, evicted.page_size);
+  if (level_configs[k].inclusion == TLB_INCLUSIVE) {
+    back_invalidate(k, evicted);
+  }
+  // an exclusive level below catches what this one evicts
+  if (k + 1 < levels->size() && level_configs[k + 1].inclusion == TLB_EXCLUSIVE) {
+    level_insert(k + 1, evicted);
+  }
+}
+
+void Tlb::back_invalidate(size_t k, const TlbEntry& entry) {
+  l1_remove(entry.process_id, entry.vpn);
+  for (size_t j = 0; j < k; j++) {
+    (*levels)[j]->remove(entry);
+  }
+}
+
+// pfn is the first 4KB frame of the page, add the 4KB frames before virtual_addr
+uint32_t Tlb::frame_of(const TlbEntry& entry, uint64_t virtual_addr) {
+  return entry.pfn + ((virtual_addr & (entry.page_size - 1)) >> 12);
+}
+
 // upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
-uint32_t Tlb::assemble_physical_addr(TlbEntry tlb_entry, uint32_t virtual_addr) {
+uint64_t Tlb::assemble_physical_addr(TlbEntry tlb_entry, uint64_t virtual_addr) {
   // get the offset length based on page size
   uint32_t page_size = tlb_entry.page_size;
   uint32_t offset_length = log2(page_size);
 
   // get the value of offset
-  uint32_t mask = (1 << offset_length) - 1;
-  uint32_t offset = virtual_addr & mask;
+  uint64_t mask = (uint64_t(1) << offset_length) - 1;
+  uint64_t offset = virtual_addr & mask;
 
   // assembly pfn + offset
   uint32_t pfn = tlb_entry.pfn;
-  uint32_t physical_addr = (pfn << offset_length) | offset;
+  uint64_t physical_addr = (uint64_t(pfn) << offset_length) | offset;
   return physical_addr;
 }
 
@@ -172,33 +426,40 @@ uint32_t Tlb::assemble_physical_addr(TlbEntry tlb_entry, uint32_t virtual_addr)
 int Tlb::l1_insert(TlbEntry entry) {
   if(l1_list->size() < l1_size) {
     l1_list->push_back(entry);
+    l1_index->set(l1_list->size() - 1, entry);
     return -1;
   } else {
     // l1 is full, pick a random one to replace
     int random = random_generator(0, l1_size-1);
+    l1_evicted((*l1_list)[random]);
     (*l1_list)[random] = entry;
+    l1_index->set(random, entry);
     return random;
   }
 }
 
 // TLBs: insert a tlb entry into l1 using FIFO policy
 // return -1 if no replacement occurs, return the replaced index in l1 if replacement occurs.
-int Tlb::l1_insert(TlbEntry entry, int fifo) {
+int Tlb::l1_insert(TlbEntry entry, int /* fifo */) {
   if(l1_list->size() < l1_size) {
     l1_list->push_back(entry);
+    l1_index->set(l1_list->size() - 1, entry);
     return -1;
   } else {
     // l1 is full, kick the first element out
+    l1_evicted(l1_list->front());
     l1_list->erase(l1_list->begin());
     l1_list->push_back(entry);
+    l1_sync();
     return 0; 
   }
 }
 
 // policy: least frequently used
-int Tlb::l1_insert(TlbEntry entry, int lfu1, int lfu2) {
+int Tlb::l1_insert(TlbEntry entry, int /* lfu1 */, int /* lfu2 */) {
   if(l1_list->size() < l1_size) {
     l1_list->push_back(entry);
+    l1_index->set(l1_list->size() - 1, entry);
     return -1;
   } else {
     // l1 is full, kick out the least frequently used entry
@@ -206,155 +467,154 @@ int Tlb::l1_insert(TlbEntry entry, int lfu1, int lfu2) {
         return e1.frequency < e2.frequency;
     });
     // the first one will be the least frequently used after sorting
+    l1_evicted(l1_list->front());
     l1_list->erase(l1_list->begin());
     l1_list->push_back(entry);
+    l1_sync();
     return 0;  
   }
 }
 
 // policy: least recently used
-int Tlb::l1_insert(TlbEntry entry, int lru1, int lru2, int lru3) {
+int Tlb::l1_insert(TlbEntry entry, int /* lru1 */, int /* lru2 */, int /* lru3 */) {
+  entry.stamp = ++l1_clock;
   if(l1_list->size() < l1_size) {
     l1_list->push_back(entry);
+    l1_index->set(l1_list->size() - 1, entry);
     return -1;
   } else {
-    // l1 is full, kick out the least frequently used entry
-    l1_list->erase(l1_list->begin());
+    // l1 is full, kick out the least recently used entry: the smallest stamp, replaced in its slot
+    size_t lru = 0;
+    for (size_t i = 1; i < l1_list->size(); i++) {
+      if ((*l1_list)[i].stamp < (*l1_list)[lru].stamp) {
+        lru = i;
+      }
+    }
+    l1_evicted((*l1_list)[lru]);
+    (*l1_list)[lru] = entry;
+    l1_index->set(lru, entry);
+    return lru;
+  }
+}
+
+// policy: arc, drrip or ship, l1 being a single set of l1_size ways
+int Tlb::l1_insert_adaptive(TlbEntry entry) {
+  l1_replacement->on_miss(0, entry.process_id, entry.vpn, entry.page_size);
+  bool full = l1_list->size() >= l1_size;
+  int replaced;
+  if (!full) {
     l1_list->push_back(entry);
-    return 0;  
+    replaced = l1_list->size() - 1;
+  } else {
+    vector<ReplacementMeta*> metas;
+    for (TlbEntry& e : *l1_list) {
+      metas.push_back(&e.meta);
+    }
+    replaced = l1_replacement->victim(0, metas);
+    TlbEntry& old = (*l1_list)[replaced];
+    l1_replacement->on_evict(0, old.process_id, old.vpn, old.page_size, old.meta);
+    l1_evicted(old);
+    (*l1_list)[replaced] = entry;
   }
+  l1_replacement->on_fill(0, (*l1_list)[replaced].meta);
+  l1_index->set(replaced, entry);
+  return full ? replaced : -1;
 }
 
 
 //flush all
 void Tlb::l1_flush() {
-  while (l1_list->size() != 0) {
-    l1_list->pop_back();
-  }
-}
-
-// default: maximum 256 entries allowed per process
-void Tlb::l2_insert(TlbEntry entry) {
-    // std::find_if() is used for searching a range defined by iterators for the first element that satisfies a specific condition.
-    // check if that process is already in tlb l2 list
-    auto iter = find_if(l2_list->begin(), l2_list->end(), [entry](const vector<TlbEntry>* procTlb) {
-        return !procTlb->empty() && procTlb->back().process_id == entry.process_id;
-    });
-    vector<TlbEntry>* toReplace = nullptr;
-    if (iter == l2_list->end()) {
-        // the process is not in l2 tlb
-        // find the first empty proTlb (sub l2 tlb)
-        auto iter = find_if(l2_list->begin(), l2_list->end(), [](const vector<TlbEntry>* procTlb) {
-            return procTlb->empty();
-        });
-        if (iter == l2_list->end()) {
-            // no empty sub list is found, reached max_process_allowed
-            // pick a random sub list and flush all the enties of that sub list
-            auto idx = random_generator(0, max_process_allowed);
-            toReplace = (*l2_list)[idx];
-            toReplace->clear();
-        } else {
-            // an empty sub list is found
-            toReplace = *iter;
+  SIM_EVENT(SIM_EVENT_FLUSH, l1_level(), 0, 0, 0);
+  auto not_global = [](const TlbEntry& e) { return (e.process_id & TLB_GLOBAL_TAG) == 0; };
+  if (classifier != nullptr) {
+    for_each_l1([this, &not_global]() {
+      for (const TlbEntry& e : *l1_list) {
+        if (not_global(e)) {
+          classifier->flushed(l1_level(), e.process_id, e.page_size, e.vpn);
         }
-    } else {
-      // the process is already in l2 tlb
-        toReplace = *iter;
-    }
-    if (toReplace->size() == l2_size_per_process) {
-      // the sub l2 is already full, pick a random one to replace
-        int idx = random_generator(0, l2_size_per_process);
-        (*toReplace)[idx] = entry;
-    } else {
-      // sub l2 is not null, push back
-        toReplace->push_back(entry);
+      }
+    });
+    // what the victim buffer loses, l1 would have got back
+    for (const TlbEntry& e : *victim_list) {
+      if (not_global(e)) {
+        classifier->flushed(0, e.process_id, e.page_size, e.vpn);
+        classifier->flushed(1, e.process_id, e.page_size, e.vpn);
+      }
     }
+  }
+  for_each_l1([this, &not_global]() {
+    l1_list->erase(remove_if(l1_list->begin(), l1_list->end(), not_global), l1_list->end());
+    l1_sync();
+  });
+  victim_list->erase(remove_if(victim_list->begin(), victim_list->end(), not_global), victim_list->end());
 }
 
-void Tlb::l2_insert(TlbEntry entry, int fifo) {
-    // std::find_if() is used for searching a range defined by iterators for the first element that satisfies a specific condition.
-    // check if that process is already in tlb l2 list
-    auto iter = find_if(l2_list->begin(), l2_list->end(), [entry](const vector<TlbEntry>* procTlb) {
-        return !procTlb->empty() && procTlb->back().process_id == entry.process_id;
-    });
-    vector<TlbEntry>* toReplace = nullptr;
-    if (iter == l2_list->end()) {
-        // the process is not in l2 tlb
-        // find the first empty proTlb (sub l2 tlb)
-        auto iter = find_if(l2_list->begin(), l2_list->end(), [](const vector<TlbEntry>* procTlb) {
-            return procTlb->empty();
-        });
-        if (iter == l2_list->end()) {
-            // no empty sub list is found, reached max_process_allowed
-            // delete the first sub list and insert a new empty sub list at the end
-            delete l2_list->front();
-            l2_list->erase(l2_list->begin());
-            l2_list->push_back(new vector<TlbEntry>());
-            toReplace = l2_list->back();
-        } else {
-            // an empty sub list is found
-            toReplace = *iter;
-        }
-    } else {
-      // the process is already in l2 tlb
-        toReplace = *iter;
-    }
-    if (toReplace->size() == l2_size_per_process) {
-      // the sub l2 is already full, pick the first one to remove, and insert at the end (FIFO)
-        toReplace->erase(toReplace->begin());
-        toReplace->push_back(entry);
-    } else {
-      // sub l2 is not null, push back
-        toReplace->push_back(entry);
+void Tlb::lower_insert(TlbEntry entry) {
+  for (size_t k = 0; k < levels->size(); k++) {
+    if (level_configs[k].inclusion != TLB_EXCLUSIVE) {
+      level_insert(k, entry);
     }
+  }
 }
 
-// int Tlb::replacingPolicy(int size) {
-//     return random_generator(0, l2_size_per_process);
-// }
-
+void Tlb::set_l2_partitioning(bool enabled, uint32_t interval) {
+  SharedL2* l2 = shared_l2();
+  if (l2 != nullptr) {
+    l2->set_partitioning(enabled, interval);
+  }
+}
 
-void Tlb::invalidate_tlb(uint32_t process_id, uint32_t vpn) {
+void Tlb::invalidate_tlb(uint32_t process_id, uint64_t vpn, bool swapped_out) {
+  SIM_EVENT(SIM_EVENT_INVALIDATE, 0, process_id, vpn, 0);
+  if (classifier != nullptr && swapped_out) {
+    classifier->invalidated(process_id, vpn);
+  } else if (classifier != nullptr) {
+    classifier->remapped(process_id, vpn);
+  }
   l1_remove(process_id, vpn);
-  l2_remove(process_id, vpn);
+  for (TlbLevel* level : *levels) {
+    level->invalidate(process_id, vpn);
+  }
   return;
 }
 
-// when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-void Tlb::l1_remove(uint32_t process_id, uint32_t vpn) {
-  for (int i = 0; i < l1_list->size(); i++) {
-    if ( (*l1_list)[i].process_id == process_id ) {
-      if ( (*l1_list)[i].vpn == vpn ) {
-        // remove the tlb entry
-        l1_list->erase(l1_list->begin() + i);
-        return;
-      }
-    }
-    else {
-      // process not match
-      return;
-    }
+void Tlb::flush_process(uint32_t process_id) {
+  SIM_EVENT(SIM_EVENT_FLUSH, 0, process_id, 0, 0);
+  for_each_l1([this, process_id]() {
+    l1_list->erase(remove_if(l1_list->begin(), l1_list->end(), [process_id](const TlbEntry& e) {
+        return e.process_id == process_id;
+    }), l1_list->end());
+    l1_sync();
+  });
+  victim_list->erase(remove_if(victim_list->begin(), victim_list->end(), [process_id](const TlbEntry& e) {
+      return e.process_id == process_id;
+  }), victim_list->end());
+  for (TlbLevel* level : *levels) {
+    level->flush_process(process_id);
   }
 }
 
 // when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-void Tlb::l2_remove(uint32_t process_id, uint32_t vpn) {
-  // check if process is in l2 
-  for (int i = 0; i < l2_list->size(); i++) {
-    vector<TlbEntry>* sub_process = (*l2_list)[i];
-    if (!sub_process->empty()) {
-      if (sub_process->back().process_id == process_id) {
-        for (int j = 0; j < sub_process->size(); j++) {
-          if ((*sub_process)[j].vpn == vpn) {
-            sub_process->erase(sub_process->begin() + j);
-            return;
-          }
+void Tlb::l1_remove(uint32_t process_id, uint64_t vpn) {
+  victim_list->erase(remove_if(victim_list->begin(), victim_list->end(), [process_id, vpn](const TlbEntry& e) {
+      return e.process_id == process_id && e.vpn == vpn;
+  }), victim_list->end());
+  for_each_l1([this, process_id, vpn]() {
+    for (size_t i = 0; i < l1_list->size(); i++) {
+      if ( (*l1_list)[i].process_id == process_id ) {
+        if ( (*l1_list)[i].vpn == vpn ) {
+          // remove the tlb entry
+          l1_list->erase(l1_list->begin() + i);
+          l1_sync();
+          return;
         }
       }
     }
-  }
-  // otherwise, process not in l2 or process_id not found
-  return;
+  });
+}
+
+void Tlb::l1_sync() {
+  l1_index->rebuild(*l1_list);
 }
 
 int Tlb::random_generator(uint32_t start, uint32_t end) {
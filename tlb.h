@@ -7,25 +7,34 @@
 #include <random>
 #include <ctime>
 #include <cmath>
+#include <string>
+#include "tlb-simd.h"
+#include "tlb-level.h"
+#include "tlb-l2.h"
+#include "tlb-miss.h"
 
 using namespace std;
 
-extern int L1_hit;
-extern int L2_hit;
-extern int TLB_miss;
+extern thread_local int L1_hit;
+extern thread_local int L2_hit;
+extern thread_local int TLB_miss;
+extern thread_local int Victim_hit;
+// hits in levels 3 and below, indexed by level (levels 1 and 2 count in L1_hit and L2_hit)
+extern thread_local int Level_hit[TLB_MAX_LEVELS + 1];
 
 class TlbEntry {
 public:
   uint32_t process_id; // get it from page table entry obj
   uint32_t page_size;  // different page has different sizes, get it from page table entry obj
                        // set mask according to page_size
-  uint32_t vpn;
+  uint64_t vpn;
   uint32_t pfn;
-  uint32_t reference;  // only needed in LRU replacement policy
+  uint64_t stamp;      // lru l1: when the entry was filled or last hit, the smallest is evicted
   uint32_t frequency;
+  ReplacementMeta meta;  // adaptive l1 policies only
 
   // constructor
-  TlbEntry(uint32_t process_id, uint32_t page_size, uint32_t vpn, uint32_t pfn);
+  TlbEntry(uint32_t process_id, uint32_t page_size, uint64_t vpn, uint32_t pfn);
 };
 
 class PTEntry {
@@ -36,35 +45,78 @@ public:
   PTEntry(uint32_t page_size, uint32_t pfn);
 };
 
-//two-level tlb
+// tlb hierarchy: l1, an optional victim buffer, then any number of lower levels
 class Tlb {
 public:
   vector<TlbEntry>* l1_list;
-  vector<vector<TlbEntry>*>* l2_list;   
+  L1SearchIndex* l1_index;   // SoA mirror of l1_list for the lookup, slot i == (*l1_list)[i]
+  vector<TlbEntry>* victim_list;   // victim buffer: l1 evictions, oldest first, probed before l2
+  vector<TlbLevel*>* levels;       // below l1, (*levels)[0] is l2; entries tagged with pid
+  vector<TlbLevelConfig> level_configs;
   uint32_t l1_size;
-  uint32_t l2_size;
-  uint32_t max_process_allowed; // max number of processes that can exist in l2, default 4
-  uint32_t l2_size_per_process; // default 1024/4 = 256
-
-  // constructor
-	Tlb(uint32_t l1_size, uint32_t l2_size, uint32_t max_process_allowed);
+  uint32_t l2_size;      // 0: l1 only
+  uint32_t victim_size;  // 0: no victim buffer
+  TlbPolicy l1_policy;
+  AdaptiveReplacement* l1_replacement;   // l1 as a single set when l1_policy is adaptive, else null
+  uint64_t l1_clock;     // lru l1 stamps: a hit restamps its slot in place, so the index stays as it is
+
+  // split l1: an instruction TLB next to the data TLB, both in front of the same lower levels.
+  // The l1_* members always hold the side in use, idle_l1_* the other one (null when l1 is unified)
+  bool split_l1;
+  bool itlb_active;
+  vector<TlbEntry>* idle_l1_list;
+  L1SearchIndex* idle_l1_index;
+  uint32_t idle_l1_size;
+  TlbPolicy idle_l1_policy;
+  AdaptiveReplacement* idle_l1_replacement;
+
+  TlbMissClassifier* classifier;   // null unless miss classification is on
+
+  // constructor: l1 plus, unless l2_size is 0, a fully-associative lru l2 (nine)
+	Tlb(uint32_t l1_size, uint32_t l2_size);
+
+  // deep copy, used to snapshot the os for parallel simulation
+  Tlb(const Tlb& other);
+  Tlb& operator=(const Tlb& other) = delete;
 
   // destructor
   ~Tlb();
 
+  // drop every entry and resize l1 and l2 (l2_size 0: l1 only), l1 goes back to unified
+  void reconfigure(uint32_t l1_size, uint32_t l2_size);
+  // give code its own itlb_size-entry l1 with its own policy (0: unified l1); the current l1 becomes the dTLB
+  void set_split_l1(uint32_t itlb_size, TlbPolicy itlb_policy);
+  // make the instruction or the data side the l1 that look_up and l1_insert use (no-op when unified)
+  void select_l1(bool instruction);
+  // drop every entry below l1 and rebuild the lower levels, l2 first
+  void configure_levels(const vector<TlbLevelConfig>& configs);
+  // l2 if it is the shared fully-associative lru kind (the one that can be partitioned), else nullptr
+  SharedL2* shared_l2() const;
+  void set_l1_policy(TlbPolicy policy);
+  // fully-associative fifo buffer catching l1 evictions; a hit swaps the entry back into l1
+  void set_victim_size(uint32_t size);
+  // classify every miss of every level into Miss_classes; kept across reconfigurations, which start it afresh
+  void set_miss_classification(bool enabled);
+
   // pfn and page_size is obtained from page table entry obj
-  TlbEntry create_tlb_entry(uint32_t pfn, uint32_t page_size, uint32_t virtual_addr, uint32_t process_id);
+  TlbEntry create_tlb_entry(uint32_t pfn, uint32_t page_size, uint64_t virtual_addr, uint32_t process_id);
+  // the 4KB frame of entry's page holding virtual_addr
+  static uint32_t frame_of(const TlbEntry& entry, uint64_t virtual_addr);
 
-  // look_up(): given a virtual addr, look it up in both l1 and l2
-  // return pfn if found, -1 if miss
-  int look_up(uint32_t virtual_addr, uint32_t process_id);
+  // look_up(): given a virtual addr, look it up in l1, the victim buffer and the lower levels
+  // return the 4KB frame holding virtual_addr if found, throw on a miss
+  int look_up(uint64_t virtual_addr, uint32_t process_id);
 
   // the following look up helps implementing lru policy
-  int look_up(uint32_t virtual_addr, uint32_t process_id, int lru);
+  int look_up(uint64_t virtual_addr, uint32_t process_id, int lru);
+
+  // look_up()/l1_insert() with the overload l1_policy selects
+  int policy_look_up(uint64_t virtual_addr, uint32_t process_id);
+  int policy_l1_insert(TlbEntry entry);
 
 
   // upon TLB hit, assemble physical address: use pfn and offset to form a physicai address
-  uint32_t assemble_physical_addr(TlbEntry tlb_entry, uint32_t virtual_addr);
+  uint64_t assemble_physical_addr(TlbEntry tlb_entry, uint64_t virtual_addr);
 
   // TLBs: insert a tlb entry into l1, random policy
   // return -1 if no replacement occurs, return the replaced index in l1 if replacement occurs.
@@ -75,26 +127,58 @@ public:
   int l1_insert(TlbEntry entry, int lfu1, int lfu2);
     // the following l1_insert() implememts a lru policy.
   int l1_insert(TlbEntry entry, int lru1, int lru2, int lru3);
+  // arc, drrip or ship, through l1_replacement
+  int l1_insert_adaptive(TlbEntry entry);
 
-  //flush all
+  //flush all but the global entries (TLB_GLOBAL_TAG)
   void l1_flush();
   
-  // default: maximum 256 entries allowed per process
-  // random policy
-  void l2_insert(TlbEntry entry);
-  // the following l2_insert() implememts a fifo policy. When calling the method, the parameter fifo can be any number (it's added only for method overloading)
-  void l2_insert(TlbEntry entry, int fifo);
+  // fill the lower levels after a page walk (all but the exclusive ones)
+  void lower_insert(TlbEntry entry);
+  // a page walk resolved a miss at every level with this entry (for miss classification)
+  void record_walk(const TlbEntry& entry);
 
-  void invalidate_tlb(uint32_t process_id, uint32_t vpn);
+  // repartition l2 every interval l2 lookups from per-pid shadow tags, or go back to plain shared LRU
+  void set_l2_partitioning(bool enabled, uint32_t interval);
+
+  // swapped_out: the page went to disk, anything else (free, migration, copy-on-write, promotion) remapped it
+  void invalidate_tlb(uint32_t process_id, uint64_t vpn, bool swapped_out = false);
+
+  // drop every entry of a process at every level, used when the process exits
+  void flush_process(uint32_t process_id);
 
 private:
   // when a page is swapped out from RAM, delete (invalidate) the corresponding tlb entry
-  void l1_remove(uint32_t process_id, uint32_t vpn);
-
-  void l2_remove(uint32_t process_id, uint32_t vpn);
+  void l1_remove(uint32_t process_id, uint64_t vpn);
 
   int random_generator(uint32_t start, uint32_t end);
 
+  // an entry evicted from l1 goes to the victim buffer if there is one, and what leaves the
+  // l1 side goes on to l2 if l2 is exclusive
+  void l1_evicted(const TlbEntry& entry);
+  void victim_insert(const TlbEntry& entry);
+  // on a victim buffer hit, move the entry back into l1 and return true
+  bool victim_look_up(uint64_t virtual_addr, uint32_t process_id, TlbEntry& found);
+
+  // probe the lower levels after an l1 and victim buffer miss, throw if they miss too
+  int lower_look_up(uint64_t virtual_addr, uint32_t process_id);
+  // insert into lower level k and handle what it evicts
+  void level_insert(size_t k, const TlbEntry& entry);
+  // an inclusive level k evicted entry: drop it from every level above
+  void back_invalidate(size_t k, const TlbEntry& entry);
+
+  // rebuild l1_index after l1_list was reordered or shrunk
+  void l1_sync();
+
+  // level of the l1 side in use for the miss classifier: 0 for the iTLB, else 1
+  int l1_level() const;
+  // count misses in l1 and the first missed_levels lower levels for entry
+  void classify_misses(const TlbEntry& entry, size_t missed_levels);
+
+  void swap_l1_sides();
+  // run f on l1, and on the idle side as well when l1 is split
+  template <typename F> void for_each_l1(F f);
+
   //int replacingPolicy(int size);
 };
 
@@ -0,0 +1,37 @@
+// trace-op.h
+#ifndef TRACE_OP_H
+#define TRACE_OP_H
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// trace instructions as numbers, for the batched entry points (same numbering as vmsim_op in vmsim.h)
+enum TraceOp : uint8_t {
+    OP_SWITCH = 0,
+    OP_ALLOC = 1,
+    OP_FREE = 2,
+    OP_ACCESS_CODE = 3,
+    OP_ACCESS_STACK = 4,
+    OP_ACCESS_HEAP = 5,
+    OP_EXIT = 6,
+    OP_FORK = 7,        // value: the child's pid (decimal)
+    OP_UNKNOWN = 255
+};
+
+// one decoded trace event, 16 bytes
+struct PackedEvent {
+    uint64_t value;
+    uint32_t pid;
+    TraceOp op;
+};
+
+// "access_stak" -> OP_ACCESS_STACK, ...; OP_UNKNOWN for anything else
+TraceOp traceOpFromString(const string& instruction);
+
+inline bool isAccessOp(TraceOp op) {
+    return op == OP_ACCESS_CODE || op == OP_ACCESS_STACK || op == OP_ACCESS_HEAP;
+}
+
+#endif // TRACE_OP_H
@@ -0,0 +1,106 @@
+#include "trace.h"
+#include "os.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+using namespace std;
+
+bool parseTraceLine(const string& line, TraceEvent& event) {
+    istringstream iss(line);
+    event.pid = 0;
+    event.instruction.clear();
+    event.value = 0;
+
+    iss >> event.pid >> event.instruction;
+    if (event.instruction == "switch" || event.instruction == "exit") {
+        return true;
+    }
+    // a fork names the child pid, in decimal like the pid column
+    if (event.instruction == "fork" ? !(iss >> event.value) : !(iss >> hex >> event.value)) {
+        cerr << "Error parsing value for instruction: " << event.instruction << endl;
+        return false;
+    }
+    return true;
+}
+
+vector<TraceEvent> loadTrace(const string& path) {
+    ifstream inputFile(path);
+    if (!inputFile) {
+        throw runtime_error("Unable to open file " + path);
+    }
+
+    vector<TraceEvent> events;
+    string line;
+    TraceEvent event;
+    while (getline(inputFile, line)) {
+        if (parseTraceLine(line, event)) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+bool packTraceLine(const string& line, PackedEvent& event) {
+    const char* p = line.c_str();
+    char* end;
+    event.pid = strtoul(p, &end, 10);
+    p = end;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    const char* name = p;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\r') {
+        p++;
+    }
+    string instruction(name, p - name);
+    event.op = traceOpFromString(instruction);
+    event.value = 0;
+    if (event.op == OP_UNKNOWN) {
+        return false;
+    }
+    if (event.op == OP_SWITCH || event.op == OP_EXIT) {
+        return true;
+    }
+    event.value = strtoull(p, &end, event.op == OP_FORK ? 10 : 16);
+    if (end == p) {
+        cerr << "Error parsing value for instruction: " << instruction << endl;
+        return false;
+    }
+    return true;
+}
+
+void streamTrace(istream& input, size_t chunk, const function<void(const vector<PackedEvent>&)>& consume) {
+    auto decode = [&input, chunk](vector<PackedEvent>& out) {
+        out.clear();
+        string line;
+        PackedEvent event;
+        while (out.size() < chunk && getline(input, line)) {
+            if (packTraceLine(line, event)) {
+                out.push_back(event);
+            }
+        }
+        return !out.empty();
+    };
+
+    vector<PackedEvent> current, next;
+    bool more = decode(current);
+    while (more) {
+        auto pending = async(launch::async, decode, ref(next));
+        consume(current);
+        more = pending.get();
+        swap(current, next);
+    }
+}
+
+bool isAccessInstruction(const string& instruction) {
+    return instruction == "access_code" || instruction == "access_stak" || instruction == "access_heap";
+}
+
+void applyEvent(os& osInstance, const TraceEvent& event) {
+    osInstance.handleInstruction(event.instruction, event.value, event.pid);
+}
@@ -0,0 +1,46 @@
+// trace.h
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "trace-op.h"
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class os;
+
+/**
+ * One line of a trace file: "<pid> <instruction> [hex value]".
+ * switch and exit lines carry no value.
+ */
+struct TraceEvent {
+    uint32_t pid;
+    string instruction;
+    uint64_t value;
+};
+
+// parse a trace line, return false (and report to cerr) if the value of an instruction is malformed
+bool parseTraceLine(const string& line, TraceEvent& event);
+
+// read a whole trace file into memory, malformed lines are skipped
+vector<TraceEvent> loadTrace(const string& path);
+
+// accesses only touch the TLB, everything else changes page table / allocator state
+bool isAccessInstruction(const string& instruction);
+
+// parse a trace line straight into a packed event (no stream or string allocation), same rules as parseTraceLine;
+// returns false for malformed lines and unknown instructions
+bool packTraceLine(const string& line, PackedEvent& event);
+
+// decode the trace in chunks of `chunk` events on a helper thread, one chunk ahead of consume,
+// so that parsing overlaps with simulating the previous chunk
+void streamTrace(istream& input, size_t chunk, const function<void(const vector<PackedEvent>&)>& consume);
+
+// feed one event to the os, the same way the sequential driver does
+void applyEvent(os& osInstance, const TraceEvent& event);
+
+#endif // TRACE_H
@@ -0,0 +1,261 @@
+#include "tuner.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+
+string TunerConfig::options() const {
+    ostringstream ret;
+    ret << "--l1-size " << l1Size;
+    // a fully-associative lru l2 is what --l2-size builds, anything else needs the full level spec
+    if (l2Size > 0 && (l2Ways != 0 || l2Policy != TLB_LRU)) {
+        ret << " --tlb-level " << tlb_level_spec(levels()[0]);
+    } else {
+        ret << " --l2-size " << l2Size;
+    }
+    ret << " --l1-policy " << tlb_policy_name(policy);
+    if (victimSize > 0) {
+        ret << " --victim " << victimSize;
+    }
+    if (itlbSize > 0) {
+        ret << " --itlb-size " << itlbSize << " --itlb-policy " << tlb_policy_name(policy);
+    }
+    if (asidTagging) {
+        ret << " --asid";
+    }
+    if (smallPagesOnly) {
+        ret << " --small-pages";
+    }
+    return ret.str();
+}
+
+vector<TlbLevelConfig> TunerConfig::levels() const {
+    vector<TlbLevelConfig> ret;
+    if (l2Size > 0) {
+        ret.push_back(TlbLevelConfig{l2Size, l2Ways, l2Policy, TLB_NINE});
+    }
+    return ret;
+}
+
+static bool dominates(const TunerCandidate& a, const TunerCandidate& b) {
+    uint32_t ea = a.config.entries(), eb = b.config.entries();
+    double ha = a.stats.tlbHitRate(), hb = b.stats.tlbHitRate();
+    return ea <= eb && ha >= hb && (ea < eb || ha > hb);
+}
+
+// non-dominated sorting: rank 0 is the Pareto frontier, rank 1 the frontier once rank 0 is removed, ...
+static vector<size_t> paretoRanks(const vector<TunerCandidate>& candidates, const vector<size_t>& ids) {
+    vector<size_t> rank(ids.size(), SIZE_MAX);
+    size_t assigned = 0;
+    for (size_t level = 0; assigned < ids.size(); level++) {
+        vector<size_t> front;
+        for (size_t i = 0; i < ids.size(); i++) {
+            if (rank[i] != SIZE_MAX) {
+                continue;
+            }
+            bool dominated = false;
+            for (size_t j = 0; j < ids.size() && !dominated; j++) {
+                dominated = j != i && rank[j] == SIZE_MAX && dominates(candidates[ids[j]], candidates[ids[i]]);
+            }
+            if (!dominated) {
+                front.push_back(i);
+            }
+        }
+        for (size_t i : front) {
+            rank[i] = level;
+        }
+        assigned += front.size();
+    }
+    return rank;
+}
+
+// simulate every listed candidate on the first prefix[t] events of every trace
+static void evaluate(const os& initial, const vector<vector<TraceEvent> >& traces, const vector<size_t>& prefix,
+                     vector<TunerCandidate>& candidates, const vector<size_t>& ids, size_t threads) {
+    size_t jobs = ids.size() * traces.size();
+    vector<SimStats> results(jobs);
+    vector<exception_ptr> errors(jobs);
+    atomic<size_t> next(0);
+
+    auto worker = [&]() {
+        for (size_t job = next++; job < jobs; job = next++) {
+            const TunerConfig& config = candidates[ids[job / traces.size()]].config;
+            size_t t = job % traces.size();
+            try {
+                os sim(initial);
+                sim.getTlb().reconfigure(config.l1Size, 0);
+                sim.getTlb().configure_levels(config.levels());
+                sim.getTlb().set_l1_policy(config.policy);
+                sim.getTlb().set_victim_size(config.victimSize);
+                sim.getTlb().set_split_l1(config.itlbSize, config.policy);
+                sim.setAsidTagging(config.asidTagging);
+                sim.setSmallPagesOnly(config.smallPagesOnly);
+                resetStats();
+                for (size_t i = 0; i < prefix[t]; i++) {
+                    applyEvent(sim, traces[t][i]);
+                }
+                results[job] = collectStats();
+            } catch (...) {
+                errors[job] = current_exception();
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (size_t k = 0; k < min(threads, jobs); k++) {
+        workers.emplace_back(worker);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    for (const auto& e : errors) {
+        if (e) {
+            rethrow_exception(e);
+        }
+    }
+
+    for (size_t c = 0; c < ids.size(); c++) {
+        SimStats sum;
+        for (size_t t = 0; t < traces.size(); t++) {
+            sum.add(results[c * traces.size() + t]);
+        }
+        candidates[ids[c]].stats = sum;
+    }
+}
+
+TunerResult autoTune(const os& initial, const vector<vector<TraceEvent> >& traces, const TunerGrid& grid,
+                     const TunerOptions& options) {
+    TunerResult result;
+    for (uint32_t l1 : grid.l1Sizes)
+        for (uint32_t l2 : grid.l2Sizes)
+            for (uint32_t ways : grid.l2Ways)
+                for (TlbPolicy l2Policy : grid.l2Policies)
+                    for (uint32_t victim : grid.victimSizes)
+                        for (uint32_t itlb : grid.itlbSizes)
+                            for (TlbPolicy policy : grid.policies)
+                                for (bool asid : grid.asidTagging)
+                                    for (bool small : grid.smallPagesOnly) {
+                                        // without an l2 its shape does not matter, so only the first one is a candidate
+                                        if (l2 == 0 && (ways != grid.l2Ways[0] || l2Policy != grid.l2Policies[0])) {
+                                            continue;
+                                        }
+                                        // an l2 that does not split into whole sets of this many ways
+                                        if (ways != 0 && l2 % ways != 0) {
+                                            continue;
+                                        }
+                                        TunerCandidate c;
+                                        c.config = TunerConfig{l1, l2, ways, l2Policy, victim, itlb, policy, asid, small};
+                                        if (options.entryBudget == 0 || c.config.entries() <= options.entryBudget) {
+                                            result.candidates.push_back(c);
+                                        }
+                                    }
+    if (result.candidates.empty() || traces.empty()) {
+        return result;
+    }
+
+    size_t eta = max<size_t>(options.eta, 2);
+    size_t threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+    size_t totalRounds = 1;
+    for (size_t n = result.candidates.size(); n > 1; n = (n + eta - 1) / eta) {
+        totalRounds++;
+    }
+
+    vector<size_t> survivors(result.candidates.size());
+    for (size_t i = 0; i < survivors.size(); i++) {
+        survivors[i] = i;
+    }
+
+    for (size_t r = 0; r < totalRounds; r++) {
+        bool last = r + 1 == totalRounds;
+        double fraction = last ? 1.0 : pow(double(eta), -double(totalRounds - 1 - r));
+        vector<size_t> prefix;
+        for (const auto& trace : traces) {
+            size_t n = max<size_t>(options.minPrefix, size_t(ceil(trace.size() * fraction)));
+            prefix.push_back(min(n, trace.size()));
+        }
+        size_t events = 0, full = 0;
+        for (size_t t = 0; t < traces.size(); t++) {
+            events += prefix[t];
+            full += traces[t].size();
+        }
+        // short traces: the prefix already is the whole trace, so this is the final round
+        if (events == full) {
+            last = true;
+            fraction = 1.0;
+        }
+        evaluate(initial, traces, prefix, result.candidates, survivors, threads);
+        for (size_t id : survivors) {
+            result.candidates[id].rounds++;
+        }
+
+        if (last) {
+            for (size_t id : survivors) {
+                result.candidates[id].fullRun = true;
+            }
+            auto rank = paretoRanks(result.candidates, survivors);
+            for (size_t i = 0; i < survivors.size(); i++) {
+                result.candidates[survivors[i]].pareto = rank[i] == 0;
+            }
+            result.rounds.push_back(TunerRound{survivors.size(), fraction, events, survivors.size()});
+            break;
+        }
+
+        // keep whole Pareto fronts, best first, until 1/eta of the candidates are kept
+        auto rank = paretoRanks(result.candidates, survivors);
+        vector<size_t> order(survivors.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return rank[a] < rank[b]; });
+        size_t target = (survivors.size() + eta - 1) / eta;
+        vector<size_t> kept;
+        for (size_t i = 0; i < order.size(); i++) {
+            if (kept.size() >= target && rank[order[i]] != rank[order[i - 1]]) {
+                break;
+            }
+            kept.push_back(survivors[order[i]]);
+        }
+        result.rounds.push_back(TunerRound{survivors.size(), fraction, events, kept.size()});
+
+        // nothing left to prune without losing part of the frontier: go straight to the full run
+        if (kept.size() == survivors.size()) {
+            r = totalRounds - 2;
+        }
+        survivors = kept;
+    }
+    return result;
+}
+
+void printTunerReport(const TunerResult& result, ostream& out) {
+    out << "Tuner: " << result.candidates.size() << " configurations" << endl;
+    for (size_t r = 0; r < result.rounds.size(); r++) {
+        const auto& round = result.rounds[r];
+        out << "Round " << r << ": " << round.candidates << " configurations on " << round.events
+            << " events (" << round.prefixFraction * 100 << "% of each trace), kept " << round.kept << endl;
+    }
+
+    vector<const TunerCandidate*> frontier;
+    for (const auto& c : result.candidates) {
+        if (c.pareto) {
+            frontier.push_back(&c);
+        }
+    }
+    sort(frontier.begin(), frontier.end(), [](const TunerCandidate* a, const TunerCandidate* b) {
+        return a->config.entries() < b->config.entries();
+    });
+
+    out << "Pareto frontier (TLB hit rate vs TLB entries):" << endl;
+    out << left << setw(10) << "entries" << setw(12) << "hit rate" << "options" << endl;
+    for (const auto* c : frontier) {
+        out << left << setw(10) << c->config.entries() << setw(12) << c->stats.tlbHitRate()
+            << c->config.options() << endl;
+    }
+    out << right;
+}
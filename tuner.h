@@ -0,0 +1,85 @@
+// tuner.h
+#ifndef TUNER_H
+#define TUNER_H
+
+#include "os.h"
+#include "stats.h"
+#include "tlb-level.h"
+#include "trace.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * TLB configuration auto-tuner.
+ * Every combination of the grid is a candidate. Candidates go through successive halving:
+ * each round simulates the survivors on a prefix of every trace (the prefix grows by eta each
+ * round, the last round runs the full traces) and keeps the best 1/eta by Pareto rank of
+ * TLB hit rate against TLB entries. Simulations run in parallel, one os copy per (candidate, trace).
+ */
+struct TunerConfig {
+    uint32_t l1Size;
+    uint32_t l2Size;
+    uint32_t l2Ways;        // 0: fully associative
+    TlbPolicy l2Policy;
+    uint32_t victimSize;
+    uint32_t itlbSize;      // 0: unified l1, else l1Size is the dTLB (the iTLB uses the same policy)
+    TlbPolicy policy;
+    bool asidTagging;
+    bool smallPagesOnly;
+
+    uint32_t entries() const { return l1Size + l2Size + victimSize + itlbSize; }
+    // the command line options that reproduce this configuration
+    string options() const;
+    // the lower levels to build under l1, empty without an l2
+    vector<TlbLevelConfig> levels() const;
+};
+
+struct TunerGrid {
+    vector<uint32_t> l1Sizes = {16, 32, 64, 128, 256};
+    vector<uint32_t> l2Sizes = {0};
+    vector<uint32_t> l2Ways = {0};
+    vector<TlbPolicy> l2Policies = {TLB_LRU};
+    vector<uint32_t> victimSizes = {0};
+    vector<uint32_t> itlbSizes = {0};
+    vector<TlbPolicy> policies = {TLB_RANDOM, TLB_FIFO, TLB_LFU, TLB_LRU};
+    vector<bool> asidTagging = {false, true};
+    vector<bool> smallPagesOnly = {false};
+};
+
+struct TunerOptions {
+    size_t entryBudget = 0;   // skip configurations with more TLB entries, 0 for no limit
+    size_t eta = 2;           // keep 1/eta of the candidates per round
+    size_t minPrefix = 20000; // never prune on fewer events per trace than this
+    size_t threads = 0;       // 0 for one per hardware thread
+};
+
+struct TunerCandidate {
+    TunerConfig config;
+    SimStats stats;        // summed over the traces, from the last round it ran in
+    size_t rounds = 0;     // rounds survived
+    bool fullRun = false;  // reached the final round on the full traces
+    bool pareto = false;
+};
+
+struct TunerRound {
+    size_t candidates;
+    double prefixFraction;
+    size_t events;      // events simulated per candidate, summed over the traces
+    size_t kept;
+};
+
+struct TunerResult {
+    vector<TunerCandidate> candidates;
+    vector<TunerRound> rounds;
+};
+
+TunerResult autoTune(const os& initial, const vector<vector<TraceEvent> >& traces, const TunerGrid& grid,
+                     const TunerOptions& options);
+
+// rounds, then the Pareto frontier of the full runs
+void printTunerReport(const TunerResult& result, ostream& out = cout);
+
+#endif // TUNER_H
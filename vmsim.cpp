@@ -0,0 +1,321 @@
+#include "vmsim.h"
+#include "os.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+// the simulator counters are thread_local globals: every call starts from zero and moves what
+// it counted into the instance, so instances and threads can be interleaved freely
+struct vmsim {
+    os sim;
+    SimStats stats;
+    string error;
+
+    vmsim(uint64_t memorySize, uint64_t diskSize, uint32_t highWatermark, uint32_t lowWatermark)
+        : sim(memorySize, diskSize, highWatermark, lowWatermark) {}
+};
+
+static_assert(sizeof(vmsim_event) == sizeof(PackedEvent) && offsetof(vmsim_event, op) == offsetof(PackedEvent, op),
+              "vmsim_event must match PackedEvent");
+static_assert(int(VMSIM_ACCESS_HEAP) == int(OP_ACCESS_HEAP) && int(VMSIM_FORK) == int(OP_FORK),
+              "vmsim_op must match TraceOp");
+
+// events packed per chunk from the parallel arrays of vmsim_run
+static const size_t PACK_CHUNK = 4096;
+
+namespace {
+// collects the counters of one API call into the instance
+class CountingScope {
+public:
+    explicit CountingScope(vmsim* sim) : sim(sim) { resetStats(); }
+    ~CountingScope() {
+        sim->stats.add(collectStats());
+        resetStats();
+    }
+
+private:
+    vmsim* sim;
+};
+}
+
+extern "C" {
+
+vmsim* vmsim_create(uint64_t memory_size, uint64_t disk_size, uint32_t high_watermark, uint32_t low_watermark) {
+    try {
+        return new vmsim(memory_size, disk_size, high_watermark, low_watermark);
+    } catch (const exception& e) {
+        return nullptr;
+    }
+}
+
+void vmsim_destroy(vmsim* sim) {
+    delete sim;
+}
+
+int vmsim_configure_tlb(vmsim* sim, uint32_t l1_size, uint32_t l2_size, const char* policy, int asid_tagging,
+                        int small_pages_only) {
+    TlbPolicy l1Policy;
+    if (l1_size == 0 || policy == nullptr || !parse_tlb_policy(policy, l1Policy)) {
+        sim->error = "invalid TLB configuration";
+        return -1;
+    }
+    sim->sim.getTlb().reconfigure(l1_size, l2_size);
+    sim->sim.getTlb().set_l1_policy(l1Policy);
+    sim->sim.setAsidTagging(asid_tagging != 0);
+    sim->sim.setSmallPagesOnly(small_pages_only != 0);
+    sim->error.clear();
+    return 0;
+}
+
+// run packed events through os::runBatch up to the first bad op or failing event;
+// offset is the index of events[0] in the caller's array, for the error message
+static size_t runPacked(vmsim* sim, const PackedEvent* events, size_t n, uint64_t* physical, size_t offset) {
+    size_t valid = 0;
+    while (valid < n && events[valid].op <= OP_FORK) {
+        valid++;
+    }
+    size_t done = 0;
+    try {
+        sim->sim.runBatch(events, valid, physical, &done);
+    } catch (const exception& e) {
+        sim->error = string(e.what()) + " at event " + to_string(offset + done);
+        return done;
+    }
+    if (valid < n) {
+        sim->error = "unknown op " + to_string(int(events[valid].op)) + " at event " + to_string(offset + valid);
+    }
+    return valid;
+}
+
+int vmsim_configure_numa(vmsim* sim, uint32_t nodes, const char* policy, uint32_t local_ns, uint32_t remote_ns) {
+    try {
+        NumaConfig config;
+        parseNumaPolicy(policy == nullptr ? "first-touch" : policy, config);
+        config.localLatency = local_ns;
+        config.remoteLatency = remote_ns;
+        // nothing is allocated yet, so all of memory is free
+        config.nodeSizes = numaNodeSizes(sim->sim.freeMemorySize(), nodes == 0 ? 1 : nodes, "");
+        sim->sim.setNuma(config);
+    } catch (const exception& e) {
+        sim->error = string("invalid NUMA configuration: ") + e.what();
+        return -1;
+    }
+    sim->error.clear();
+    return 0;
+}
+
+int vmsim_configure_address_bits(vmsim* sim, int va_bits) {
+    try {
+        sim->sim.setAddressBits(va_bits);
+    } catch (const exception& e) {
+        sim->error = string("invalid address width: ") + e.what();
+        return -1;
+    }
+    sim->error.clear();
+    return 0;
+}
+
+int vmsim_configure_itlb(vmsim* sim, uint32_t entries, const char* policy) {
+    TlbPolicy itlbPolicy;
+    if (policy == nullptr || !parse_tlb_policy(policy, itlbPolicy)) {
+        sim->error = "invalid iTLB policy";
+        return -1;
+    }
+    sim->sim.getTlb().set_split_l1(entries, itlbPolicy);
+    sim->error.clear();
+    return 0;
+}
+
+int vmsim_configure_timing(vmsim* sim, uint32_t width, uint32_t walkers, uint32_t mshrs, uint32_t hit_cycles,
+                           uint32_t lower_hit_cycles, uint32_t cache_cycles, uint32_t memory_cycles) {
+    if (width > 0 && (walkers == 0 || mshrs == 0)) {
+        sim->error = "walkers and miss-status entries must be positive";
+        return -1;
+    }
+    TimingConfig config;
+    config.width = width;
+    config.walkers = walkers;
+    config.mshrs = mshrs;
+    config.hitCycles = hit_cycles;
+    config.lowerHitCycles = lower_hit_cycles;
+    config.cacheCycles = cache_cycles;
+    config.memoryCycles = memory_cycles;
+    sim->sim.setTiming(config);
+    sim->error.clear();
+    return 0;
+}
+
+void vmsim_classify_misses(vmsim* sim, int enabled) {
+    sim->sim.getTlb().set_miss_classification(enabled != 0);
+}
+
+void vmsim_configure_victim(vmsim* sim, uint32_t entries) {
+    sim->sim.getTlb().set_victim_size(entries);
+}
+
+int vmsim_configure_levels(vmsim* sim, const char* specs) {
+    vector<TlbLevelConfig> levels;
+    try {
+        stringstream in(specs == nullptr ? "" : specs);
+        string spec;
+        while (getline(in, spec, ',')) {
+            levels.push_back(parse_tlb_level(spec));
+        }
+    } catch (const exception& e) {
+        sim->error = string("invalid TLB level: ") + e.what();
+        return -1;
+    }
+    if (levels.size() + 1 > TLB_MAX_LEVELS) {
+        sim->error = "too many TLB levels";
+        return -1;
+    }
+    sim->sim.getTlb().configure_levels(levels);
+    sim->error.clear();
+    return 0;
+}
+
+int vmsim_configure_caches(vmsim* sim, const char* specs) {
+    vector<CacheConfig> levels;
+    try {
+        stringstream in(specs == nullptr ? "" : specs);
+        string spec;
+        while (getline(in, spec, ',')) {
+            levels.push_back(parseCacheLevel(spec));
+        }
+        sim->sim.setCaches(levels);
+    } catch (const exception& e) {
+        sim->error = string("invalid cache level: ") + e.what();
+        return -1;
+    }
+    sim->error.clear();
+    return 0;
+}
+
+size_t vmsim_run(vmsim* sim, const uint32_t* pids, const uint8_t* ops, const uint64_t* values, size_t n,
+                 uint64_t* physical) {
+    CountingScope counting(sim);
+    sim->error.clear();
+    vector<PackedEvent> chunk;
+    chunk.reserve(min(n, PACK_CHUNK));
+    for (size_t base = 0; base < n; base += PACK_CHUNK) {
+        size_t count = min(PACK_CHUNK, n - base);
+        chunk.clear();
+        for (size_t i = base; i < base + count; i++) {
+            chunk.push_back(PackedEvent{values[i], pids[i], TraceOp(ops[i])});
+        }
+        size_t done = runPacked(sim, chunk.data(), count, physical == nullptr ? nullptr : physical + base, base);
+        if (done < count) {
+            return base + done;
+        }
+    }
+    return n;
+}
+
+size_t vmsim_run_events(vmsim* sim, const vmsim_event* events, size_t n, uint64_t* physical) {
+    CountingScope counting(sim);
+    sim->error.clear();
+    return runPacked(sim, reinterpret_cast<const PackedEvent*>(events), n, physical, 0);
+}
+
+size_t vmsim_translate(vmsim* sim, uint32_t pid, uint8_t op, const uint64_t* addresses, size_t n,
+                       uint64_t* physical) {
+    CountingScope counting(sim);
+    sim->error.clear();
+    if (!isAccessOp(TraceOp(op))) {
+        sim->error = "vmsim_translate needs an access op";
+        return 0;
+    }
+    size_t done = 0;
+    try {
+        sim->sim.translateBatch(pid, TraceOp(op), addresses, n, physical, &done);
+    } catch (const exception& e) {
+        sim->error = string(e.what()) + " at address " + to_string(done);
+    }
+    return done;
+}
+
+int vmsim_run_file(vmsim* sim, const char* path) {
+    ifstream inputFile(path);
+    if (!inputFile) {
+        sim->error = string("unable to open ") + path;
+        return -1;
+    }
+    CountingScope counting(sim);
+    sim->error.clear();
+    try {
+        streamTrace(inputFile, PACK_CHUNK, [sim](const vector<PackedEvent>& chunk) {
+            sim->sim.runBatch(chunk.data(), chunk.size());
+        });
+    } catch (const exception& e) {
+        sim->error = e.what();
+        return -1;
+    }
+    return 0;
+}
+
+void vmsim_get_stats(const vmsim* sim, vmsim_stats* stats) {
+    stats->memory_access_attempts = sim->stats.memory_access_attempts;
+    stats->code_miss = sim->stats.code_miss;
+    stats->stack_miss = sim->stats.stack_miss;
+    stats->heap_miss = sim->stats.heap_miss;
+    stats->tlb_miss = sim->stats.TLB_miss;
+    stats->l1_hit = sim->stats.L1_hit;
+    stats->l2_hit = sim->stats.L2_hit;
+    stats->memory_hit = sim->stats.memory_hit;
+    stats->victim_hit = sim->stats.victim_hit;
+    stats->code_access = sim->stats.code_access;
+    stats->itlb_hit = sim->stats.itlb_hit;
+    for (int k = 0; k <= VMSIM_MAX_TLB_LEVELS; k++) {
+        stats->level_hit[k] = k <= TLB_MAX_LEVELS ? sim->stats.level_hit[k] : 0;
+    }
+    for (int k = 0; k <= VMSIM_MAX_CACHE_LEVELS; k++) {
+        stats->walk_served[k] = sim->stats.walk_served[k];
+        stats->walk_ref_served[k] = sim->stats.walk_ref_served[k];
+        stats->data_served[k] = sim->stats.data_served[k];
+    }
+    stats->numa_local = sim->stats.numa_local;
+    stats->numa_remote = sim->stats.numa_remote;
+    stats->walk_memory_ns = sim->stats.walk_memory_ns;
+    stats->data_memory_ns = sim->stats.data_memory_ns;
+    stats->arc_ops = sim->stats.replacement_ops[TLB_ARC];
+    stats->drrip_ops = sim->stats.replacement_ops[TLB_DRRIP];
+    stats->ship_ops = sim->stats.replacement_ops[TLB_SHIP];
+    stats->ship_dead_fills = sim->stats.ship_dead_fills;
+    for (int k = 0; k <= VMSIM_MAX_TLB_LEVELS; k++) {
+        for (int c = 0; c < VMSIM_MISS_CLASSES; c++) {
+            stats->miss_class[k][c] = 0;
+        }
+    }
+    stats->timing_cycles = sim->stats.timing_cycles;
+    stats->timing_blocking_cycles = sim->stats.timing_blocking_cycles;
+    stats->timing_walks = sim->stats.timing_walks;
+    stats->timing_merged = sim->stats.timing_merged;
+    stats->timing_walk_cycles = sim->stats.timing_walk_cycles;
+    stats->timing_walk_busy_cycles = sim->stats.timing_walk_busy_cycles;
+    stats->timing_max_walks = sim->stats.timing_max_walks;
+    stats->timing_window_stall = sim->stats.timing_window_stall;
+    stats->timing_mshr_stall = sim->stats.timing_mshr_stall;
+    for (const auto& entry : sim->stats.miss_classes) {
+        for (int c = 0; c < VMSIM_MISS_CLASSES; c++) {
+            stats->miss_class[entry.first.level][c] += entry.second[c];
+        }
+    }
+    stats->level_hit[1] = sim->stats.L1_hit;
+    stats->level_hit[2] = sim->stats.L2_hit;
+}
+
+void vmsim_reset_stats(vmsim* sim) {
+    sim->stats = SimStats();
+}
+
+const char* vmsim_last_error(const vmsim* sim) {
+    return sim->error.c_str();
+}
+
+}
@@ -0,0 +1,154 @@
+/* vmsim.h: C API of the simulator, built into libvmsim.so (see vmsim.py for the Python bindings) */
+#ifndef VMSIM_H
+#define VMSIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* trace instructions, in the numbering used by the op arrays passed to vmsim_run */
+enum vmsim_op {
+    VMSIM_SWITCH = 0,
+    VMSIM_ALLOC = 1,
+    VMSIM_FREE = 2,
+    VMSIM_ACCESS_CODE = 3,
+    VMSIM_ACCESS_STACK = 4,
+    VMSIM_ACCESS_HEAP = 5,
+    VMSIM_EXIT = 6,
+    VMSIM_FORK = 7      /* pid forks a child, value is the child's pid */
+};
+
+#define VMSIM_MAX_TLB_LEVELS 8
+#define VMSIM_MAX_CACHE_LEVELS 4
+/* compulsory, capacity, conflict, flush, invalidation */
+#define VMSIM_MISS_CLASSES 5
+
+typedef struct vmsim_stats {
+    long long memory_access_attempts;
+    long long code_miss;
+    long long stack_miss;
+    long long heap_miss;
+    long long tlb_miss;
+    long long l1_hit;
+    long long l2_hit;
+    long long memory_hit;
+    long long victim_hit;
+    /* with a split l1: code accesses and their iTLB hits (the rest of l1_hit is the dTLB's) */
+    long long code_access;
+    long long itlb_hit;
+    /* hits per TLB level, level_hit[1] == l1_hit and level_hit[2] == l2_hit; index 0 is unused */
+    long long level_hit[VMSIM_MAX_TLB_LEVELS + 1];
+    /* by the data cache level that served them, index VMSIM_MAX_CACHE_LEVELS for memory */
+    long long walk_served[VMSIM_MAX_CACHE_LEVELS + 1];
+    long long walk_ref_served[VMSIM_MAX_CACHE_LEVELS + 1];
+    long long data_served[VMSIM_MAX_CACHE_LEVELS + 1];
+    /* NUMA accounting, zero with a single node */
+    long long numa_local;
+    long long numa_remote;
+    long long walk_memory_ns;
+    long long data_memory_ns;
+    /* metadata work of the adaptive TLB replacement policies, zero with random/fifo/lfu/lru */
+    long long arc_ops;
+    long long drrip_ops;
+    long long ship_ops;
+    long long ship_dead_fills;
+    /* with vmsim_classify_misses: misses by TLB level (0 the iTLB of a split l1, 1 l1, 2 l2, ...) and class */
+    long long miss_class[VMSIM_MAX_TLB_LEVELS + 1][VMSIM_MISS_CLASSES];
+    /* with vmsim_configure_timing: cycles, the same with blocking walks, walks started and misses merged into
+       one in flight, walk cycles and cycles with any walk in flight (their ratio is the walk concurrency),
+       the most walks in flight, and issue stalls on a full window and on a full miss-status table */
+    long long timing_cycles;
+    long long timing_blocking_cycles;
+    long long timing_walks;
+    long long timing_merged;
+    long long timing_walk_cycles;
+    long long timing_walk_busy_cycles;
+    long long timing_max_walks;
+    long long timing_window_stall;
+    long long timing_mshr_stall;
+} vmsim_stats;
+
+/* one packed event, same layout as the simulator's PackedEvent */
+typedef struct vmsim_event {
+    uint64_t value;
+    uint32_t pid;
+    uint8_t op;
+} vmsim_event;
+
+/* opaque simulator instance: one os with its own counters */
+typedef struct vmsim vmsim;
+
+/* sizes in bytes; returns NULL if the os cannot be created */
+vmsim* vmsim_create(uint64_t memory_size, uint64_t disk_size, uint32_t high_watermark, uint32_t low_watermark);
+void vmsim_destroy(vmsim* sim);
+
+/* policy: "random", "fifo", "lfu", "lru", "arc", "drrip" or "ship". Drops every TLB entry. Returns 0, or -1 on a bad argument */
+int vmsim_configure_tlb(vmsim* sim, uint32_t l1_size, uint32_t l2_size, const char* policy, int asid_tagging,
+                        int small_pages_only);
+
+/* split l1: code gets an entries-entry iTLB with its own policy, l1_size becomes the dTLB. 0 for a unified l1.
+   Call after vmsim_configure_tlb, which unifies l1 again. Returns 0, or -1 on a bad policy */
+int vmsim_configure_itlb(vmsim* sim, uint32_t entries, const char* policy);
+
+/* victim buffer of n entries between l1 and l2, 0 to remove it */
+void vmsim_configure_victim(vmsim* sim, uint32_t entries);
+
+/* classify the misses of every TLB level (see miss_class in vmsim_stats); survives later TLB configuration */
+void vmsim_classify_misses(vmsim* sim, int enabled);
+
+/* replace the levels below l1 with a comma-separated list of
+   entries[:ways|full[:policy[:inclusive|exclusive|nine]]] specs, "" for l1 only.
+   Drops every TLB entry. Returns 0, or -1 on a bad spec */
+int vmsim_configure_levels(vmsim* sim, const char* specs);
+
+/* model page walks and data accesses in a comma-separated list of size[:ways|full[:line]] data cache levels,
+   first level first ("" turns the model off). Returns 0, or -1 on a bad spec */
+int vmsim_configure_caches(vmsim* sim, const char* specs);
+
+/* split memory into nodes equal NUMA nodes (process pid runs on node pid % nodes) placed by policy
+   "first-touch", "interleave" or "preferred[:node]", with local and remote latencies in ns.
+   Only before the first event. Returns 0, or -1 on a bad argument */
+int vmsim_configure_numa(vmsim* sim, uint32_t nodes, const char* policy, uint32_t local_ns, uint32_t remote_ns);
+
+/* time translations: a window of width accesses, walkers concurrent page walks and mshrs miss-status entries;
+   cycles: l1 hit, hit below l1, walk reference served by a cache, by memory. width 0 turns it off.
+   Returns 0, or -1 on a bad argument */
+int vmsim_configure_timing(vmsim* sim, uint32_t width, uint32_t walkers, uint32_t mshrs, uint32_t hit_cycles,
+                           uint32_t lower_hit_cycles, uint32_t cache_cycles, uint32_t memory_cycles);
+
+/* 32, 48 or 57-bit virtual addresses with 2, 4 or 5-level page tables (32 by default).
+   Only before the first event. Returns 0, or -1 on a bad argument */
+int vmsim_configure_address_bits(vmsim* sim, int va_bits);
+
+/* run n events given as parallel arrays; returns the number of events run, which is < n after an error.
+   physical (optional, n entries) receives the physical address of every access, the base virtual
+   address of every alloc and 0 for the other events */
+size_t vmsim_run(vmsim* sim, const uint32_t* pids, const uint8_t* ops, const uint64_t* values, size_t n,
+                 uint64_t* physical);
+
+/* the same for an array of packed events */
+size_t vmsim_run_events(vmsim* sim, const vmsim_event* events, size_t n, uint64_t* physical);
+
+/* access n addresses of one segment (op VMSIM_ACCESS_*) of process pid, switching to it first if it is not
+   running; physical (optional) receives the physical addresses. Returns the number of addresses translated */
+size_t vmsim_translate(vmsim* sim, uint32_t pid, uint8_t op, const uint64_t* addresses, size_t n,
+                       uint64_t* physical);
+
+/* run a trace file; returns 0, or -1 if it could not be read or an event failed */
+int vmsim_run_file(vmsim* sim, const char* path);
+
+/* counters accumulated by this instance since creation or the last reset */
+void vmsim_get_stats(const vmsim* sim, vmsim_stats* stats);
+void vmsim_reset_stats(vmsim* sim);
+
+/* message of the last failed call on this instance, empty if none */
+const char* vmsim_last_error(const vmsim* sim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* VMSIM_H */
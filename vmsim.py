@@ -0,0 +1,252 @@
+"""
+Python bindings for the simulator, in-process through ctypes over libvmsim.so.
+Build the library with `make libvmsim.so` (or the CMake `vmsim` target); set VMSIM_LIB to load it from elsewhere.
+
+    sim = vmsim.Simulator(memory_mb=4096)
+    sim.configure_tlb(l1_size=64, policy='lru')
+    sim.run(pids, ops, addrs)          # numpy arrays or any sequences, one entry per event
+    print(sim.stats().as_dict())
+"""
+import ctypes
+import os
+from array import array
+from typing import Dict, Sequence, Tuple
+
+SWITCH, ALLOC, FREE, ACCESS_CODE, ACCESS_STACK, ACCESS_HEAP, EXIT, FORK = range(8)
+
+# trace file instruction -> op
+OPS = {
+    'switch': SWITCH,
+    'alloc': ALLOC,
+    'free': FREE,
+    'access_code': ACCESS_CODE,
+    'access_stak': ACCESS_STACK,
+    'access_heap': ACCESS_HEAP,
+    'exit': EXIT,
+    'fork': FORK,
+}
+
+MB = 1024 * 1024
+
+
+MAX_TLB_LEVELS = 8
+MAX_CACHE_LEVELS = 4
+MISS_CLASSES = ('compulsory', 'capacity', 'conflict', 'flush', 'invalidation')
+
+
+class Stats(ctypes.Structure):
+    _fields_ = [(name, ctypes.c_longlong) for name in (
+        'memory_access_attempts', 'code_miss', 'stack_miss', 'heap_miss',
+        'tlb_miss', 'l1_hit', 'l2_hit', 'memory_hit', 'victim_hit', 'code_access', 'itlb_hit')] + [
+        ('level_hit', ctypes.c_longlong * (MAX_TLB_LEVELS + 1))] + [
+        (name, ctypes.c_longlong * (MAX_CACHE_LEVELS + 1)) for name in (
+            'walk_served', 'walk_ref_served', 'data_served')] + [
+        (name, ctypes.c_longlong) for name in ('numa_local', 'numa_remote', 'walk_memory_ns', 'data_memory_ns',
+                                               'arc_ops', 'drrip_ops', 'ship_ops', 'ship_dead_fills')] + [
+        ('miss_class', ctypes.c_longlong * len(MISS_CLASSES) * (MAX_TLB_LEVELS + 1))] + [
+        (name, ctypes.c_longlong) for name in (
+            'timing_cycles', 'timing_blocking_cycles', 'timing_walks', 'timing_merged', 'timing_walk_cycles',
+            'timing_walk_busy_cycles', 'timing_max_walks', 'timing_window_stall', 'timing_mshr_stall')]
+
+    @property
+    def tlb_hit_rate(self) -> float:
+        if self.memory_access_attempts == 0:
+            return 0.0
+        return (self.memory_access_attempts - self.tlb_miss) / self.memory_access_attempts
+
+    def as_dict(self) -> Dict[str, float]:
+        ret = {}
+        for name, kind in self._fields_:
+            value = getattr(self, name)
+            if kind is ctypes.c_longlong:
+                ret[name] = value
+            else:
+                ret[name] = [list(row) if isinstance(row, ctypes.Array) else row for row in value]
+        ret['tlb_hit_rate'] = self.tlb_hit_rate
+        return ret
+
+
+def _load_library() -> ctypes.CDLL:
+    path = os.environ.get('VMSIM_LIB', os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libvmsim.so'))
+    lib = ctypes.CDLL(path)
+    lib.vmsim_create.restype = ctypes.c_void_p
+    lib.vmsim_create.argtypes = [ctypes.c_uint64, ctypes.c_uint64, ctypes.c_uint32, ctypes.c_uint32]
+    lib.vmsim_destroy.argtypes = [ctypes.c_void_p]
+    lib.vmsim_configure_tlb.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint32, ctypes.c_char_p,
+                                        ctypes.c_int, ctypes.c_int]
+    lib.vmsim_configure_victim.argtypes = [ctypes.c_void_p, ctypes.c_uint32]
+    lib.vmsim_classify_misses.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.vmsim_configure_timing.argtypes = [ctypes.c_void_p] + [ctypes.c_uint32] * 7
+    lib.vmsim_configure_itlb.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p]
+    lib.vmsim_configure_levels.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.vmsim_configure_caches.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.vmsim_configure_numa.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_uint32,
+                                         ctypes.c_uint32]
+    lib.vmsim_run.restype = ctypes.c_size_t
+    lib.vmsim_configure_address_bits.argtypes = [ctypes.c_void_p, ctypes.c_int]
+    lib.vmsim_run.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_uint32), ctypes.POINTER(ctypes.c_uint8),
+                              ctypes.POINTER(ctypes.c_uint64), ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint64)]
+    lib.vmsim_translate.restype = ctypes.c_size_t
+    lib.vmsim_translate.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_uint8, ctypes.POINTER(ctypes.c_uint64),
+                                    ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint64)]
+    lib.vmsim_run_file.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    lib.vmsim_get_stats.argtypes = [ctypes.c_void_p, ctypes.POINTER(Stats)]
+    lib.vmsim_reset_stats.argtypes = [ctypes.c_void_p]
+    lib.vmsim_last_error.restype = ctypes.c_char_p
+    lib.vmsim_last_error.argtypes = [ctypes.c_void_p]
+    return lib
+
+
+_lib = None
+
+
+def _library() -> ctypes.CDLL:
+    global _lib
+    if _lib is None:
+        _lib = _load_library()
+    return _lib
+
+
+def _as_buffer(data, typecode: str, ctype, dtype: str):
+    """Contiguous buffer of data and a pointer to it; numpy arrays are used in place when they already match."""
+    if hasattr(data, '__array_interface__'):
+        import numpy
+        buf = numpy.ascontiguousarray(data, dtype=dtype)
+        return buf, buf.ctypes.data_as(ctypes.POINTER(ctype))
+    buf = data if isinstance(data, array) and data.typecode == typecode else array(typecode, data)
+    address, _ = buf.buffer_info()
+    return buf, ctypes.cast(address, ctypes.POINTER(ctype))
+
+
+def _output(n: int):
+    buf = array('Q', bytes(8 * n))
+    address, _ = buf.buffer_info()
+    return buf, ctypes.cast(address, ctypes.POINTER(ctypes.c_uint64))
+
+
+def load_trace(path: str) -> Tuple[array, array, array]:
+    """Read a trace file into (pids, ops, values) arrays, ready for Simulator.run."""
+    pids, ops, values = array('I'), array('B'), array('Q')
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if len(fields) < 2 or fields[1] not in OPS:
+                continue
+            pids.append(int(fields[0]))
+            ops.append(OPS[fields[1]])
+            # the child pid of a fork is decimal, every other value hex
+            values.append(int(fields[2], 10 if fields[1] == 'fork' else 16) if len(fields) > 2 else 0)
+    return pids, ops, values
+
+
+class Simulator:
+    def __init__(self, memory_mb: int = 4096, disk_mb: int = 10240, high_watermark_mb: int = 200,
+                 low_watermark_mb: int = 100):
+        self._lib = _library()
+        self._sim = self._lib.vmsim_create(memory_mb * MB, disk_mb * MB, high_watermark_mb * MB, low_watermark_mb * MB)
+        if not self._sim:
+            raise MemoryError('unable to create the simulator')
+
+    def close(self) -> None:
+        if self._sim:
+            self._lib.vmsim_destroy(self._sim)
+            self._sim = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc) -> None:
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def _error(self) -> str:
+        return self._lib.vmsim_last_error(self._sim).decode()
+
+    def configure_tlb(self, l1_size: int = 64, l2_size: int = 0, policy: str = 'random', asid: bool = False,
+                      small_pages: bool = False) -> None:
+        if self._lib.vmsim_configure_tlb(self._sim, l1_size, l2_size, policy.encode(), int(asid),
+                                         int(small_pages)) != 0:
+            raise ValueError(self._error())
+
+    def configure_itlb(self, entries: int, policy: str = 'random') -> None:
+        """Split l1: code gets its own iTLB (0 for a unified l1); call after configure_tlb."""
+        if self._lib.vmsim_configure_itlb(self._sim, entries, policy.encode()) != 0:
+            raise ValueError(self._error())
+
+    def configure_victim(self, entries: int) -> None:
+        self._lib.vmsim_configure_victim(self._sim, entries)
+
+    def configure_timing(self, width: int, walkers: int = 1, mshrs: int = 8, hit_cycles: int = 1,
+                         lower_hit_cycles: int = 8, cache_cycles: int = 20, memory_cycles: int = 200) -> None:
+        """Time translations with up to walkers overlapping page walks; width 0 turns it off."""
+        if self._lib.vmsim_configure_timing(self._sim, width, walkers, mshrs, hit_cycles, lower_hit_cycles,
+                                            cache_cycles, memory_cycles) != 0:
+            raise ValueError(self._error())
+
+    def classify_misses(self, enabled: bool = True) -> None:
+        """Fill stats().miss_class[level][class], level 0 being the iTLB and classes as in MISS_CLASSES."""
+        self._lib.vmsim_classify_misses(self._sim, int(enabled))
+
+    def configure_levels(self, specs: Sequence[str]) -> None:
+        """Replace the levels below l1, e.g. ['1536:12:lru:inclusive', '4096:16:fifo:exclusive']."""
+        if self._lib.vmsim_configure_levels(self._sim, ','.join(specs).encode()) != 0:
+            raise ValueError(self._error())
+
+    def configure_caches(self, specs: Sequence[str]) -> None:
+        """Model page walks and data accesses in these cache levels, e.g. ['32K:8', '256K:4', '8M:16'].
+        The *_served stats are indexed by level, with memory at index MAX_CACHE_LEVELS."""
+        if self._lib.vmsim_configure_caches(self._sim, ','.join(specs).encode()) != 0:
+            raise ValueError(self._error())
+
+    def configure_numa(self, nodes: int, policy: str = 'first-touch', local_ns: int = 80,
+                       remote_ns: int = 140) -> None:
+        """Split memory into equal NUMA nodes; only before the first event."""
+        if self._lib.vmsim_configure_numa(self._sim, nodes, policy.encode(), local_ns, remote_ns) != 0:
+            raise ValueError(self._error())
+
+    def configure_address_bits(self, va_bits: int) -> None:
+        """32, 48 or 57-bit virtual addresses (2, 4 or 5-level page tables); only before the first event."""
+        if self._lib.vmsim_configure_address_bits(self._sim, va_bits) != 0:
+            raise ValueError(self._error())
+
+    def run(self, pids: Sequence[int], ops: Sequence[int], values: Sequence[int], physical: bool = False):
+        """
+        Run one event per index of the three arrays (ops are the constants of this module).
+        With physical=True, return an array('Q') holding the physical address of every access,
+        the base virtual address of every alloc and 0 for other events.
+        """
+        n = len(ops)
+        if len(pids) != n or len(values) != n:
+            raise ValueError('pids, ops and values must have the same length')
+        pid_buf, pid_ptr = _as_buffer(pids, 'I', ctypes.c_uint32, 'uint32')
+        op_buf, op_ptr = _as_buffer(ops, 'B', ctypes.c_uint8, 'uint8')
+        value_buf, value_ptr = _as_buffer(values, 'Q', ctypes.c_uint64, 'uint64')
+        out, out_ptr = _output(n) if physical else (None, None)
+        done = self._lib.vmsim_run(self._sim, pid_ptr, op_ptr, value_ptr, n, out_ptr)
+        if done != n:
+            raise RuntimeError(self._error())
+        return out
+
+    def translate(self, pid: int, op: int, addresses: Sequence[int]) -> array:
+        """Access every address in one segment (ACCESS_CODE/STACK/HEAP) of pid, return the physical addresses."""
+        n = len(addresses)
+        addr_buf, addr_ptr = _as_buffer(addresses, 'Q', ctypes.c_uint64, 'uint64')
+        out, out_ptr = _output(n)
+        done = self._lib.vmsim_translate(self._sim, pid, op, addr_ptr, n, out_ptr)
+        if done != n:
+            raise RuntimeError(self._error())
+        return out
+
+    def run_file(self, path: str) -> None:
+        if self._lib.vmsim_run_file(self._sim, path.encode()) != 0:
+            raise RuntimeError(self._error())
+
+    def stats(self) -> Stats:
+        ret = Stats()
+        self._lib.vmsim_get_stats(self._sim, ctypes.byref(ret))
+        return ret
+
+    def reset_stats(self) -> None:
+        self._lib.vmsim_reset_stats(self._sim)